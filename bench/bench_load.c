@@ -0,0 +1,583 @@
+/**
+ * @file bench_load.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Generates end-to-end load on the sd-bus-call RPC without sysrepo or
+ *        Netopeer2. A private dbus-daemon is started on a temporary socket and
+ *        test_service is launched against it, then generic_sdbus_call_rpc_tree_cb
+ *        is driven directly with libyang input trees from a number of threads.
+ *        Requests can be padded to a batch of entries with Peer.Ping calls,
+ *        which sd-bus answers for every object path, to measure the per-entry
+ *        overhead of large batches.
+ *        Throughput and latency percentiles of the whole run are reported.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+#include <systemd/sd-bus.h>
+
+#include "bus-connection.h"
+
+#ifndef BENCH_YANG_DIR
+#define BENCH_YANG_DIR "./yang"
+#endif
+#ifndef BENCH_TEST_SERVICE
+#define BENCH_TEST_SERVICE "./tests/test_service"
+#endif
+
+#define BENCH_YANG_MODEL "generic-sd-bus"
+#define BENCH_SERVICE "net.sysrepo.SDBUSTest"
+#define BENCH_OBJECT_PATH "/net/sysrepo/SDBUSTest"
+#define BENCH_INTERFACE "net.sysrepo.SDBUSTest"
+#define BENCH_CALL_PATH "/" BENCH_YANG_MODEL ":sd-bus-call"
+#define BENCH_MESSAGE_XPATH BENCH_CALL_PATH "/sd-bus-message[sd-bus='USER'][sd-bus-service='" BENCH_SERVICE "']" \
+											"[sd-bus-object-path='" BENCH_OBJECT_PATH "'][sd-bus-interface='" BENCH_INTERFACE "']" \
+											"[sd-bus-method='%s']/%s"
+#define BENCH_PING_XPATH BENCH_CALL_PATH "/sd-bus-message[sd-bus='USER'][sd-bus-service='" BENCH_SERVICE "']" \
+										 "[sd-bus-object-path='" BENCH_OBJECT_PATH "/%zu'][sd-bus-interface='org.freedesktop.DBus.Peer']" \
+										 "[sd-bus-method='Ping']/%s"
+#define BENCH_XPATH_SIZE 512
+#define BENCH_STATUS_PATH "sd-bus-result/sd-bus-status"
+#define BENCH_STATUS_OK "ok"
+#define BENCH_SERVICE_WAIT_USEC 5000000ULL
+
+#define BENCH_CONCURRENCY_DEFAULT 4
+#define BENCH_REQUESTS_DEFAULT 10000
+#define BENCH_METHOD_DEFAULT "Test9"
+
+// a method of test_service and arguments it accepts as a passing test
+typedef struct bench_method_s {
+	const char *name;
+	const char *signature;
+	const char *arguments;
+} bench_method_t;
+
+typedef struct bench_load_s {
+	const struct ly_ctx *ctx;
+	const char *method;
+	// sd-bus-message entries of every request, 0 for just the selected methods
+	size_t batch;
+	// entries every request ends up with
+	size_t entries;
+	size_t requests;
+	pthread_mutex_t lock;
+	// next request to be sent, shared by all threads
+	size_t next;
+	size_t failed;
+	// latency of every request in nanoseconds, indexed by request
+	uint64_t *latencies;
+} bench_load_t;
+
+// sysrepo plugin callbacks are not declared in a header of their own
+int generic_sdbus_call_rpc_tree_cb(sr_session_ctx_t *session, const char *op_path,
+								   const struct lyd_node *input, sr_event_t event,
+								   uint32_t request_id, struct lyd_node *output,
+								   void *private_data);
+int generic_sdbus_schema_init(const struct ly_ctx *ctx);
+
+static uint64_t bench_now(void);
+static int bench_process_start(char *const argv[], int output_fd, pid_t *pid);
+static void bench_process_stop(pid_t pid);
+static int bench_daemon_start(const char *address, pid_t *pid);
+static int bench_service_wait(void);
+static struct lyd_node *bench_input_build(const struct ly_ctx *ctx, const char *method, size_t batch);
+static void *bench_load_thread(void *arg);
+static int bench_latency_compare(const void *a, const void *b);
+static uint64_t bench_percentile(const uint64_t *latencies, size_t count, double percentile);
+
+static const bench_method_t bench_methods[] = {
+	{"Test1", "s", "\"str_arg\""},
+	{"Test2", "x", "15"},
+	{"Test3", "d", "1.1532"},
+	{"Test4", "v", "au 1 14460"},
+	{"Test5", "a{ss}", "2 \"str_arg\" \"str_arg\" \"str_arg\" \"str_arg\""},
+	{"Test6", "a(ssso)", "2 \"str_arg\" \"str_arg\" \"str_arg\" \"/test/test\" \"str_arg\" \"str_arg\" \"str_arg\" \"/test/test\""},
+	{"Test7", "asssbb", "4 \"str_arg\" \"str_arg\" \"str_arg\" \"str_arg\" \"str_arg\" \"str_arg\" 1 0"},
+	{"Test8", "sayssusaia(sv)", "\"str_arg\" 2 10 20 \"str_arg\" \"str_arg\" 1000 \"str_arg\" 3 1 2 3 3 \"str_arg\" s \"str_arg\" "
+								"\"str_arg\" u 1000 \"str_arg\" b 1"},
+	{"Test9", "ssa(sv)a(sa(sv))", "\"str_arg\" \"str_arg\" 2 \"str_arg\" au 1 14460 \"str_arg\" s \"str_arg\" 2 \"str_arg\" 3 "
+								  "\"str_arg\" y 1 \"str_arg\" u 2 \"str_arg\" x 3 \"str_arg\" 0"},
+};
+
+int main(int argc, char **argv)
+{
+	int error = 0;
+	int option = 0;
+	size_t concurrency = BENCH_CONCURRENCY_DEFAULT;
+	const char *yang_dir = BENCH_YANG_DIR;
+	const char *test_service = BENCH_TEST_SERVICE;
+	char directory[] = "/tmp/bench-load-XXXXXX";
+	char socket_path[sizeof(directory) + 8] = {0};
+	char address[sizeof(socket_path) + 16] = {0};
+	pid_t daemon_pid = -1;
+	pid_t service_pid = -1;
+	int null_fd = -1;
+	struct ly_ctx *ctx = NULL;
+	pthread_t *threads = NULL;
+	size_t threads_count = 0;
+	bench_load_t load = {.method = BENCH_METHOD_DEFAULT, .requests = BENCH_REQUESTS_DEFAULT};
+	uint64_t begin = 0;
+	uint64_t elapsed = 0;
+
+	while ((option = getopt(argc, argv, "c:n:m:b:s:y:h")) != -1) {
+		switch (option) {
+			case 'c':
+				concurrency = strtoul(optarg, NULL, 10);
+				break;
+			case 'n':
+				load.requests = strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				load.method = optarg;
+				break;
+			case 'b':
+				load.batch = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				test_service = optarg;
+				break;
+			case 'y':
+				yang_dir = optarg;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-c concurrency] [-n requests] [-m Test1..Test9|all] [-b batch] [-s test_service] [-y yang-dir]\n", argv[0]);
+				return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (concurrency == 0 || load.requests == 0) {
+		fprintf(stderr, "concurrency and requests must be positive\n");
+		return EXIT_FAILURE;
+	}
+	pthread_mutex_init(&load.lock, NULL);
+
+	// "all" puts every method into a request, the batch only pads it
+	load.entries = (strcmp(load.method, "all") == 0) ? sizeof(bench_methods) / sizeof(bench_methods[0]) : 1;
+	if (load.batch > load.entries) {
+		load.entries = load.batch;
+	}
+
+	load.latencies = calloc(load.requests, sizeof(uint64_t));
+	threads = calloc(concurrency, sizeof(pthread_t));
+	if (load.latencies == NULL || threads == NULL) {
+		fprintf(stderr, "out of memory\n");
+		error = -ENOMEM;
+		goto out;
+	}
+
+	ctx = ly_ctx_new(yang_dir, 0);
+	if (ctx == NULL || ly_ctx_load_module(ctx, BENCH_YANG_MODEL, NULL) == NULL) {
+		fprintf(stderr, "failed to load the %s module from %s\n", BENCH_YANG_MODEL, yang_dir);
+		error = -ENOENT;
+		goto out;
+	}
+	load.ctx = ctx;
+
+	// the plugin init is not run, the RPC callback still needs the resolved schema
+	if (generic_sdbus_schema_init(ctx) != SR_ERR_OK) {
+		fprintf(stderr, "failed to resolve the schema of the %s module\n", BENCH_YANG_MODEL);
+		error = -ENOENT;
+		goto out;
+	}
+
+	// the bus lives and dies with this run, nothing else can reach it
+	if (mkdtemp(directory) == NULL) {
+		error = -errno;
+		fprintf(stderr, "failed to create a temporary directory: %s\n", strerror(-error));
+		goto out;
+	}
+	snprintf(socket_path, sizeof(socket_path), "%s/bus", directory);
+	snprintf(address, sizeof(address), "unix:path=%s", socket_path);
+
+	error = bench_daemon_start(address, &daemon_pid);
+	if (error < 0) {
+		fprintf(stderr, "failed to start dbus-daemon: %s\n", strerror(-error));
+		goto out;
+	}
+	// test_service and the plugin both connect to the user bus
+	setenv("DBUS_SESSION_BUS_ADDRESS", address, 1);
+
+	// test_service reports every call on its standard output
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	error = bench_process_start((char *const[]){(char *) test_service, NULL}, null_fd, &service_pid);
+	if (error < 0) {
+		fprintf(stderr, "failed to start %s: %s\n", test_service, strerror(-error));
+		goto out;
+	}
+
+	error = bench_service_wait();
+	if (error < 0) {
+		fprintf(stderr, "%s did not appear on the bus: %s\n", BENCH_SERVICE, strerror(-error));
+		goto out;
+	}
+
+	begin = bench_now();
+	for (threads_count = 0; threads_count < concurrency; threads_count++) {
+		error = -pthread_create(&threads[threads_count], NULL, bench_load_thread, &load);
+		if (error < 0) {
+			fprintf(stderr, "failed to start a load thread: %s\n", strerror(-error));
+			break;
+		}
+	}
+	for (size_t i = 0; i < threads_count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	elapsed = bench_now() - begin;
+	if (error < 0) {
+		goto out;
+	}
+
+	qsort(load.latencies, load.requests, sizeof(uint64_t), bench_latency_compare);
+
+	printf("method:      %s\n", load.method);
+	printf("concurrency: %zu\n", concurrency);
+	printf("entries:     %zu per request\n", load.entries);
+	printf("requests:    %zu (%zu failed)\n", load.requests, load.failed);
+	printf("throughput:  %.1f requests/s\n", (double) load.requests * 1e9 / (double) elapsed);
+	printf("per entry:   %.2f us\n", (double) bench_percentile(load.latencies, load.requests, 50.0) / 1e3 / (double) load.entries);
+	printf("latency p50: %.1f us\n", (double) bench_percentile(load.latencies, load.requests, 50.0) / 1e3);
+	printf("latency p99: %.1f us\n", (double) bench_percentile(load.latencies, load.requests, 99.0) / 1e3);
+	printf("latency p999: %.1f us\n", (double) bench_percentile(load.latencies, load.requests, 99.9) / 1e3);
+	printf("latency max: %.1f us\n", (double) load.latencies[load.requests - 1] / 1e3);
+
+	if (load.failed > 0) {
+		error = -EIO;
+	}
+
+out:
+	bench_process_stop(service_pid);
+	bench_process_stop(daemon_pid);
+	if (socket_path[0] != '\0') {
+		unlink(socket_path);
+		rmdir(directory);
+	}
+	if (null_fd >= 0) {
+		close(null_fd);
+	}
+	if (ctx != NULL) {
+		ly_ctx_destroy(ctx, NULL);
+	}
+	pthread_mutex_destroy(&load.lock);
+	free(threads);
+	free(load.latencies);
+
+	return (error < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_process_start(char *const argv[], int output_fd, pid_t *pid)
+{
+	*pid = fork();
+	if (*pid < 0) {
+		return -errno;
+	}
+
+	if (*pid == 0) {
+		if (output_fd >= 0) {
+			dup2(output_fd, STDOUT_FILENO);
+		}
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	return 0;
+}
+
+static void bench_process_stop(pid_t pid)
+{
+	if (pid <= 0) {
+		return;
+	}
+
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+}
+
+/*
+ * @brief Starts a private dbus-daemon with the session bus policy and waits
+ *        until it listens, which it signals by printing its address.
+ *
+ * @param[in] address address the daemon listens on.
+ * @param[out] pid process of the daemon.
+ *
+ * @return error code.
+ */
+static int bench_daemon_start(const char *address, pid_t *pid)
+{
+	int error = 0;
+	int fds[2] = {-1, -1};
+	char address_option[BENCH_XPATH_SIZE] = {0};
+	char print_option[32] = {0};
+	char printed[BENCH_XPATH_SIZE] = {0};
+	ssize_t size = 0;
+
+	// only the write end is inherited by the daemon
+	if (pipe2(fds, O_CLOEXEC) < 0) {
+		return -errno;
+	}
+
+	*pid = fork();
+	if (*pid < 0) {
+		error = -errno;
+		goto out;
+	}
+
+	if (*pid == 0) {
+		fcntl(fds[1], F_SETFD, 0);
+		snprintf(address_option, sizeof(address_option), "--address=%s", address);
+		snprintf(print_option, sizeof(print_option), "--print-address=%d", fds[1]);
+		execlp("dbus-daemon", "dbus-daemon", "--session", "--nofork", "--nopidfile", address_option, print_option, (char *) NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+	fds[1] = -1;
+
+	size = read(fds[0], printed, sizeof(printed) - 1);
+	if (size <= 0) {
+		error = (size < 0) ? -errno : -ECHILD;
+		bench_process_stop(*pid);
+		*pid = -1;
+	}
+
+out:
+	close(fds[0]);
+	if (fds[1] >= 0) {
+		close(fds[1]);
+	}
+
+	return error;
+}
+
+/*
+ * @brief Waits until test_service owns its name on the private bus.
+ *
+ * @return error code.
+ */
+static int bench_service_wait(void)
+{
+	int error = 0;
+	int has_owner = 0;
+	sd_bus *bus = NULL;
+	sd_bus_message *reply = NULL;
+	uint64_t deadline = bench_now() + BENCH_SERVICE_WAIT_USEC * 1000ULL;
+
+	error = sd_bus_open_user(&bus);
+	if (error < 0) {
+		return error;
+	}
+
+	while (!has_owner) {
+		error = sd_bus_call_method(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+								   "NameHasOwner", NULL, &reply, "s", BENCH_SERVICE);
+		if (error >= 0) {
+			error = sd_bus_message_read(reply, "b", &has_owner);
+			reply = sd_bus_message_unref(reply);
+		}
+		if (error < 0) {
+			break;
+		}
+		if (!has_owner) {
+			if (bench_now() > deadline) {
+				error = -ETIMEDOUT;
+				break;
+			}
+			usleep(10000);
+		}
+	}
+
+	sd_bus_flush_close_unref(bus);
+
+	return (error < 0) ? error : 0;
+}
+
+/*
+ * @brief Builds the sd-bus-call input with one sd-bus-message entry for the
+ *        given method, or one entry for every method if it is "all". The
+ *        input is then padded with Peer.Ping entries up to the batch size.
+ *
+ * @param[in] ctx libyang context with the plugin module loaded.
+ * @param[in] method name of the test_service method.
+ * @param[in] batch number of entries of the input.
+ *
+ * @return RPC input tree, or NULL if it could not be built.
+ */
+static struct lyd_node *bench_input_build(const struct ly_ctx *ctx, const char *method, size_t batch)
+{
+	struct lyd_node *input = NULL;
+	struct lyd_node *node = NULL;
+	char xpath[BENCH_XPATH_SIZE] = {0};
+	bool found = false;
+	size_t entries = 0;
+
+	for (size_t i = 0; i < sizeof(bench_methods) / sizeof(bench_methods[0]); i++) {
+		if (strcmp(method, "all") != 0 && strcmp(method, bench_methods[i].name) != 0) {
+			continue;
+		}
+		found = true;
+
+		snprintf(xpath, sizeof(xpath), BENCH_MESSAGE_XPATH, bench_methods[i].name, "sd-bus-method-signature");
+		node = lyd_new_path(input, ctx, xpath, (void *) bench_methods[i].signature, 0, 0);
+		if (node == NULL) {
+			goto error_out;
+		}
+		// the first path creates the whole tree and returns its root
+		if (input == NULL) {
+			input = node;
+		}
+
+		snprintf(xpath, sizeof(xpath), BENCH_MESSAGE_XPATH, bench_methods[i].name, "sd-bus-method-arguments");
+		if (lyd_new_path(input, ctx, xpath, (void *) bench_methods[i].arguments, 0, 0) == NULL) {
+			goto error_out;
+		}
+		entries++;
+	}
+
+	if (!found) {
+		goto error_out;
+	}
+
+	// every entry needs a key of its own, so every ping goes to another object path
+	for (; entries < batch; entries++) {
+		snprintf(xpath, sizeof(xpath), BENCH_PING_XPATH, entries, "sd-bus-method-signature");
+		if (lyd_new_path(input, ctx, xpath, "", 0, 0) == NULL) {
+			goto error_out;
+		}
+
+		snprintf(xpath, sizeof(xpath), BENCH_PING_XPATH, entries, "sd-bus-method-arguments");
+		if (lyd_new_path(input, ctx, xpath, "", 0, 0) == NULL) {
+			goto error_out;
+		}
+	}
+
+	return input;
+
+error_out:
+	lyd_free_withsiblings(input);
+
+	return NULL;
+}
+
+static void *bench_load_thread(void *arg)
+{
+	bench_load_t *load = (bench_load_t *) arg;
+	bus_connection_pool_t *connections = NULL;
+	struct lyd_node *input = NULL;
+	struct lyd_node *output = NULL;
+	struct ly_set *statuses = NULL;
+	size_t request = 0;
+	uint64_t begin = 0;
+	bool failed = false;
+	int rc = SR_ERR_OK;
+
+	// every thread gets its own bus connections, like every sysrepo worker would
+	if (bus_connection_pool_create(&connections) < 0) {
+		fprintf(stderr, "failed to create a bus connection pool\n");
+		return NULL;
+	}
+
+	input = bench_input_build(load->ctx, load->method, load->batch);
+	if (input == NULL) {
+		fprintf(stderr, "failed to build the input of method %s\n", load->method);
+		goto out;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&load->lock);
+		request = load->next++;
+		pthread_mutex_unlock(&load->lock);
+		if (request >= load->requests) {
+			break;
+		}
+
+		output = lyd_new_path(NULL, load->ctx, BENCH_CALL_PATH, NULL, 0, LYD_PATH_OPT_OUTPUT);
+
+		begin = bench_now();
+		rc = (output == NULL) ? SR_ERR_NOMEM : generic_sdbus_call_rpc_tree_cb(NULL, BENCH_CALL_PATH, input, SR_EV_RPC, (uint32_t) request, output, connections);
+		load->latencies[request] = bench_now() - begin;
+
+		// failed sd-bus calls only show up in the status of their result
+		failed = (rc != SR_ERR_OK);
+		statuses = failed ? NULL : lyd_find_path(output, BENCH_STATUS_PATH);
+		for (unsigned int i = 0; statuses != NULL && i < statuses->number; i++) {
+			failed = failed || strcmp(((struct lyd_node_leaf_list *) statuses->set.d[i])->value_str, BENCH_STATUS_OK) != 0;
+		}
+		failed = failed || statuses == NULL || statuses->number == 0;
+		ly_set_free(statuses);
+		lyd_free_withsiblings(output);
+
+		if (failed) {
+			pthread_mutex_lock(&load->lock);
+			load->failed++;
+			pthread_mutex_unlock(&load->lock);
+		}
+	}
+
+out:
+	lyd_free_withsiblings(input);
+	bus_connection_pool_destroy(connections);
+
+	return NULL;
+}
+
+static int bench_latency_compare(const void *a, const void *b)
+{
+	uint64_t left = *(const uint64_t *) a;
+	uint64_t right = *(const uint64_t *) b;
+
+	return (left > right) - (left < right);
+}
+
+// nearest-rank percentile of sorted latencies
+static uint64_t bench_percentile(const uint64_t *latencies, size_t count, double percentile)
+{
+	size_t rank = (size_t) ((percentile / 100.0) * (double) count + 0.999999);
+
+	if (rank == 0) {
+		rank = 1;
+	}
+	if (rank > count) {
+		rank = count;
+	}
+
+	return latencies[rank - 1];
+}
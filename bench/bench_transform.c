@@ -0,0 +1,505 @@
+/**
+ * @file bench_transform.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Measures bus_message_encode and bus_message_decode over a corpus of
+ *        signatures. Messages are built on a local bus that is never connected
+ *        to a daemon, so neither sysrepo nor a running bus is needed. Every
+ *        case reports the time, the heap allocations and the allocated bytes
+ *        per operation, allocations are counted by interposing the allocator.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/socket.h>
+
+#include <systemd/sd-bus.h>
+
+#include "transform-sd-bus.h"
+
+#define BENCH_MIN_TIME_MSEC_DEFAULT 500
+#define BENCH_BOOTSTRAP_SIZE 4096
+
+// a signature and a generator of its arguments in the busctl format
+typedef struct bench_case_s {
+	const char *name;
+	const char *signature;
+	void (*arguments)(FILE *stream);
+} bench_case_t;
+
+typedef struct bench_result_s {
+	uint64_t operations;
+	uint64_t elapsed_nsec;
+	uint64_t allocations;
+	uint64_t bytes;
+} bench_result_t;
+
+static void *(*bench_real_malloc)(size_t size) = NULL;
+static void *(*bench_real_calloc)(size_t count, size_t size) = NULL;
+static void *(*bench_real_realloc)(void *pointer, size_t size) = NULL;
+static void (*bench_real_free)(void *pointer) = NULL;
+// serves dlsym while the real allocator is being looked up
+static char bench_bootstrap[BENCH_BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bench_bootstrap_used = 0;
+static bool bench_counting = false;
+static uint64_t bench_allocations = 0;
+static uint64_t bench_bytes = 0;
+
+static void bench_allocator_init(void);
+static uint64_t bench_now(void);
+static int bench_bus_open(sd_bus **bus);
+static int bench_message_new(sd_bus *bus, sd_bus_message **m);
+static int bench_encode(sd_bus *bus, const char *signature, const char *arguments, uint64_t operations);
+static int bench_decode(sd_bus_message *m, uint64_t operations);
+static int bench_run(sd_bus *bus, const bench_case_t *bench_case, bool decode, uint64_t min_time_nsec, bench_result_t *result);
+static void bench_result_print(const char *name, const char *operation, const bench_result_t *result);
+
+static void bench_arguments_basic(FILE *stream);
+static void bench_arguments_string_long(FILE *stream);
+static void bench_arguments_array_large(FILE *stream);
+static void bench_arguments_array_strings(FILE *stream);
+static void bench_arguments_dict_large(FILE *stream);
+static void bench_arguments_struct_deep(FILE *stream);
+static void bench_arguments_array_deep(FILE *stream);
+static void bench_arguments_variant_deep(FILE *stream);
+static void bench_arguments_mixed(FILE *stream);
+
+#define BENCH_ARRAY_DEPTH 32
+#define BENCH_VARIANT_DEPTH 32
+
+static const bench_case_t bench_cases[] = {
+	{"basic", "ybnqiuxtdsog", bench_arguments_basic},
+	{"string-1m", "s", bench_arguments_string_long},
+	{"array-u-65536", "au", bench_arguments_array_large},
+	{"array-s-4096", "as", bench_arguments_array_strings},
+	{"dict-sv-1024", "a{sv}", bench_arguments_dict_large},
+	{"struct-depth-32", "(((((((((((((((((((((((((((((((("
+						"i))))))))))))))))))))))))))))))))",
+	 bench_arguments_struct_deep},
+	{"array-depth-32", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaai", bench_arguments_array_deep},
+	{"variant-depth-32", "v", bench_arguments_variant_deep},
+	{"mixed", "ssa(sv)a(sa(sv))", bench_arguments_mixed},
+};
+
+void *malloc(size_t size)
+{
+	if (bench_real_malloc == NULL) {
+		bench_allocator_init();
+	}
+	if (bench_counting) {
+		bench_allocations++;
+		bench_bytes += size;
+	}
+
+	return bench_real_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+	void *pointer = NULL;
+
+	if (bench_real_calloc == NULL) {
+		// dlsym allocates before the real calloc is known, these blocks are never freed
+		size = (count * size + 15) & ~(size_t) 15;
+		if (bench_bootstrap_used + size > sizeof(bench_bootstrap)) {
+			return NULL;
+		}
+		pointer = bench_bootstrap + bench_bootstrap_used;
+		bench_bootstrap_used += size;
+		return pointer;
+	}
+	if (bench_counting) {
+		bench_allocations++;
+		bench_bytes += count * size;
+	}
+
+	return bench_real_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size)
+{
+	if (bench_real_realloc == NULL) {
+		bench_allocator_init();
+	}
+	if (bench_counting) {
+		bench_allocations++;
+		bench_bytes += size;
+	}
+
+	return bench_real_realloc(pointer, size);
+}
+
+void free(void *pointer)
+{
+	if ((char *) pointer >= bench_bootstrap && (char *) pointer < bench_bootstrap + sizeof(bench_bootstrap)) {
+		return;
+	}
+	if (bench_real_free == NULL) {
+		bench_allocator_init();
+	}
+
+	bench_real_free(pointer);
+}
+
+int main(int argc, char **argv)
+{
+	int error = 0;
+	int option = 0;
+	const char *filter = NULL;
+	uint64_t min_time_nsec = BENCH_MIN_TIME_MSEC_DEFAULT * 1000000ULL;
+	sd_bus *bus = NULL;
+	bench_result_t result = {0};
+
+	while ((option = getopt(argc, argv, "t:h")) != -1) {
+		switch (option) {
+			case 't':
+				min_time_nsec = strtoull(optarg, NULL, 10) * 1000000ULL;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-t min-time-msec] [case-filter]\n", argv[0]);
+				return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind < argc) {
+		filter = argv[optind];
+	}
+
+	error = bench_bus_open(&bus);
+	if (error < 0) {
+		fprintf(stderr, "failed to open a local bus: %s\n", strerror(-error));
+		return EXIT_FAILURE;
+	}
+
+	printf("%-20s %-8s %14s %14s %14s\n", "case", "op", "ns/op", "allocs/op", "bytes/op");
+
+	for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++) {
+		if (filter != NULL && strstr(bench_cases[i].name, filter) == NULL) {
+			continue;
+		}
+
+		error = bench_run(bus, &bench_cases[i], false, min_time_nsec, &result);
+		if (error < 0) {
+			fprintf(stderr, "%s: encode failed: %s\n", bench_cases[i].name, strerror(-error));
+			goto out;
+		}
+		bench_result_print(bench_cases[i].name, "encode", &result);
+
+		error = bench_run(bus, &bench_cases[i], true, min_time_nsec, &result);
+		if (error < 0) {
+			fprintf(stderr, "%s: decode failed: %s\n", bench_cases[i].name, strerror(-error));
+			goto out;
+		}
+		bench_result_print(bench_cases[i].name, "decode", &result);
+	}
+
+out:
+	sd_bus_close_unref(bus);
+
+	return (error < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void bench_allocator_init(void)
+{
+	// POSIX way of converting the object pointers returned by dlsym
+	*(void **) (&bench_real_malloc) = dlsym(RTLD_NEXT, "malloc");
+	*(void **) (&bench_real_realloc) = dlsym(RTLD_NEXT, "realloc");
+	*(void **) (&bench_real_free) = dlsym(RTLD_NEXT, "free");
+	*(void **) (&bench_real_calloc) = dlsym(RTLD_NEXT, "calloc");
+	if (bench_real_malloc == NULL || bench_real_realloc == NULL || bench_real_free == NULL || bench_real_calloc == NULL) {
+		abort();
+	}
+}
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/*
+ * @brief Opens a bus on one end of a socket pair. The bus starts authenticating
+ *        and stays in that state, which is enough to build and seal messages.
+ *
+ * @param[out] bus local bus.
+ *
+ * @return error code.
+ */
+static int bench_bus_open(sd_bus **bus)
+{
+	int error = 0;
+	int fds[2] = {-1, -1};
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		return -errno;
+	}
+
+	error = sd_bus_new(bus);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	error = sd_bus_set_fd(*bus, fds[0], fds[0]);
+	if (error < 0) {
+		goto error_out;
+	}
+	// the bus owns its end of the pair from now on
+	fds[0] = -1;
+
+	error = sd_bus_start(*bus);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	// nobody ever answers the authentication, the other end is not needed
+	close(fds[1]);
+
+	return 0;
+
+error_out:
+	*bus = sd_bus_unref(*bus);
+	if (fds[0] >= 0) {
+		close(fds[0]);
+	}
+	close(fds[1]);
+
+	return error;
+}
+
+static int bench_message_new(sd_bus *bus, sd_bus_message **m)
+{
+	return sd_bus_message_new_method_call(bus, m, "org.sysrepo.Bench", "/org/sysrepo/Bench", "org.sysrepo.Bench", "Bench");
+}
+
+static int bench_encode(sd_bus *bus, const char *signature, const char *arguments, uint64_t operations)
+{
+	int error = 0;
+	sd_bus_message *m = NULL;
+
+	for (uint64_t i = 0; i < operations; i++) {
+		error = bench_message_new(bus, &m);
+		if (error < 0) {
+			return error;
+		}
+
+		error = bus_message_encode(signature, arguments, m);
+		sd_bus_message_unref(m);
+		if (error < 0) {
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+static int bench_decode(sd_bus_message *m, uint64_t operations)
+{
+	int error = 0;
+	char *arguments = NULL;
+
+	for (uint64_t i = 0; i < operations; i++) {
+		error = sd_bus_message_rewind(m, 1);
+		if (error < 0) {
+			return error;
+		}
+
+		error = bus_message_decode(m, &arguments);
+		free(arguments);
+		arguments = NULL;
+		if (error < 0) {
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Runs a case for at least the minimum time. The number of operations
+ *        is doubled until a run takes long enough, so the clock and the
+ *        counters are read around a single run.
+ *
+ * @param[in] bus local bus the messages are built on.
+ * @param[in] bench_case case to be run.
+ * @param[in] decode measure bus_message_decode instead of bus_message_encode.
+ * @param[in] min_time_nsec minimum duration of the measured run.
+ * @param[out] result measurements of the last run.
+ *
+ * @return error code.
+ */
+static int bench_run(sd_bus *bus, const bench_case_t *bench_case, bool decode, uint64_t min_time_nsec, bench_result_t *result)
+{
+	int error = 0;
+	char *arguments = NULL;
+	size_t arguments_size = 0;
+	FILE *stream = NULL;
+	sd_bus_message *m = NULL;
+	uint64_t begin = 0;
+
+	stream = open_memstream(&arguments, &arguments_size);
+	if (stream == NULL) {
+		return -errno;
+	}
+	bench_case->arguments(stream);
+	if (fclose(stream) != 0) {
+		free(arguments);
+		return -ENOMEM;
+	}
+
+	if (decode) {
+		// a single sealed message is read over and over again
+		error = bench_message_new(bus, &m);
+		if (error < 0) {
+			goto out;
+		}
+		error = bus_message_encode(bench_case->signature, arguments, m);
+		if (error < 0) {
+			goto out;
+		}
+		error = sd_bus_message_seal(m, 1, 0);
+		if (error < 0) {
+			goto out;
+		}
+	}
+
+	for (result->operations = 1;; result->operations *= 2) {
+		bench_allocations = 0;
+		bench_bytes = 0;
+		bench_counting = true;
+		begin = bench_now();
+
+		error = decode ? bench_decode(m, result->operations) : bench_encode(bus, bench_case->signature, arguments, result->operations);
+
+		result->elapsed_nsec = bench_now() - begin;
+		bench_counting = false;
+		result->allocations = bench_allocations;
+		result->bytes = bench_bytes;
+
+		if (error < 0 || result->elapsed_nsec >= min_time_nsec) {
+			break;
+		}
+	}
+
+out:
+	sd_bus_message_unref(m);
+	free(arguments);
+
+	return error;
+}
+
+static void bench_result_print(const char *name, const char *operation, const bench_result_t *result)
+{
+	double operations = (double) result->operations;
+
+	printf("%-20s %-8s %14.1f %14.1f %14.1f\n", name, operation, (double) result->elapsed_nsec / operations,
+		   (double) result->allocations / operations, (double) result->bytes / operations);
+}
+
+static void bench_arguments_basic(FILE *stream)
+{
+	fputs("255 1 -32768 65535 -2147483648 4294967295 -9223372036854775807 18446744073709551615 "
+		  "3.14159 \"str_arg\" \"/org/sysrepo/Bench\" \"a{sv}\"",
+		  stream);
+}
+
+static void bench_arguments_string_long(FILE *stream)
+{
+	fputc('"', stream);
+	for (size_t i = 0; i < 1024 * 1024; i++) {
+		fputc('a' + (int) (i % 26), stream);
+	}
+	fputc('"', stream);
+}
+
+static void bench_arguments_array_large(FILE *stream)
+{
+	fprintf(stream, "%d", 65536);
+	for (unsigned int i = 0; i < 65536; i++) {
+		fprintf(stream, " %u", i * 2654435761U);
+	}
+}
+
+static void bench_arguments_array_strings(FILE *stream)
+{
+	fprintf(stream, "%d", 4096);
+	for (int i = 0; i < 4096; i++) {
+		fprintf(stream, " \"unit-%08d.service-with-a-longer-name\"", i);
+	}
+}
+
+static void bench_arguments_dict_large(FILE *stream)
+{
+	fprintf(stream, "%d", 1024);
+	for (int i = 0; i < 1024; i++) {
+		switch (i % 4) {
+			case 0:
+				fprintf(stream, " \"Property%d\" s \"value-%d\"", i, i);
+				break;
+			case 1:
+				fprintf(stream, " \"Property%d\" u %d", i, i);
+				break;
+			case 2:
+				fprintf(stream, " \"Property%d\" b %d", i, i % 2);
+				break;
+			default:
+				fprintf(stream, " \"Property%d\" as 2 \"first-%d\" \"second-%d\"", i, i, i);
+				break;
+		}
+	}
+}
+
+static void bench_arguments_struct_deep(FILE *stream)
+{
+	fputs("42", stream);
+}
+
+static void bench_arguments_array_deep(FILE *stream)
+{
+	// one element on every level but the innermost one
+	for (int i = 0; i < BENCH_ARRAY_DEPTH - 1; i++) {
+		fputs("1 ", stream);
+	}
+	fputs("4 1 2 3 4", stream);
+}
+
+static void bench_arguments_variant_deep(FILE *stream)
+{
+	for (int i = 0; i < BENCH_VARIANT_DEPTH - 1; i++) {
+		fputs("v ", stream);
+	}
+	fputs("i 42", stream);
+}
+
+static void bench_arguments_mixed(FILE *stream)
+{
+	fputs("\"str_arg\" \"str_arg\" 2 \"str_arg\" au 1 14460 \"str_arg\" s \"str_arg\" 2 \"str_arg\" 3 "
+		  "\"str_arg\" y 1 \"str_arg\" u 2 \"str_arg\" x 3 \"str_arg\" 0",
+		  stream);
+}
@@ -0,0 +1,410 @@
+/**
+ * @file bus-cache.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements a cache of decoded sd-bus replies for allow-listed methods.
+ *        Entries are keyed by the whole call, see bus_call_key_build(). Every
+ *        entry lives for the TTL of the first rule matching its method, and
+ *        the least recently used entries are evicted once the cache grows
+ *        past its memory cap.
+ *        The cache is shared by the worker threads and guarded by a mutex.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "bus-cache.h"
+#include "hashmap.h"
+
+typedef struct bus_cache_entry_s {
+	// least recently used list, most recent first
+	struct bus_cache_entry_s *prev;
+	struct bus_cache_entry_s *next;
+	char *key;
+	size_t key_size;
+	char *response;
+	char *signature;
+	uint64_t expires_usec;
+	// memory accounted for the entry
+	size_t size;
+} bus_cache_entry_t;
+
+struct bus_cache_s {
+	pthread_mutex_t lock;
+	// rules and their strings share a single allocation
+	bus_cache_rule_t *rules;
+	size_t rules_count;
+	size_t max_bytes;
+	size_t bytes;
+	// key -> bus_cache_entry_t, entries are freed by the cache itself
+	hashmap_t *entries;
+	bus_cache_entry_t *head;
+	bus_cache_entry_t *tail;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+static uint64_t bus_cache_ttl(bus_cache_t *cache, const bus_call_t *call);
+static bool bus_cache_allowed(bus_cache_t *cache, const bus_call_t *call);
+static void bus_cache_entry_link(bus_cache_t *cache, bus_cache_entry_t *entry);
+static void bus_cache_entry_unlink(bus_cache_t *cache, bus_cache_entry_t *entry);
+static void bus_cache_entry_remove(bus_cache_t *cache, bus_cache_entry_t *entry);
+static void bus_cache_entries_clear(bus_cache_t *cache);
+static uint64_t bus_cache_now(void);
+
+int bus_cache_create(bus_cache_t **cache)
+{
+	int error = 0;
+
+	if (cache == NULL) {
+		return -EINVAL;
+	}
+
+	*cache = calloc(1, sizeof(bus_cache_t));
+	if (*cache == NULL) {
+		return -ENOMEM;
+	}
+
+	error = hashmap_create(&(*cache)->entries, NULL);
+	if (error < 0) {
+		free(*cache);
+		*cache = NULL;
+		return error;
+	}
+
+	pthread_mutex_init(&(*cache)->lock, NULL);
+
+	return 0;
+}
+
+void bus_cache_destroy(bus_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	bus_cache_entries_clear(cache);
+	hashmap_destroy(cache->entries);
+	free(cache->rules);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+int bus_cache_configure(bus_cache_t *cache, const bus_cache_rule_t *rules, size_t rules_count, size_t max_bytes)
+{
+	size_t size = rules_count * sizeof(bus_cache_rule_t);
+	bus_cache_rule_t *copy = NULL;
+	char *strings = NULL;
+
+	if (cache == NULL || (rules == NULL && rules_count > 0)) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < rules_count; i++) {
+		if (rules[i].service == NULL || rules[i].interface == NULL || rules[i].method == NULL) {
+			return -EINVAL;
+		}
+		size += strlen(rules[i].service) + strlen(rules[i].interface) + strlen(rules[i].method) + 3;
+	}
+
+	copy = malloc(size ? size : 1);
+	if (copy == NULL) {
+		return -ENOMEM;
+	}
+
+	strings = (char *) (copy + rules_count);
+	for (size_t i = 0; i < rules_count; i++) {
+		copy[i].ttl_usec = rules[i].ttl_usec;
+		copy[i].service = strings;
+		strings = stpcpy(strings, rules[i].service) + 1;
+		copy[i].interface = strings;
+		strings = stpcpy(strings, rules[i].interface) + 1;
+		copy[i].method = strings;
+		strings = stpcpy(strings, rules[i].method) + 1;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	free(cache->rules);
+	cache->rules = copy;
+	cache->rules_count = rules_count;
+	cache->max_bytes = max_bytes;
+	// entries cached under the old rules may outlive their new TTL
+	bus_cache_entries_clear(cache);
+	// the counters describe the current configuration
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+	pthread_mutex_unlock(&cache->lock);
+
+	return 0;
+}
+
+int bus_cache_lookup(bus_cache_t *cache, bus_call_t *call)
+{
+	int error = 0;
+	char *key = NULL;
+	size_t key_size = 0;
+	bus_cache_entry_t *entry = NULL;
+
+	if (cache == NULL || call == NULL) {
+		return -EINVAL;
+	}
+
+	// calls no rule allows are neither hits nor misses, and need no key
+	if (!bus_cache_allowed(cache, call)) {
+		return -ENOENT;
+	}
+
+	error = bus_call_key_build(call, &key, &key_size);
+	if (error < 0) {
+		return error;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+
+	// the rules may have changed while the key was built
+	if (bus_cache_ttl(cache, call) == 0) {
+		error = -ENOENT;
+		goto out;
+	}
+
+	entry = hashmap_get(cache->entries, key, key_size);
+	if (entry != NULL && entry->expires_usec <= bus_cache_now()) {
+		bus_cache_entry_remove(cache, entry);
+		entry = NULL;
+	}
+	if (entry == NULL) {
+		cache->misses++;
+		error = -ENOENT;
+		goto out;
+	}
+
+	call->response = (entry->response != NULL) ? strdup(entry->response) : NULL;
+	call->reply_signature = strdup(entry->signature);
+	if ((entry->response != NULL && call->response == NULL) || call->reply_signature == NULL) {
+		free(call->response);
+		call->response = NULL;
+		free(call->reply_signature);
+		call->reply_signature = NULL;
+		error = -ENOMEM;
+		goto out;
+	}
+
+	bus_cache_entry_unlink(cache, entry);
+	bus_cache_entry_link(cache, entry);
+	cache->hits++;
+
+out:
+	pthread_mutex_unlock(&cache->lock);
+	free(key);
+
+	return error;
+}
+
+int bus_cache_store(bus_cache_t *cache, const bus_call_t *call)
+{
+	int error = 0;
+	uint64_t ttl_usec = 0;
+	bus_cache_entry_t *entry = NULL;
+	bus_cache_entry_t *previous = NULL;
+
+	if (cache == NULL || call == NULL || call->reply_signature == NULL) {
+		return -EINVAL;
+	}
+
+	// nothing is copied for the calls no rule allows, or for replies that could never fit
+	if (!bus_cache_allowed(cache, call)) {
+		return -ENOENT;
+	}
+
+	entry = calloc(1, sizeof(bus_cache_entry_t));
+	if (entry == NULL) {
+		return -ENOMEM;
+	}
+
+	error = bus_call_key_build(call, &entry->key, &entry->key_size);
+	if (error < 0) {
+		free(entry);
+		return error;
+	}
+
+	entry->response = (call->response != NULL) ? strdup(call->response) : NULL;
+	entry->signature = strdup(call->reply_signature);
+	if ((call->response != NULL && entry->response == NULL) || entry->signature == NULL) {
+		error = -ENOMEM;
+		goto error_out;
+	}
+
+	// the hashmap keeps its own copy of the key
+	entry->size = sizeof(bus_cache_entry_t) + 2 * entry->key_size + strlen(entry->signature) + 1 +
+				  ((entry->response != NULL) ? strlen(entry->response) + 1 : 0);
+
+	pthread_mutex_lock(&cache->lock);
+
+	ttl_usec = bus_cache_ttl(cache, call);
+	if (ttl_usec == 0 || entry->size > cache->max_bytes) {
+		pthread_mutex_unlock(&cache->lock);
+		error = -ENOENT;
+		goto error_out;
+	}
+
+	previous = hashmap_get(cache->entries, entry->key, entry->key_size);
+	if (previous != NULL) {
+		bus_cache_entry_remove(cache, previous);
+	}
+
+	error = hashmap_insert(cache->entries, entry->key, entry->key_size, entry);
+	if (error < 0) {
+		pthread_mutex_unlock(&cache->lock);
+		goto error_out;
+	}
+
+	entry->expires_usec = bus_cache_now() + ttl_usec;
+	bus_cache_entry_link(cache, entry);
+	cache->bytes += entry->size;
+
+	while (cache->bytes > cache->max_bytes && cache->tail != NULL) {
+		bus_cache_entry_remove(cache, cache->tail);
+		cache->evictions++;
+	}
+
+	pthread_mutex_unlock(&cache->lock);
+
+	return 0;
+
+error_out:
+	free(entry->key);
+	free(entry->response);
+	free(entry->signature);
+	free(entry);
+
+	return error;
+}
+
+void bus_cache_stats(bus_cache_t *cache, bus_cache_stats_t *stats)
+{
+	if (cache == NULL || stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+	stats->entries = hashmap_size(cache->entries);
+	stats->bytes = cache->bytes;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static uint64_t bus_cache_ttl(bus_cache_t *cache, const bus_call_t *call)
+{
+	for (size_t i = 0; i < cache->rules_count; i++) {
+		if (fnmatch(cache->rules[i].service, call->service, 0) == 0 &&
+			fnmatch(cache->rules[i].interface, call->interface, 0) == 0 &&
+			fnmatch(cache->rules[i].method, call->method, 0) == 0) {
+			return cache->rules[i].ttl_usec;
+		}
+	}
+
+	return 0;
+}
+
+static bool bus_cache_allowed(bus_cache_t *cache, const bus_call_t *call)
+{
+	bool allowed = false;
+	size_t max_bytes = 0;
+
+	pthread_mutex_lock(&cache->lock);
+	allowed = cache->rules_count > 0 && bus_cache_ttl(cache, call) != 0;
+	max_bytes = cache->max_bytes;
+	pthread_mutex_unlock(&cache->lock);
+
+	// the reply alone is larger than the whole cache
+	if (allowed && call->response != NULL) {
+		allowed = sizeof(bus_cache_entry_t) + strlen(call->response) + 1 <= max_bytes;
+	}
+
+	return allowed;
+}
+
+static void bus_cache_entry_link(bus_cache_t *cache, bus_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head != NULL) {
+		cache->head->prev = entry;
+	}
+	cache->head = entry;
+	if (cache->tail == NULL) {
+		cache->tail = entry;
+	}
+}
+
+static void bus_cache_entry_unlink(bus_cache_t *cache, bus_cache_entry_t *entry)
+{
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void bus_cache_entry_remove(bus_cache_t *cache, bus_cache_entry_t *entry)
+{
+	bus_cache_entry_unlink(cache, entry);
+	hashmap_remove(cache->entries, entry->key, entry->key_size);
+	cache->bytes -= entry->size;
+
+	free(entry->key);
+	free(entry->response);
+	free(entry->signature);
+	free(entry);
+}
+
+static void bus_cache_entries_clear(bus_cache_t *cache)
+{
+	while (cache->head != NULL) {
+		bus_cache_entry_remove(cache, cache->head);
+	}
+}
+
+static uint64_t bus_cache_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
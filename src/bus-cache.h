@@ -0,0 +1,59 @@
+/**
+ * @file bus-cache.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for caching the decoded replies of idempotent sd-bus calls
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_CACHE_H_
+#define _BUS_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus-call.h"
+
+typedef struct bus_cache_s bus_cache_t;
+
+// methods whose replies may be cached, shell-style wildcard patterns
+typedef struct bus_cache_rule_s {
+	const char *service;
+	const char *interface;
+	const char *method;
+	uint64_t ttl_usec;
+} bus_cache_rule_t;
+
+typedef struct bus_cache_stats_s {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;
+	size_t bytes;
+} bus_cache_stats_t;
+
+int bus_cache_create(bus_cache_t **cache);
+void bus_cache_destroy(bus_cache_t *cache);
+
+int bus_cache_configure(bus_cache_t *cache, const bus_cache_rule_t *rules, size_t rules_count, size_t max_bytes);
+int bus_cache_lookup(bus_cache_t *cache, bus_call_t *call);
+int bus_cache_store(bus_cache_t *cache, const bus_call_t *call);
+void bus_cache_stats(bus_cache_t *cache, bus_cache_stats_t *stats);
+
+#endif //_BUS_CACHE_H_
@@ -0,0 +1,475 @@
+/**
+ * @file bus-call.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements dispatching of sd-bus method calls.
+ *        Calls can either be run one after another with a blocking
+ *        sd_bus_call() or pipelined: all messages are sent up front with
+ *        sd_bus_call_async() and the replies are collected from a single
+ *        poll loop over every bus connection involved.
+ *        Every call is bounded by its own timeout and by what is left of
+ *        the deadline of the whole RPC, whichever is shorter.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+
+#include <sysrepo.h>
+
+#include <systemd/sd-bus.h>
+
+#include "bus-call.h"
+#include "bus-trace.h"
+#include "transform-sd-bus.h"
+
+static size_t bus_call_arguments_normalize(const char *arguments, char *normalized);
+static int bus_call_reply_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static size_t bus_call_fail_pending(bus_call_t *calls, size_t calls_count, sd_bus *bus, int error);
+static int bus_call_timeout(const bus_call_t *call, uint64_t deadline_usec, uint64_t *timeout_usec);
+static int bus_call_wait(sd_bus **buses, size_t buses_count);
+static void bus_call_sent(bus_call_t *call);
+static void bus_call_completed(bus_call_t *call);
+static uint64_t bus_call_now(void);
+
+uint64_t bus_call_deadline(uint64_t timeout_usec)
+{
+	return (timeout_usec == 0) ? 0 : bus_call_now() + timeout_usec;
+}
+
+int bus_call_prepare(bus_call_t *call, bus_connection_pool_t *pool, uint64_t deadline_usec)
+{
+	int error = 0;
+	uint64_t timeout_usec = 0;
+
+	if (call == NULL || pool == NULL) {
+		return -EINVAL;
+	}
+
+	error = bus_connection_get(pool, call->bus_type, call->address, &call->bus);
+	if (error < 0) {
+		SRP_LOG_ERR("failed to connect to bus: %s", strerror(-error));
+		return error;
+	}
+	// the pool may drop a peer while the call still uses it
+	sd_bus_ref(call->bus);
+
+	if (call->signature == NULL) {
+		// introspection counts against the timeout of the call and the deadline of the RPC
+		error = bus_call_timeout(call, deadline_usec, &timeout_usec);
+		if (error == 0) {
+			error = bus_signature_cache_lookup(bus_connection_signature_cache(pool, call->bus_type, call->address), call->bus,
+											   timeout_usec, call->service, call->object_path, call->interface, call->method,
+											   call->signature_buffer, sizeof(call->signature_buffer));
+		}
+		if (error < 0) {
+			SRP_LOG_ERR("failed to introspect signature of %s.%s: %s", call->interface, call->method, strerror(-error));
+			return error;
+		}
+		call->signature = call->signature_buffer;
+		call->signature_introspected = true;
+	}
+
+	error = sd_bus_message_new_method_call(call->bus, &call->message, call->service, call->object_path, call->interface, call->method);
+	if (error < 0) {
+		SRP_LOG_ERR("failed to create a new message: %s", strerror(-error));
+		return error;
+	}
+
+	error = bus_message_encode_format(call->signature, call->arguments, call->arguments_format, call->bytes_format, call->message);
+	if (error < 0) {
+		SRP_LOG_ERR("failed to encode arguments: %s", strerror(-error));
+		return error;
+	}
+
+	return 0;
+}
+
+int bus_call_run(bus_call_t *call, uint64_t deadline_usec)
+{
+	int error = 0;
+	uint64_t timeout_usec = 0;
+
+	if (call == NULL || call->message == NULL) {
+		return -EINVAL;
+	}
+
+	bus_call_sent(call);
+	error = bus_call_timeout(call, deadline_usec, &timeout_usec);
+	if (error == 0) {
+		error = sd_bus_call(call->bus, call->message, timeout_usec, &call->bus_error, &call->reply);
+	}
+	call->error = (error < 0) ? error : 0;
+	call->done = true;
+	bus_call_completed(call);
+
+	return call->error;
+}
+
+int bus_call_run_pipelined(bus_call_t *calls, size_t calls_count, size_t max_in_flight, uint64_t deadline_usec)
+{
+	int error = 0;
+	uint64_t timeout_usec = 0;
+	sd_bus **buses = NULL;
+	size_t buses_count = 0;
+	size_t next = 0;
+	size_t in_flight = 0;
+	bool progress = false;
+
+	if (calls == NULL || max_in_flight == 0) {
+		return -EINVAL;
+	}
+
+	buses = calloc(calls_count ? calls_count : 1, sizeof(sd_bus *));
+	if (buses == NULL) {
+		return -ENOMEM;
+	}
+
+	// every connection taking part in the batch is driven from the same loop
+	for (size_t i = 0; i < calls_count; i++) {
+		size_t j = 0;
+
+		if (calls[i].bus == NULL) {
+			continue;
+		}
+
+		for (j = 0; j < buses_count && buses[j] != calls[i].bus; j++)
+			;
+		if (j == buses_count) {
+			buses[buses_count++] = calls[i].bus;
+		}
+	}
+
+	while (next < calls_count || in_flight > 0) {
+		while (next < calls_count && in_flight < max_in_flight) {
+			bus_call_t *call = &calls[next++];
+
+			if (call->done || call->message == NULL) {
+				continue;
+			}
+
+			// calls queued behind the in-flight cap only get what is left of the deadline
+			bus_call_sent(call);
+			error = bus_call_timeout(call, deadline_usec, &timeout_usec);
+			if (error == 0) {
+				error = sd_bus_call_async(call->bus, &call->slot, call->message, bus_call_reply_cb, call, timeout_usec);
+			}
+			if (error < 0) {
+				call->error = error;
+				call->done = true;
+				bus_call_completed(call);
+				continue;
+			}
+
+			in_flight++;
+		}
+
+		progress = false;
+		for (size_t i = 0; i < buses_count; i++) {
+			while ((error = sd_bus_process(buses[i], NULL)) > 0) {
+				progress = true;
+			}
+
+			// the connection is unusable, nothing pending on it will ever complete
+			if (error < 0 && bus_call_fail_pending(calls, next, buses[i], error) > 0) {
+				progress = true;
+			}
+		}
+
+		in_flight = 0;
+		for (size_t i = 0; i < next; i++) {
+			if (calls[i].slot != NULL && !calls[i].done) {
+				in_flight++;
+			}
+		}
+
+		if (!progress && in_flight > 0) {
+			error = bus_call_wait(buses, buses_count);
+			if (error < 0) {
+				goto out;
+			}
+		}
+	}
+
+	error = 0;
+
+out:
+	free(buses);
+
+	return error;
+}
+
+int bus_call_decode(bus_call_t *call)
+{
+	int error = 0;
+	const char *signature = NULL;
+
+	if (call == NULL || call->reply == NULL) {
+		return -EINVAL;
+	}
+
+	error = bus_message_decode_format(call->reply, call->response_format, call->bytes_format, &call->response);
+	if (error < 0) {
+		SRP_LOG_ERR("failed to parse reply of %s.%s: %s", call->interface, call->method, strerror(-error));
+		call->error = error;
+		return error;
+	}
+
+	signature = sd_bus_message_get_signature(call->reply, true);
+	call->reply_signature = strdup((signature != NULL) ? signature : "");
+	if (call->reply_signature == NULL) {
+		call->error = -ENOMEM;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+// identical calls get identical keys: bus, address, destination, object, interface, method,
+// signature, formats and the arguments with insignificant whitespace removed
+// only the signature of the request counts, the key is the same before and after introspection
+int bus_call_key_build(const bus_call_t *call, char **key, size_t *key_size)
+{
+	bool signature_omitted = call->signature == NULL || call->signature_introspected;
+	const char *strings[] = {(call->address != NULL) ? call->address : "", call->service, call->object_path, call->interface,
+							 call->method, signature_omitted ? "" : call->signature};
+	size_t size = 5;
+	char *position = NULL;
+
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		if (strings[i] == NULL) {
+			return -EINVAL;
+		}
+		size += strlen(strings[i]) + 1;
+	}
+	size += ((call->arguments != NULL) ? strlen(call->arguments) : 0) + 1;
+
+	*key = malloc(size);
+	if (*key == NULL) {
+		return -ENOMEM;
+	}
+
+	position = *key;
+	*position++ = (char) call->bus_type;
+	*position++ = (char) call->arguments_format;
+	*position++ = (char) call->response_format;
+	*position++ = (char) call->bytes_format;
+	// an omitted signature differs from an empty one
+	*position++ = (char) signature_omitted;
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		position = stpcpy(position, strings[i]) + 1;
+	}
+	position += bus_call_arguments_normalize(call->arguments, position);
+	*position++ = '\0';
+
+	*key_size = (size_t) (position - *key);
+
+	return 0;
+}
+
+static size_t bus_call_arguments_normalize(const char *arguments, char *normalized)
+{
+	size_t length = 0;
+	bool quoted = false;
+	bool escaped = false;
+	bool space = false;
+
+	if (arguments == NULL) {
+		return 0;
+	}
+
+	// whitespace outside of strings only separates tokens, a single space is kept
+	for (const char *c = arguments; *c != '\0'; c++) {
+		if (quoted) {
+			normalized[length++] = *c;
+			if (escaped) {
+				escaped = false;
+			} else if (*c == '\\') {
+				escaped = true;
+			} else if (*c == '"') {
+				quoted = false;
+			}
+			continue;
+		}
+
+		if (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+			space = (length > 0);
+			continue;
+		}
+
+		if (space) {
+			normalized[length++] = ' ';
+			space = false;
+		}
+
+		normalized[length++] = *c;
+		quoted = (*c == '"');
+	}
+
+	return length;
+}
+
+void bus_call_release(bus_call_t *call)
+{
+	if (call == NULL) {
+		return;
+	}
+
+	// dropping the slot also cancels a reply that is still in flight
+	call->slot = sd_bus_slot_unref(call->slot);
+	call->message = sd_bus_message_unref(call->message);
+	call->reply = sd_bus_message_unref(call->reply);
+	call->bus = sd_bus_unref(call->bus);
+	free(call->response);
+	call->response = NULL;
+	free(call->response_handle);
+	call->response_handle = NULL;
+	free(call->reply_signature);
+	call->reply_signature = NULL;
+	sd_bus_error_free(&call->bus_error);
+}
+
+static int bus_call_reply_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	bus_call_t *call = (bus_call_t *) userdata;
+
+	if (sd_bus_message_is_method_error(m, NULL)) {
+		call->error = -sd_bus_message_get_errno(m);
+		sd_bus_error_copy(&call->bus_error, sd_bus_message_get_error(m));
+	} else {
+		call->reply = sd_bus_message_ref(m);
+		call->error = 0;
+	}
+
+	call->done = true;
+	bus_call_completed(call);
+
+	return 0;
+}
+
+static int bus_call_timeout(const bus_call_t *call, uint64_t deadline_usec, uint64_t *timeout_usec)
+{
+	uint64_t now_usec = 0;
+
+	*timeout_usec = call->timeout_usec;
+
+	if (deadline_usec == 0) {
+		return 0;
+	}
+
+	now_usec = bus_call_now();
+	if (now_usec >= deadline_usec) {
+		return -ETIMEDOUT;
+	}
+
+	if (*timeout_usec == 0 || *timeout_usec > deadline_usec - now_usec) {
+		*timeout_usec = deadline_usec - now_usec;
+	}
+
+	return 0;
+}
+
+static size_t bus_call_fail_pending(bus_call_t *calls, size_t calls_count, sd_bus *bus, int error)
+{
+	size_t failed = 0;
+
+	for (size_t i = 0; i < calls_count; i++) {
+		if (calls[i].bus == bus && calls[i].slot != NULL && !calls[i].done) {
+			calls[i].slot = sd_bus_slot_unref(calls[i].slot);
+			calls[i].error = error;
+			calls[i].done = true;
+			bus_call_completed(&calls[i]);
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+static int bus_call_wait(sd_bus **buses, size_t buses_count)
+{
+	int error = 0;
+	struct pollfd *fds = NULL;
+	uint64_t now_usec = bus_call_now();
+	uint64_t timeout_usec = UINT64_MAX;
+	uint64_t until_usec = 0;
+	int timeout_ms = -1;
+
+	fds = calloc(buses_count, sizeof(struct pollfd));
+	if (fds == NULL) {
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < buses_count; i++) {
+		int fd = sd_bus_get_fd(buses[i]);
+		int events = sd_bus_get_events(buses[i]);
+
+		// closed connections are ignored by poll()
+		fds[i].fd = (fd < 0 || events < 0) ? -1 : fd;
+		fds[i].events = (short) ((events < 0) ? 0 : events);
+
+		if (sd_bus_get_timeout(buses[i], &until_usec) > 0) {
+			uint64_t left_usec = (until_usec > now_usec) ? until_usec - now_usec : 0;
+			if (left_usec < timeout_usec) {
+				timeout_usec = left_usec;
+			}
+		}
+	}
+
+	if (timeout_usec != UINT64_MAX) {
+		timeout_ms = (timeout_usec / 1000 >= INT_MAX) ? INT_MAX : (int) ((timeout_usec + 999) / 1000);
+	}
+
+	error = poll(fds, (nfds_t) buses_count, timeout_ms);
+	if (error < 0 && errno != EINTR) {
+		error = -errno;
+	} else {
+		error = 0;
+	}
+
+	free(fds);
+
+	return error;
+}
+
+static void bus_call_sent(bus_call_t *call)
+{
+	call->sent_usec = bus_call_now();
+	BUS_TRACE(call__send, call->service, call->method);
+}
+
+static void bus_call_completed(bus_call_t *call)
+{
+	call->completed_usec = bus_call_now();
+	BUS_TRACE(call__done, call->service, call->method, call->error, call->completed_usec - call->sent_usec);
+}
+
+static uint64_t bus_call_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file bus-call.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for dispatching sd-bus method calls
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_CALL_H_
+#define _BUS_CALL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-bus-protocol.h>
+
+#include "bus-connection.h"
+#include "transform-sd-bus.h"
+
+// single sd-bus-message entry of an sd-bus-call RPC
+typedef struct bus_call_s {
+	bus_connection_type_t bus_type;
+	// D-Bus server the call goes to directly instead of the bus of bus_type, NULL for none
+	const char *address;
+	const char *service;
+	const char *object_path;
+	const char *interface;
+	const char *method;
+	const char *signature;
+	const char *arguments;
+	bus_encode_format_t arguments_format;
+	uint64_t timeout_usec;
+	// holds the introspected signature when the request did not carry one
+	char signature_buffer[SD_BUS_MAXIMUM_SIGNATURE_LENGTH + 1];
+	// signature points to signature_buffer, keys are built as if it were still omitted
+	bool signature_introspected;
+
+	sd_bus *bus;
+	sd_bus_message *message;
+	sd_bus_message *reply;
+	sd_bus_slot *slot;
+	int error;
+	// D-Bus error name and message of a failed call
+	sd_bus_error bus_error;
+	bool done;
+	// reply decoded into response_format
+	bus_decode_format_t response_format;
+	// representation of byte arrays in the arguments and the decoded reply
+	bus_bytes_format_t bytes_format;
+	char *response;
+	// handle of the response when it was offloaded, response is NULL then, see bus-offload.h
+	char *response_handle;
+	size_t response_size;
+	// signature of the decoded reply, set as well when the reply came from the cache
+	char *reply_signature;
+	// identical calls in flight at the same time share a single sd-bus call
+	bool single_flight;
+	// flight this call leads or waits for, see bus-flight.h
+	struct bus_flight_s *flight;
+	bool flight_leader;
+	// metrics of the method, see bus-metrics.h
+	struct bus_metrics_target_s *metrics;
+	// when the call was sent and when its outcome was known
+	uint64_t sent_usec;
+	uint64_t completed_usec;
+} bus_call_t;
+
+uint64_t bus_call_deadline(uint64_t timeout_usec);
+
+int bus_call_prepare(bus_call_t *call, bus_connection_pool_t *pool, uint64_t deadline_usec);
+int bus_call_run(bus_call_t *call, uint64_t deadline_usec);
+int bus_call_run_pipelined(bus_call_t *calls, size_t calls_count, size_t max_in_flight, uint64_t deadline_usec);
+int bus_call_decode(bus_call_t *call);
+int bus_call_key_build(const bus_call_t *call, char **key, size_t *key_size);
+void bus_call_release(bus_call_t *call);
+
+#endif //_BUS_CALL_H_
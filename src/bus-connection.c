@@ -0,0 +1,508 @@
+/**
+ * @file bus-connection.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements a pool of long-lived sd-bus connections.
+ *        One connection is kept per bus type and reused across RPC calls,
+ *        so the socket connect, authentication and Hello() round-trip are
+ *        paid only once. A connection that was closed by the peer is
+ *        reopened the next time it is requested.
+ *        Every connection owns the method signature cache of its bus, which
+ *        is kept consistent by watching NameOwnerChanged.
+ *        Connections to a D-Bus address are peer-to-peer, without a broker in
+ *        between, and are pooled per address the same way. A peer that cannot
+ *        be opened is dropped from the pool right away, and beyond the peer
+ *        limit the least recently used peer is closed, preferring ones the
+ *        server already closed.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+
+#include "bus-connection.h"
+#include "hashmap.h"
+
+// addresses come from RPC input, the number of peers a pool connects to is capped
+#define BUS_CONNECTION_PEERS_MAX 64
+
+typedef struct bus_connection_s {
+	sd_bus *bus;
+	sd_bus_slot *name_owner_changed;
+	bus_signature_cache_t *signatures;
+	// peers only, their address and their place in the least recently used list
+	char *address;
+	struct bus_connection_s *prev;
+	struct bus_connection_s *next;
+} bus_connection_t;
+
+struct bus_connection_pool_s {
+	bus_connection_t connection[BUS_CONNECTION_TYPE_COUNT];
+	// address -> bus_connection_t, peer-to-peer connections to D-Bus servers without a broker
+	hashmap_t *peers;
+	// most recently used peer first
+	bus_connection_t *peers_head;
+	bus_connection_t *peers_tail;
+	// event loop every connection of the pool is attached to, if any
+	sd_event *event;
+};
+
+// event loop the peers of a pool are attached to, and the first failure
+typedef struct bus_connection_attach_s {
+	sd_event *event;
+	int error;
+} bus_connection_attach_t;
+
+static bus_connection_t *bus_connection_select(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address, bool create);
+static void bus_connection_peer_free(void *connection);
+static void bus_connection_peer_link(bus_connection_pool_t *pool, bus_connection_t *peer);
+static void bus_connection_peer_unlink(bus_connection_pool_t *pool, bus_connection_t *peer);
+static void bus_connection_peer_remove(bus_connection_pool_t *pool, bus_connection_t *peer);
+static void bus_connection_peer_evict(bus_connection_pool_t *pool);
+static bool bus_connection_peer_attach(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_connection_peer_detach(const void *key, size_t key_size, void *value, void *userdata);
+static int bus_connection_open(bus_connection_type_t type, const char *address, bus_connection_t *connection, sd_event *event);
+static int bus_connection_peer_open(const char *address, sd_bus **bus);
+static void bus_connection_close(bus_connection_t *connection);
+static int bus_connection_name_owner_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+
+int bus_connection_pool_create(bus_connection_pool_t **pool)
+{
+	int error = 0;
+
+	if (pool == NULL) {
+		return -EINVAL;
+	}
+
+	*pool = calloc(1, sizeof(bus_connection_pool_t));
+	if (*pool == NULL) {
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < BUS_CONNECTION_TYPE_COUNT; i++) {
+		error = bus_signature_cache_create(&(*pool)->connection[i].signatures);
+		if (error < 0) {
+			bus_connection_pool_destroy(*pool);
+			*pool = NULL;
+			return error;
+		}
+	}
+
+	error = hashmap_create(&(*pool)->peers, bus_connection_peer_free);
+	if (error < 0) {
+		bus_connection_pool_destroy(*pool);
+		*pool = NULL;
+		return error;
+	}
+
+	return 0;
+}
+
+void bus_connection_pool_destroy(bus_connection_pool_t *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < BUS_CONNECTION_TYPE_COUNT; i++) {
+		bus_connection_close(&pool->connection[i]);
+		bus_signature_cache_destroy(pool->connection[i].signatures);
+	}
+	hashmap_destroy(pool->peers);
+
+	sd_event_unref(pool->event);
+	free(pool);
+}
+
+int bus_connection_pool_attach_event(bus_connection_pool_t *pool, sd_event *event)
+{
+	int error = 0;
+	bus_connection_attach_t attach = {0};
+
+	if (pool == NULL || event == NULL || pool->event != NULL) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < BUS_CONNECTION_TYPE_COUNT; i++) {
+		if (pool->connection[i].bus == NULL) {
+			continue;
+		}
+
+		error = sd_bus_attach_event(pool->connection[i].bus, event, SD_EVENT_PRIORITY_NORMAL);
+		if (error < 0) {
+			for (size_t j = 0; j < i; j++) {
+				if (pool->connection[j].bus != NULL) {
+					sd_bus_detach_event(pool->connection[j].bus);
+				}
+			}
+			return error;
+		}
+	}
+
+	attach.event = event;
+	hashmap_foreach(pool->peers, bus_connection_peer_attach, &attach);
+	if (attach.error < 0) {
+		// detaching is a no-op for the connections that did not get attached
+		for (size_t i = 0; i < BUS_CONNECTION_TYPE_COUNT; i++) {
+			if (pool->connection[i].bus != NULL) {
+				sd_bus_detach_event(pool->connection[i].bus);
+			}
+		}
+		hashmap_foreach(pool->peers, bus_connection_peer_detach, NULL);
+		return attach.error;
+	}
+
+	// connections opened from now on are attached as well
+	pool->event = sd_event_ref(event);
+
+	return 0;
+}
+
+int bus_connection_type_parse(const char *name, bus_connection_type_t *type)
+{
+	if (name == NULL || type == NULL) {
+		return -EINVAL;
+	}
+
+	if (strcmp(name, "SYSTEM") == 0) {
+		*type = BUS_CONNECTION_TYPE_SYSTEM;
+	} else if (strcmp(name, "USER") == 0) {
+		*type = BUS_CONNECTION_TYPE_USER;
+	} else {
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+const char *bus_connection_type_name(bus_connection_type_t type)
+{
+	switch (type) {
+		case BUS_CONNECTION_TYPE_SYSTEM:
+			return "SYSTEM";
+		case BUS_CONNECTION_TYPE_USER:
+			return "USER";
+		default:
+			return NULL;
+	}
+}
+
+int bus_connection_get(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address, sd_bus **bus)
+{
+	int error = 0;
+	bus_connection_t *connection = NULL;
+
+	if (pool == NULL || bus == NULL || (address == NULL && type >= BUS_CONNECTION_TYPE_COUNT)) {
+		return -EINVAL;
+	}
+
+	connection = bus_connection_select(pool, type, address, true);
+	if (connection == NULL) {
+		return -ENOMEM;
+	}
+
+	if (connection->bus != NULL) {
+		// dispatch the signals queued since the last call, so the caches are up to date
+		while (sd_bus_process(connection->bus, NULL) > 0)
+			;
+
+		if (sd_bus_is_open(connection->bus) > 0) {
+			*bus = connection->bus;
+			return 0;
+		}
+	}
+
+	// the peer went away (or this is the first use), drop the stale connection and reconnect
+	bus_connection_close(connection);
+
+	error = bus_connection_open(type, address, connection, pool->event);
+	if (error < 0) {
+		// a peer nobody listens on would otherwise take up a place in the pool for good
+		if (address != NULL) {
+			bus_connection_peer_remove(pool, connection);
+		}
+		return error;
+	}
+
+	*bus = connection->bus;
+
+	return 0;
+}
+
+bus_signature_cache_t *bus_connection_signature_cache(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address)
+{
+	bus_connection_t *connection = NULL;
+
+	if (pool == NULL || (address == NULL && type >= BUS_CONNECTION_TYPE_COUNT)) {
+		return NULL;
+	}
+
+	connection = bus_connection_select(pool, type, address, false);
+
+	return (connection != NULL) ? connection->signatures : NULL;
+}
+
+// the standard bus of the type, or the peer of the address, created on first use if asked to
+static bus_connection_t *bus_connection_select(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address, bool create)
+{
+	bus_connection_t *connection = NULL;
+
+	if (address == NULL) {
+		return &pool->connection[type];
+	}
+
+	connection = hashmap_get(pool->peers, address, strlen(address));
+	if (connection != NULL) {
+		bus_connection_peer_unlink(pool, connection);
+		bus_connection_peer_link(pool, connection);
+		return connection;
+	}
+
+	if (!create) {
+		return NULL;
+	}
+
+	if (hashmap_size(pool->peers) >= BUS_CONNECTION_PEERS_MAX) {
+		bus_connection_peer_evict(pool);
+	}
+
+	connection = calloc(1, sizeof(bus_connection_t));
+	if (connection == NULL) {
+		return NULL;
+	}
+
+	connection->address = strdup(address);
+	if (connection->address == NULL || bus_signature_cache_create(&connection->signatures) < 0 ||
+		hashmap_insert(pool->peers, address, strlen(address), connection) < 0) {
+		bus_connection_peer_free(connection);
+		return NULL;
+	}
+	bus_connection_peer_link(pool, connection);
+
+	return connection;
+}
+
+static void bus_connection_peer_free(void *connection)
+{
+	bus_connection_t *peer = (bus_connection_t *) connection;
+
+	if (peer == NULL) {
+		return;
+	}
+
+	// calls still using the peer hold their own reference, the last one closes it
+	peer->name_owner_changed = sd_bus_slot_unref(peer->name_owner_changed);
+	if (peer->bus != NULL) {
+		sd_bus_detach_event(peer->bus);
+		sd_bus_flush(peer->bus);
+	}
+	peer->bus = sd_bus_unref(peer->bus);
+	bus_signature_cache_destroy(peer->signatures);
+	free(peer->address);
+	free(peer);
+}
+
+static void bus_connection_peer_link(bus_connection_pool_t *pool, bus_connection_t *peer)
+{
+	peer->prev = NULL;
+	peer->next = pool->peers_head;
+	if (pool->peers_head != NULL) {
+		pool->peers_head->prev = peer;
+	}
+	pool->peers_head = peer;
+	if (pool->peers_tail == NULL) {
+		pool->peers_tail = peer;
+	}
+}
+
+static void bus_connection_peer_unlink(bus_connection_pool_t *pool, bus_connection_t *peer)
+{
+	if (peer->prev != NULL) {
+		peer->prev->next = peer->next;
+	} else {
+		pool->peers_head = peer->next;
+	}
+
+	if (peer->next != NULL) {
+		peer->next->prev = peer->prev;
+	} else {
+		pool->peers_tail = peer->prev;
+	}
+
+	peer->prev = NULL;
+	peer->next = NULL;
+}
+
+static void bus_connection_peer_remove(bus_connection_pool_t *pool, bus_connection_t *peer)
+{
+	bus_connection_peer_unlink(pool, peer);
+	// frees the peer, its address is only compared before that
+	hashmap_remove(pool->peers, peer->address, strlen(peer->address));
+}
+
+// drops a peer to make room for a new one, the least recently used of the closed ones if there are any
+static void bus_connection_peer_evict(bus_connection_pool_t *pool)
+{
+	bus_connection_t *peer = pool->peers_tail;
+
+	while (peer != NULL && peer->bus != NULL && sd_bus_is_open(peer->bus) > 0) {
+		peer = peer->prev;
+	}
+
+	bus_connection_peer_remove(pool, (peer != NULL) ? peer : pool->peers_tail);
+}
+
+static bool bus_connection_peer_attach(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_connection_t *connection = (bus_connection_t *) value;
+	bus_connection_attach_t *attach = (bus_connection_attach_t *) userdata;
+	int error = 0;
+
+	if (connection->bus == NULL || attach->error < 0) {
+		return false;
+	}
+
+	error = sd_bus_attach_event(connection->bus, attach->event, SD_EVENT_PRIORITY_NORMAL);
+	if (error < 0) {
+		attach->error = error;
+	}
+
+	return false;
+}
+
+static bool bus_connection_peer_detach(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_connection_t *connection = (bus_connection_t *) value;
+
+	if (connection->bus != NULL) {
+		sd_bus_detach_event(connection->bus);
+	}
+
+	return false;
+}
+
+static int bus_connection_open(bus_connection_type_t type, const char *address, bus_connection_t *connection, sd_event *event)
+{
+	int error = 0;
+
+	if (address != NULL) {
+		error = bus_connection_peer_open(address, &connection->bus);
+	} else {
+		switch (type) {
+			case BUS_CONNECTION_TYPE_SYSTEM:
+				error = sd_bus_open_system(&connection->bus);
+				break;
+			case BUS_CONNECTION_TYPE_USER:
+				error = sd_bus_open_user(&connection->bus);
+				break;
+			default:
+				error = -EINVAL;
+				break;
+		}
+	}
+	if (error < 0) {
+		return error;
+	}
+
+	// services may have been replaced while there was no connection to watch them
+	bus_signature_cache_clear(connection->signatures);
+
+	// without a broker nobody reports name changes, the cache is cleared on reconnect instead
+	if (address == NULL) {
+		error = sd_bus_match_signal_async(connection->bus, &connection->name_owner_changed,
+										  "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+										  bus_connection_name_owner_changed_cb, NULL, connection);
+		if (error < 0) {
+			bus_connection_close(connection);
+			return error;
+		}
+	}
+
+	// the event loop dispatches incoming messages between calls
+	if (event != NULL) {
+		error = sd_bus_attach_event(connection->bus, event, SD_EVENT_PRIORITY_NORMAL);
+		if (error < 0) {
+			bus_connection_close(connection);
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+static int bus_connection_peer_open(const char *address, sd_bus **bus)
+{
+	int error = 0;
+
+	error = sd_bus_new(bus);
+	if (error < 0) {
+		return error;
+	}
+
+	error = sd_bus_set_address(*bus, address);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	// the server is the peer itself, there is no broker to send Hello to
+	error = sd_bus_set_bus_client(*bus, 0);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	error = sd_bus_start(*bus);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	return 0;
+
+error_out:
+	*bus = sd_bus_unref(*bus);
+
+	return error;
+}
+
+static void bus_connection_close(bus_connection_t *connection)
+{
+	connection->name_owner_changed = sd_bus_slot_unref(connection->name_owner_changed);
+	if (connection->bus != NULL) {
+		sd_bus_detach_event(connection->bus);
+	}
+	connection->bus = sd_bus_flush_close_unref(connection->bus);
+}
+
+static int bus_connection_name_owner_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	bus_connection_t *connection = (bus_connection_t *) userdata;
+	const char *name = NULL;
+
+	if (sd_bus_message_read(m, "s", &name) < 0) {
+		return 0;
+	}
+
+	bus_signature_cache_invalidate(connection->signatures, name);
+
+	return 0;
+}
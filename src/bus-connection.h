@@ -0,0 +1,51 @@
+/**
+ * @file bus-connection.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for managing long-lived sd-bus connections
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_CONNECTION_H_
+#define _BUS_CONNECTION_H_
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-event.h>
+
+#include "introspect-sd-bus.h"
+
+typedef enum bus_connection_type_e {
+	BUS_CONNECTION_TYPE_SYSTEM = 0,
+	BUS_CONNECTION_TYPE_USER,
+	BUS_CONNECTION_TYPE_COUNT,
+} bus_connection_type_t;
+
+typedef struct bus_connection_pool_s bus_connection_pool_t;
+
+int bus_connection_pool_create(bus_connection_pool_t **pool);
+void bus_connection_pool_destroy(bus_connection_pool_t *pool);
+int bus_connection_pool_attach_event(bus_connection_pool_t *pool, sd_event *event);
+
+int bus_connection_type_parse(const char *name, bus_connection_type_t *type);
+const char *bus_connection_type_name(bus_connection_type_t type);
+// with an address the connection goes directly to the D-Bus server listening on it, the type is ignored
+int bus_connection_get(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address, sd_bus **bus);
+bus_signature_cache_t *bus_connection_signature_cache(bus_connection_pool_t *pool, bus_connection_type_t type, const char *address);
+
+#endif //_BUS_CONNECTION_H_
@@ -0,0 +1,282 @@
+/**
+ * @file bus-flight.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements single-flight sharing of identical sd-bus calls.
+ *        The first call joining a flight becomes its leader and is sent as
+ *        usual, identical calls joining while it is in flight become
+ *        followers that send nothing and receive a copy of the decoded reply
+ *        of the leader. A flight is closed as soon as its leader completes,
+ *        later calls start a new one.
+ *        Callers complete every flight they lead before waiting for any flight
+ *        they follow, so threads following each other's calls cannot deadlock.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <systemd/sd-bus.h>
+
+#include "bus-flight.h"
+#include "hashmap.h"
+
+typedef struct bus_flight_s {
+	char *key;
+	size_t key_size;
+	pthread_cond_t completed;
+	bool done;
+	// leader and followers still holding the flight
+	size_t references;
+	// outcome of the leader
+	int error;
+	sd_bus_error bus_error;
+	char *response;
+	char *reply_signature;
+} bus_flight_t;
+
+struct bus_flight_group_s {
+	pthread_mutex_t lock;
+	// key -> bus_flight_t of the flights whose leader has not completed yet
+	hashmap_t *flights;
+};
+
+static void bus_flight_unref(bus_flight_t *flight);
+static int bus_flight_result_copy(int error, const sd_bus_error *bus_error, const char *response, const char *reply_signature,
+								  int *error_copy, sd_bus_error *bus_error_copy, char **response_copy, char **reply_signature_copy);
+
+int bus_flight_group_create(bus_flight_group_t **group)
+{
+	int error = 0;
+
+	if (group == NULL) {
+		return -EINVAL;
+	}
+
+	*group = calloc(1, sizeof(bus_flight_group_t));
+	if (*group == NULL) {
+		return -ENOMEM;
+	}
+
+	error = hashmap_create(&(*group)->flights, NULL);
+	if (error < 0) {
+		free(*group);
+		*group = NULL;
+		return error;
+	}
+
+	pthread_mutex_init(&(*group)->lock, NULL);
+
+	return 0;
+}
+
+void bus_flight_group_destroy(bus_flight_group_t *group)
+{
+	if (group == NULL) {
+		return;
+	}
+
+	// every flight is closed by its leader, none is left once the callers are gone
+	hashmap_destroy(group->flights);
+	pthread_mutex_destroy(&group->lock);
+	free(group);
+}
+
+int bus_flight_join(bus_flight_group_t *group, bus_call_t *call)
+{
+	int error = 0;
+	char *key = NULL;
+	size_t key_size = 0;
+	bus_flight_t *flight = NULL;
+	pthread_condattr_t attributes;
+
+	if (group == NULL || call == NULL || call->flight != NULL) {
+		return -EINVAL;
+	}
+
+	error = bus_call_key_build(call, &key, &key_size);
+	if (error < 0) {
+		return error;
+	}
+
+	pthread_mutex_lock(&group->lock);
+
+	flight = hashmap_get(group->flights, key, key_size);
+	if (flight != NULL) {
+		flight->references++;
+		call->flight = flight;
+		call->flight_leader = false;
+		pthread_mutex_unlock(&group->lock);
+		free(key);
+		return 0;
+	}
+
+	flight = calloc(1, sizeof(bus_flight_t));
+	if (flight == NULL) {
+		pthread_mutex_unlock(&group->lock);
+		free(key);
+		return -ENOMEM;
+	}
+
+	error = hashmap_insert(group->flights, key, key_size, flight);
+	if (error < 0) {
+		pthread_mutex_unlock(&group->lock);
+		free(flight);
+		free(key);
+		return error;
+	}
+
+	// followers wait against the monotonic deadlines of their RPCs
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&flight->completed, &attributes);
+	pthread_condattr_destroy(&attributes);
+
+	flight->key = key;
+	flight->key_size = key_size;
+	flight->references = 1;
+	flight->bus_error = SD_BUS_ERROR_NULL;
+	call->flight = flight;
+	call->flight_leader = true;
+
+	pthread_mutex_unlock(&group->lock);
+
+	return 0;
+}
+
+void bus_flight_complete(bus_flight_group_t *group, bus_call_t *call)
+{
+	bus_flight_t *flight = NULL;
+	int error = 0;
+
+	if (group == NULL || call == NULL || call->flight == NULL || !call->flight_leader) {
+		return;
+	}
+
+	flight = call->flight;
+	call->flight = NULL;
+
+	pthread_mutex_lock(&group->lock);
+
+	// a leader without a decoded reply hands its failure to the followers
+	error = (call->error < 0) ? call->error : ((call->reply_signature == NULL) ? -EIO : 0);
+	// only copying a decoded reply can fail, a failed leader keeps its own error
+	if (bus_flight_result_copy(error, &call->bus_error, call->response, call->reply_signature,
+							   &flight->error, &flight->bus_error, &flight->response, &flight->reply_signature) < 0) {
+		flight->error = -ENOMEM;
+	}
+
+	flight->done = true;
+	hashmap_remove(group->flights, flight->key, flight->key_size);
+	pthread_cond_broadcast(&flight->completed);
+
+	if (--flight->references == 0) {
+		bus_flight_unref(flight);
+	}
+
+	pthread_mutex_unlock(&group->lock);
+}
+
+int bus_flight_wait(bus_flight_group_t *group, bus_call_t *call, uint64_t deadline_usec)
+{
+	int error = 0;
+	bus_flight_t *flight = NULL;
+	struct timespec deadline = {0};
+
+	if (group == NULL || call == NULL || call->flight == NULL || call->flight_leader) {
+		return -EINVAL;
+	}
+
+	flight = call->flight;
+	call->flight = NULL;
+
+	deadline.tv_sec = (time_t) (deadline_usec / 1000000ULL);
+	deadline.tv_nsec = (long) (deadline_usec % 1000000ULL) * 1000L;
+
+	pthread_mutex_lock(&group->lock);
+
+	while (!flight->done && error == 0) {
+		if (deadline_usec == 0) {
+			error = -pthread_cond_wait(&flight->completed, &group->lock);
+		} else {
+			error = -pthread_cond_timedwait(&flight->completed, &group->lock, &deadline);
+		}
+	}
+
+	if (flight->done) {
+		error = bus_flight_result_copy(flight->error, &flight->bus_error, flight->response, flight->reply_signature,
+									   &call->error, &call->bus_error, &call->response, &call->reply_signature);
+		if (error < 0) {
+			call->error = error;
+		}
+	} else {
+		// the leader is still waiting for its reply, this RPC ran out of time
+		call->error = error;
+	}
+	call->done = true;
+
+	if (--flight->references == 0) {
+		bus_flight_unref(flight);
+	}
+
+	pthread_mutex_unlock(&group->lock);
+
+	return call->error;
+}
+
+static void bus_flight_unref(bus_flight_t *flight)
+{
+	pthread_cond_destroy(&flight->completed);
+	sd_bus_error_free(&flight->bus_error);
+	free(flight->response);
+	free(flight->reply_signature);
+	free(flight->key);
+	free(flight);
+}
+
+static int bus_flight_result_copy(int error, const sd_bus_error *bus_error, const char *response, const char *reply_signature,
+								  int *error_copy, sd_bus_error *bus_error_copy, char **response_copy, char **reply_signature_copy)
+{
+	*error_copy = error;
+	if (error < 0) {
+		// sd_bus_error_copy() returns the errno the name maps to, it only failed if the name is missing
+		if (sd_bus_error_is_set(bus_error) && sd_bus_error_copy(bus_error_copy, bus_error) < 0 &&
+			!sd_bus_error_has_name(bus_error_copy, bus_error->name)) {
+			// the errno of the leader is still handed on, only without its error name
+			sd_bus_error_free(bus_error_copy);
+		}
+		return 0;
+	}
+
+	*response_copy = (response != NULL) ? strdup(response) : NULL;
+	*reply_signature_copy = strdup(reply_signature);
+	if ((response != NULL && *response_copy == NULL) || *reply_signature_copy == NULL) {
+		free(*response_copy);
+		*response_copy = NULL;
+		free(*reply_signature_copy);
+		*reply_signature_copy = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
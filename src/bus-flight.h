@@ -0,0 +1,41 @@
+/**
+ * @file bus-flight.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for sharing identical in-flight sd-bus calls
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_FLIGHT_H_
+#define _BUS_FLIGHT_H_
+
+#include <stdint.h>
+
+#include "bus-call.h"
+
+typedef struct bus_flight_group_s bus_flight_group_t;
+
+int bus_flight_group_create(bus_flight_group_t **group);
+void bus_flight_group_destroy(bus_flight_group_t *group);
+
+int bus_flight_join(bus_flight_group_t *group, bus_call_t *call);
+void bus_flight_complete(bus_flight_group_t *group, bus_call_t *call);
+int bus_flight_wait(bus_flight_group_t *group, bus_call_t *call, uint64_t deadline_usec);
+
+#endif //_BUS_FLIGHT_H_
@@ -0,0 +1,363 @@
+/**
+ * @file bus-metrics.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements latency and error metrics of sd-bus calls. Calls are
+ *        counted per bus, service, interface and method, every phase of a
+ *        call goes into a histogram with power of two buckets, and failed
+ *        calls are counted by their D-Bus error name.
+ *        The method of a call is looked up under the mutex once when it
+ *        begins, the following records update its counters atomically
+ *        without any lock, and only failed calls take the mutex again to
+ *        count their error name. The number
+ *        of methods and error names is capped, as both come from RPC input.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <systemd/sd-bus.h>
+
+#include "bus-metrics.h"
+#include "hashmap.h"
+
+#define BUS_METRICS_TARGETS_MAX 1024
+#define BUS_METRICS_ERROR_NAMES_MAX 32
+// failed calls whose error name no longer fits are counted under this name
+#define BUS_METRICS_ERROR_NAME_OTHER "other"
+// counters and histograms are updated without the lock, readers always see whole values
+#define BUS_METRICS_ADD(counter, value) __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#define BUS_METRICS_SUB(counter, value) __atomic_fetch_sub(&(counter), (value), __ATOMIC_RELAXED)
+#define BUS_METRICS_LOAD(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+struct bus_metrics_s {
+	// guards the targets map and the error names of the targets
+	pthread_mutex_t lock;
+	// key -> bus_metrics_target_t, targets live as long as the metrics
+	hashmap_t *targets;
+};
+
+static int bus_metrics_key_build(const bus_call_t *call, char **key, size_t *key_size);
+static bus_metrics_target_t *bus_metrics_target_create(const bus_call_t *call);
+static void bus_metrics_target_free(void *target);
+static void bus_metrics_error_count(bus_metrics_target_t *target, const char *name);
+static bool bus_metrics_target_visit(const void *key, size_t key_size, void *value, void *userdata);
+
+typedef struct bus_metrics_visit_s {
+	bus_metrics_visit_cb visit;
+	void *userdata;
+} bus_metrics_visit_t;
+
+int bus_metrics_create(bus_metrics_t **metrics)
+{
+	int error = 0;
+
+	if (metrics == NULL) {
+		return -EINVAL;
+	}
+
+	*metrics = calloc(1, sizeof(bus_metrics_t));
+	if (*metrics == NULL) {
+		return -ENOMEM;
+	}
+
+	error = hashmap_create(&(*metrics)->targets, bus_metrics_target_free);
+	if (error < 0) {
+		free(*metrics);
+		*metrics = NULL;
+		return error;
+	}
+
+	pthread_mutex_init(&(*metrics)->lock, NULL);
+
+	return 0;
+}
+
+void bus_metrics_destroy(bus_metrics_t *metrics)
+{
+	if (metrics == NULL) {
+		return;
+	}
+
+	hashmap_destroy(metrics->targets);
+	pthread_mutex_destroy(&metrics->lock);
+	free(metrics);
+}
+
+void bus_metrics_call_begin(bus_metrics_t *metrics, bus_call_t *call)
+{
+	char *key = NULL;
+	size_t key_size = 0;
+	bus_metrics_target_t *target = NULL;
+
+	if (metrics == NULL || call == NULL) {
+		return;
+	}
+
+	// calls that cannot be tracked are simply left out of the metrics
+	call->metrics = NULL;
+	if (bus_metrics_key_build(call, &key, &key_size) < 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&metrics->lock);
+
+	target = hashmap_get(metrics->targets, key, key_size);
+	if (target == NULL && hashmap_size(metrics->targets) < BUS_METRICS_TARGETS_MAX) {
+		target = bus_metrics_target_create(call);
+		if (target != NULL && hashmap_insert(metrics->targets, key, key_size, target) < 0) {
+			bus_metrics_target_free(target);
+			target = NULL;
+		}
+	}
+
+	pthread_mutex_unlock(&metrics->lock);
+
+	// targets are never removed, the call can keep using its target without the lock
+	if (target != NULL) {
+		BUS_METRICS_ADD(target->in_flight, 1);
+		call->metrics = target;
+	}
+
+	free(key);
+}
+
+void bus_metrics_phase_record(bus_metrics_t *metrics, const bus_call_t *call, bus_metrics_phase_t phase, uint64_t duration_usec)
+{
+	bus_metrics_histogram_t *histogram = NULL;
+	size_t bucket = 0;
+	uint64_t max_usec = 0;
+
+	if (metrics == NULL || call == NULL || call->metrics == NULL || phase >= BUS_METRICS_PHASE_COUNT) {
+		return;
+	}
+
+	while (bucket < BUS_METRICS_BUCKETS - 1 && duration_usec > (1ULL << bucket)) {
+		bucket++;
+	}
+
+	histogram = &call->metrics->phases[phase];
+	BUS_METRICS_ADD(histogram->count, 1);
+	BUS_METRICS_ADD(histogram->sum_usec, duration_usec);
+	BUS_METRICS_ADD(histogram->buckets[bucket], 1);
+
+	max_usec = BUS_METRICS_LOAD(histogram->max_usec);
+	while (duration_usec > max_usec &&
+		   !__atomic_compare_exchange_n(&histogram->max_usec, &max_usec, duration_usec, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void bus_metrics_call_end(bus_metrics_t *metrics, const bus_call_t *call, int error)
+{
+	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
+	const char *name = NULL;
+
+	if (metrics == NULL || call == NULL || call->metrics == NULL) {
+		return;
+	}
+
+	// local failures are named after the D-Bus error their errno maps to
+	if (error < 0) {
+		if (sd_bus_error_is_set(&call->bus_error)) {
+			name = call->bus_error.name;
+		} else {
+			sd_bus_error_set_errno(&bus_error, error);
+			name = bus_error.name;
+		}
+	}
+
+	BUS_METRICS_SUB(call->metrics->in_flight, 1);
+	BUS_METRICS_ADD(call->metrics->calls, 1);
+	if (error < 0) {
+		BUS_METRICS_ADD(call->metrics->errors, 1);
+
+		// only failed calls take the lock, for the table of error names
+		pthread_mutex_lock(&metrics->lock);
+		bus_metrics_error_count(call->metrics, (name != NULL) ? name : BUS_METRICS_ERROR_NAME_OTHER);
+		pthread_mutex_unlock(&metrics->lock);
+	}
+
+	sd_bus_error_free(&bus_error);
+}
+
+void bus_metrics_foreach(bus_metrics_t *metrics, bus_metrics_visit_cb visit, void *userdata)
+{
+	bus_metrics_visit_t context = {.visit = visit, .userdata = userdata};
+
+	if (metrics == NULL || visit == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&metrics->lock);
+	hashmap_foreach(metrics->targets, bus_metrics_target_visit, &context);
+	pthread_mutex_unlock(&metrics->lock);
+}
+
+const char *bus_metrics_phase_name(bus_metrics_phase_t phase)
+{
+	static const char *names[BUS_METRICS_PHASE_COUNT] = {"encode", "call", "decode", "output"};
+
+	return (phase < BUS_METRICS_PHASE_COUNT) ? names[phase] : NULL;
+}
+
+uint64_t bus_metrics_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+// bus type byte followed by the service, interface and method with their terminators
+static int bus_metrics_key_build(const bus_call_t *call, char **key, size_t *key_size)
+{
+	const char *strings[] = {call->service, call->interface, call->method};
+	char *position = NULL;
+
+	*key_size = 1;
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		if (strings[i] == NULL) {
+			return -EINVAL;
+		}
+		*key_size += strlen(strings[i]) + 1;
+	}
+
+	*key = malloc(*key_size);
+	if (*key == NULL) {
+		return -ENOMEM;
+	}
+
+	position = *key;
+	*position++ = (char) call->bus_type;
+	for (size_t i = 0; i < sizeof(strings) / sizeof(strings[0]); i++) {
+		position = stpcpy(position, strings[i]) + 1;
+	}
+
+	return 0;
+}
+
+static bus_metrics_target_t *bus_metrics_target_create(const bus_call_t *call)
+{
+	bus_metrics_target_t *target = NULL;
+
+	target = calloc(1, sizeof(bus_metrics_target_t));
+	if (target == NULL) {
+		return NULL;
+	}
+
+	target->bus_type = call->bus_type;
+	target->service = strdup(call->service);
+	target->interface = strdup(call->interface);
+	target->method = strdup(call->method);
+	if (target->service == NULL || target->interface == NULL || target->method == NULL) {
+		bus_metrics_target_free(target);
+		return NULL;
+	}
+
+	return target;
+}
+
+static void bus_metrics_target_free(void *target)
+{
+	bus_metrics_target_t *metrics_target = (bus_metrics_target_t *) target;
+
+	if (metrics_target == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < metrics_target->error_names_count; i++) {
+		free(metrics_target->error_names[i].name);
+	}
+	free(metrics_target->error_names);
+	free(metrics_target->service);
+	free(metrics_target->interface);
+	free(metrics_target->method);
+	free(metrics_target);
+}
+
+static void bus_metrics_error_count(bus_metrics_target_t *target, const char *name)
+{
+	bus_metrics_error_t *error_names = NULL;
+	char *copy = NULL;
+
+	for (size_t i = 0; i < target->error_names_count; i++) {
+		if (strcmp(target->error_names[i].name, name) == 0) {
+			target->error_names[i].count++;
+			return;
+		}
+	}
+
+	// the last slot is kept for the errors that no longer fit
+	if (target->error_names_count >= BUS_METRICS_ERROR_NAMES_MAX - 1 && strcmp(name, BUS_METRICS_ERROR_NAME_OTHER) != 0) {
+		bus_metrics_error_count(target, BUS_METRICS_ERROR_NAME_OTHER);
+		return;
+	}
+
+	copy = strdup(name);
+	error_names = realloc(target->error_names, (target->error_names_count + 1) * sizeof(bus_metrics_error_t));
+	if (copy == NULL || error_names == NULL) {
+		free(copy);
+		if (error_names != NULL) {
+			target->error_names = error_names;
+		}
+		return;
+	}
+
+	target->error_names = error_names;
+	target->error_names[target->error_names_count].name = copy;
+	target->error_names[target->error_names_count].count = 1;
+	target->error_names_count++;
+}
+
+// visits a snapshot of the target, its counters keep changing while they are read
+static bool bus_metrics_target_visit(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_metrics_visit_t *context = (bus_metrics_visit_t *) userdata;
+	bus_metrics_target_t *target = (bus_metrics_target_t *) value;
+	bus_metrics_target_t snapshot = {0};
+
+	snapshot.bus_type = target->bus_type;
+	snapshot.service = target->service;
+	snapshot.interface = target->interface;
+	snapshot.method = target->method;
+	snapshot.calls = BUS_METRICS_LOAD(target->calls);
+	snapshot.errors = BUS_METRICS_LOAD(target->errors);
+	snapshot.in_flight = BUS_METRICS_LOAD(target->in_flight);
+	for (size_t i = 0; i < BUS_METRICS_PHASE_COUNT; i++) {
+		snapshot.phases[i].count = BUS_METRICS_LOAD(target->phases[i].count);
+		snapshot.phases[i].sum_usec = BUS_METRICS_LOAD(target->phases[i].sum_usec);
+		snapshot.phases[i].max_usec = BUS_METRICS_LOAD(target->phases[i].max_usec);
+		for (size_t j = 0; j < BUS_METRICS_BUCKETS; j++) {
+			snapshot.phases[i].buckets[j] = BUS_METRICS_LOAD(target->phases[i].buckets[j]);
+		}
+	}
+	// the error names are only changed under the lock held by the caller
+	snapshot.error_names = target->error_names;
+	snapshot.error_names_count = target->error_names_count;
+
+	context->visit(&snapshot, context->userdata);
+
+	return false;
+}
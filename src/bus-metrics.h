@@ -0,0 +1,89 @@
+/**
+ * @file bus-metrics.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for collecting latency and error metrics of sd-bus calls
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_METRICS_H_
+#define _BUS_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bus-call.h"
+
+// bucket i counts durations of at most 2^i microseconds, the last one everything longer
+#define BUS_METRICS_BUCKETS 32
+
+typedef struct bus_metrics_s bus_metrics_t;
+
+typedef enum bus_metrics_phase_e {
+	// signature lookup and encoding of the arguments
+	BUS_METRICS_PHASE_ENCODE = 0,
+	// from sending the call until its reply was dispatched
+	BUS_METRICS_PHASE_CALL,
+	BUS_METRICS_PHASE_DECODE,
+	// building the RPC output of the call
+	BUS_METRICS_PHASE_OUTPUT,
+	BUS_METRICS_PHASE_COUNT,
+} bus_metrics_phase_t;
+
+typedef struct bus_metrics_histogram_s {
+	uint64_t count;
+	uint64_t sum_usec;
+	uint64_t max_usec;
+	uint64_t buckets[BUS_METRICS_BUCKETS];
+} bus_metrics_histogram_t;
+
+typedef struct bus_metrics_error_s {
+	char *name;
+	uint64_t count;
+} bus_metrics_error_t;
+
+// metrics of a single method of a service
+typedef struct bus_metrics_target_s {
+	bus_connection_type_t bus_type;
+	char *service;
+	char *interface;
+	char *method;
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t in_flight;
+	bus_metrics_histogram_t phases[BUS_METRICS_PHASE_COUNT];
+	// failed calls by D-Bus error name
+	bus_metrics_error_t *error_names;
+	size_t error_names_count;
+} bus_metrics_target_t;
+
+typedef void (*bus_metrics_visit_cb)(const bus_metrics_target_t *target, void *userdata);
+
+int bus_metrics_create(bus_metrics_t **metrics);
+void bus_metrics_destroy(bus_metrics_t *metrics);
+
+void bus_metrics_call_begin(bus_metrics_t *metrics, bus_call_t *call);
+void bus_metrics_phase_record(bus_metrics_t *metrics, const bus_call_t *call, bus_metrics_phase_t phase, uint64_t duration_usec);
+void bus_metrics_call_end(bus_metrics_t *metrics, const bus_call_t *call, int error);
+void bus_metrics_foreach(bus_metrics_t *metrics, bus_metrics_visit_cb visit, void *userdata);
+
+const char *bus_metrics_phase_name(bus_metrics_phase_t phase);
+uint64_t bus_metrics_now(void);
+
+#endif //_BUS_METRICS_H_
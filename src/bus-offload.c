@@ -0,0 +1,425 @@
+/**
+ * @file bus-offload.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements the offloading of large decoded replies. A reply above
+ *        the threshold is written once to a sealed memfd, or to a spool file
+ *        in the configured directory, and the RPC only returns its handle:
+ *        the /proc path of the memfd or the path of the file. Handles stay
+ *        valid for the retention time, expired memfds are closed and expired
+ *        spool files removed whenever a reply is stored or collect is called.
+ *        The number of stored replies and their total size are capped, the
+ *        oldest replies are released early to make room for new ones.
+ *        A closed memfd leaves its fd number free for reuse, so memfd handles
+ *        carry the device and inode of the memfd for readers to check.
+ *        The offload is shared by the worker threads and guarded by a mutex.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// memfd_create() and the file sealing commands
+#define _GNU_SOURCE
+
+/*=========================Includes===========================================*/
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bus-offload.h"
+
+#define BUS_OFFLOAD_NAME "generic-sd-bus-reply"
+#define BUS_OFFLOAD_SPOOL_TEMPLATE "%s/" BUS_OFFLOAD_NAME "-XXXXXX"
+// path of the memfd, then its device and inode
+#define BUS_OFFLOAD_MEMFD_HANDLE "/proc/%ld/fd/%d#%" PRIu64 ":%" PRIu64
+// every stored memfd holds a file descriptor of the process
+#define BUS_OFFLOAD_ENTRIES_MAX 256
+
+// a stored reply, either an open memfd or a spool file
+typedef struct bus_offload_entry_s {
+	int fd;
+	char *path;
+	size_t size;
+	uint64_t expires_usec;
+} bus_offload_entry_t;
+
+struct bus_offload_s {
+	pthread_mutex_t lock;
+	size_t threshold;
+	char *directory;
+	uint64_t retention_usec;
+	size_t max_bytes;
+	// oldest first, room for BUS_OFFLOAD_ENTRIES_MAX entries
+	bus_offload_entry_t *entries;
+	size_t entries_count;
+	// replies being written count against both limits as well
+	size_t writing_count;
+	size_t bytes;
+	uint64_t evictions;
+};
+
+static int bus_offload_write(int fd, const char *data, size_t size);
+static int bus_offload_memfd_store(const char *data, size_t size, bus_offload_entry_t *entry, char **handle);
+static int bus_offload_spool_store(const char *directory, const char *data, size_t size, bus_offload_entry_t *entry, char **handle);
+static void bus_offload_entry_release(bus_offload_entry_t *entry);
+static void bus_offload_expire(bus_offload_t *offload, uint64_t now_usec);
+static bool bus_offload_evict(bus_offload_t *offload, size_t entries_count, size_t size);
+static uint64_t bus_offload_now(void);
+
+int bus_offload_create(bus_offload_t **offload)
+{
+	if (offload == NULL) {
+		return -EINVAL;
+	}
+
+	*offload = calloc(1, sizeof(bus_offload_t));
+	if (*offload == NULL) {
+		return -ENOMEM;
+	}
+
+	(*offload)->entries = calloc(BUS_OFFLOAD_ENTRIES_MAX, sizeof(bus_offload_entry_t));
+	if ((*offload)->entries == NULL) {
+		free(*offload);
+		*offload = NULL;
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&(*offload)->lock, NULL);
+
+	return 0;
+}
+
+void bus_offload_destroy(bus_offload_t *offload)
+{
+	if (offload == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < offload->entries_count; i++) {
+		bus_offload_entry_release(&offload->entries[i]);
+	}
+	free(offload->entries);
+	free(offload->directory);
+	pthread_mutex_destroy(&offload->lock);
+	free(offload);
+}
+
+int bus_offload_configure(bus_offload_t *offload, size_t threshold, const char *directory, uint64_t retention_usec, size_t max_bytes)
+{
+	char *copy = NULL;
+
+	if (offload == NULL) {
+		return -EINVAL;
+	}
+
+	if (directory != NULL) {
+		copy = strdup(directory);
+		if (copy == NULL) {
+			return -ENOMEM;
+		}
+	}
+
+	// replies stored so far keep the retention they were stored with, the oldest are evicted beyond a lower limit
+	pthread_mutex_lock(&offload->lock);
+	free(offload->directory);
+	offload->directory = copy;
+	offload->threshold = threshold;
+	offload->retention_usec = retention_usec;
+	offload->max_bytes = max_bytes;
+	offload->evictions = 0;
+	bus_offload_evict(offload, 0, 0);
+	pthread_mutex_unlock(&offload->lock);
+
+	return 0;
+}
+
+int bus_offload_store(bus_offload_t *offload, const char *data, size_t size, char **handle)
+{
+	int error = 0;
+	bus_offload_entry_t entry = {.fd = -1};
+	char *directory = NULL;
+	uint64_t now_usec = 0;
+
+	if (offload == NULL || data == NULL || handle == NULL) {
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&offload->lock);
+	if (offload->threshold == 0 || size <= offload->threshold) {
+		pthread_mutex_unlock(&offload->lock);
+		return 0;
+	}
+
+	if (offload->directory != NULL) {
+		directory = strdup(offload->directory);
+		if (directory == NULL) {
+			pthread_mutex_unlock(&offload->lock);
+			return -ENOMEM;
+		}
+	}
+
+	// a reply larger than the limit would evict everything and still not fit
+	if (size > offload->max_bytes) {
+		pthread_mutex_unlock(&offload->lock);
+		free(directory);
+		return -EFBIG;
+	}
+
+	now_usec = bus_offload_now();
+	bus_offload_expire(offload, now_usec);
+	// replies still being written cannot be evicted
+	if (!bus_offload_evict(offload, 1, size)) {
+		pthread_mutex_unlock(&offload->lock);
+		free(directory);
+		return -ENOSPC;
+	}
+	entry.size = size;
+	entry.expires_usec = now_usec + offload->retention_usec;
+	offload->writing_count++;
+	offload->bytes += size;
+	pthread_mutex_unlock(&offload->lock);
+
+	// the reply is written without holding the lock, other calls are not held up by a large write
+	if (directory != NULL) {
+		error = bus_offload_spool_store(directory, data, size, &entry, handle);
+	} else {
+		error = bus_offload_memfd_store(data, size, &entry, handle);
+	}
+	free(directory);
+
+	// the reservation made above guarantees room for the entry
+	pthread_mutex_lock(&offload->lock);
+	offload->writing_count--;
+	if (error < 0) {
+		offload->bytes -= size;
+	} else {
+		offload->entries[offload->entries_count++] = entry;
+	}
+	pthread_mutex_unlock(&offload->lock);
+
+	return (error < 0) ? error : 1;
+}
+
+void bus_offload_collect(bus_offload_t *offload)
+{
+	if (offload == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&offload->lock);
+	bus_offload_expire(offload, bus_offload_now());
+	pthread_mutex_unlock(&offload->lock);
+}
+
+void bus_offload_stats(bus_offload_t *offload, bus_offload_stats_t *stats)
+{
+	if (offload == NULL || stats == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&offload->lock);
+	bus_offload_expire(offload, bus_offload_now());
+	stats->evictions = offload->evictions;
+	stats->entries = offload->entries_count;
+	stats->bytes = offload->bytes;
+	pthread_mutex_unlock(&offload->lock);
+}
+
+static int bus_offload_write(int fd, const char *data, size_t size)
+{
+	ssize_t written = 0;
+
+	while (size > 0) {
+		written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+
+		data += written;
+		size -= (size_t) written;
+	}
+
+	return 0;
+}
+
+static int bus_offload_memfd_store(const char *data, size_t size, bus_offload_entry_t *entry, char **handle)
+{
+	int error = 0;
+	int fd = -1;
+	int handle_size = 0;
+	struct stat st = {0};
+
+	fd = memfd_create(BUS_OFFLOAD_NAME, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	error = bus_offload_write(fd, data, size);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	// readers get the exact reply, nobody can change it behind their back
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+		error = -errno;
+		goto error_out;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		error = -errno;
+		goto error_out;
+	}
+
+	handle_size = snprintf(NULL, 0, BUS_OFFLOAD_MEMFD_HANDLE, (long) getpid(), fd, (uint64_t) st.st_dev, (uint64_t) st.st_ino) + 1;
+	*handle = malloc((size_t) handle_size);
+	if (*handle == NULL) {
+		error = -ENOMEM;
+		goto error_out;
+	}
+	snprintf(*handle, (size_t) handle_size, BUS_OFFLOAD_MEMFD_HANDLE, (long) getpid(), fd, (uint64_t) st.st_dev, (uint64_t) st.st_ino);
+
+	entry->fd = fd;
+
+	return 0;
+
+error_out:
+	close(fd);
+
+	return error;
+}
+
+static int bus_offload_spool_store(const char *directory, const char *data, size_t size, bus_offload_entry_t *entry, char **handle)
+{
+	int error = 0;
+	int fd = -1;
+	char *path = NULL;
+	int path_size = 0;
+
+	path_size = snprintf(NULL, 0, BUS_OFFLOAD_SPOOL_TEMPLATE, directory) + 1;
+	path = malloc((size_t) path_size);
+	if (path == NULL) {
+		return -ENOMEM;
+	}
+	snprintf(path, (size_t) path_size, BUS_OFFLOAD_SPOOL_TEMPLATE, directory);
+
+	fd = mkostemp(path, O_CLOEXEC);
+	if (fd < 0) {
+		error = -errno;
+		free(path);
+		return error;
+	}
+
+	error = bus_offload_write(fd, data, size);
+	if (error == 0 && fchmod(fd, S_IRUSR | S_IRGRP) < 0) {
+		error = -errno;
+	}
+	close(fd);
+	if (error < 0) {
+		unlink(path);
+		free(path);
+		return error;
+	}
+
+	*handle = strdup(path);
+	if (*handle == NULL) {
+		unlink(path);
+		free(path);
+		return -ENOMEM;
+	}
+
+	entry->path = path;
+
+	return 0;
+}
+
+static void bus_offload_entry_release(bus_offload_entry_t *entry)
+{
+	if (entry->fd >= 0) {
+		close(entry->fd);
+		entry->fd = -1;
+	}
+
+	if (entry->path != NULL) {
+		unlink(entry->path);
+		free(entry->path);
+		entry->path = NULL;
+	}
+}
+
+static void bus_offload_expire(bus_offload_t *offload, uint64_t now_usec)
+{
+	size_t kept = 0;
+
+	for (size_t i = 0; i < offload->entries_count; i++) {
+		if (offload->entries[i].expires_usec <= now_usec) {
+			offload->bytes -= offload->entries[i].size;
+			bus_offload_entry_release(&offload->entries[i]);
+			continue;
+		}
+
+		offload->entries[kept++] = offload->entries[i];
+	}
+
+	offload->entries_count = kept;
+}
+
+// releases the oldest entries until the given entries and size fit within the limits, returns whether they fit
+static bool bus_offload_evict(bus_offload_t *offload, size_t entries_count, size_t size)
+{
+	size_t evicted = 0;
+	bool fits = false;
+
+	for (;;) {
+		fits = offload->entries_count - evicted + offload->writing_count + entries_count <= BUS_OFFLOAD_ENTRIES_MAX &&
+			   offload->bytes + size <= offload->max_bytes;
+		if (fits || evicted == offload->entries_count) {
+			break;
+		}
+
+		offload->bytes -= offload->entries[evicted].size;
+		bus_offload_entry_release(&offload->entries[evicted]);
+		evicted++;
+	}
+
+	if (evicted > 0) {
+		offload->entries_count -= evicted;
+		memmove(offload->entries, offload->entries + evicted, offload->entries_count * sizeof(bus_offload_entry_t));
+		offload->evictions += evicted;
+	}
+
+	return fits;
+}
+
+static uint64_t bus_offload_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file bus-offload.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for moving large decoded replies out of the RPC output
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_OFFLOAD_H_
+#define _BUS_OFFLOAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct bus_offload_s bus_offload_t;
+
+typedef struct bus_offload_stats_s {
+	uint64_t evictions;
+	size_t entries;
+	size_t bytes;
+} bus_offload_stats_t;
+
+int bus_offload_create(bus_offload_t **offload);
+void bus_offload_destroy(bus_offload_t *offload);
+
+// a threshold of 0 disables offloading, without a directory replies go to sealed memfds
+int bus_offload_configure(bus_offload_t *offload, size_t threshold, const char *directory, uint64_t retention_usec, size_t max_bytes);
+// returns 1 and the handle of the stored data, or 0 if the data is small enough to stay inline
+int bus_offload_store(bus_offload_t *offload, const char *data, size_t size, char **handle);
+// releases the stored data whose retention has run out
+void bus_offload_collect(bus_offload_t *offload);
+void bus_offload_stats(bus_offload_t *offload, bus_offload_stats_t *stats);
+
+#endif //_BUS_OFFLOAD_H_
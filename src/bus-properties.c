@@ -0,0 +1,435 @@
+/**
+ * @file bus-properties.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements reading and writing of sd-bus properties in batches.
+ *        Properties read from the same object and interface are grouped
+ *        and fetched with a single org.freedesktop.DBus.Properties.GetAll
+ *        call, the requested ones are then picked out of its reply and
+ *        decoded with the regular reply decoder. Writes are sent as one
+ *        Set call per property since D-Bus has no way to merge them.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sysrepo.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-bus-protocol.h>
+
+#include "bus-properties.h"
+#include "hashmap.h"
+
+#define BUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+#define BUS_PROPERTIES_GET_ALL "GetAll"
+#define BUS_PROPERTIES_GET_ALL_SIGNATURE "s"
+#define BUS_PROPERTIES_SET "Set"
+#define BUS_PROPERTIES_SET_SIGNATURE "ssv"
+
+// growing buffer the hashmap keys are built in
+typedef struct bus_property_key_s {
+	char *data;
+	size_t size;
+	size_t capacity;
+} bus_property_key_t;
+
+static int bus_property_call_add(bus_property_batch_t *batch, const bus_property_t *property, const char *method,
+								 const char *signature, bus_encode_format_t format);
+static char *bus_property_arguments(bus_encode_format_t format, const char *interface, const char *name, const char *value);
+static int bus_property_reply_parse(sd_bus_message *reply, size_t call, hashmap_t *reads, bus_property_key_t *key,
+									bus_decode_format_t format);
+static int bus_property_key_build(bus_property_key_t *key, size_t strings_count, const char **strings, const void *id, size_t id_size);
+
+int bus_property_batch_create(bus_property_batch_t *batch, bus_property_t *properties, size_t properties_count,
+							  bus_encode_format_t value_format)
+{
+	int error = 0;
+	hashmap_t *groups = NULL;
+	bus_property_key_t key = {0};
+	uintptr_t group = 0;
+
+	if (batch == NULL || (properties == NULL && properties_count > 0)) {
+		return -EINVAL;
+	}
+
+	memset(batch, 0, sizeof(bus_property_batch_t));
+
+	// there is never more than one call per property
+	batch->calls = calloc(properties_count ? properties_count : 1, sizeof(bus_call_t));
+	batch->arguments = calloc(properties_count ? properties_count : 1, sizeof(char *));
+	if (batch->calls == NULL || batch->arguments == NULL) {
+		error = -ENOMEM;
+		goto error_out;
+	}
+
+	error = hashmap_create(&groups, NULL);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	for (size_t i = 0; i < properties_count; i++) {
+		bus_property_t *property = &properties[i];
+		const char *strings[] = {property->service, property->object_path, property->interface};
+		uint8_t bus_type = (uint8_t) property->bus_type;
+
+		// writes cannot be merged, D-Bus has no counterpart of GetAll for them
+		if (property->value != NULL) {
+			property->call = batch->calls_count;
+			error = bus_property_call_add(batch, property, BUS_PROPERTIES_SET, BUS_PROPERTIES_SET_SIGNATURE, value_format);
+			if (error < 0) {
+				goto error_out;
+			}
+			continue;
+		}
+
+		error = bus_property_key_build(&key, 3, strings, &bus_type, sizeof(bus_type));
+		if (error < 0) {
+			goto error_out;
+		}
+
+		// groups hold the index of their GetAll call plus one, zero means no group yet
+		group = (uintptr_t) hashmap_get(groups, key.data, key.size);
+		if (group == 0) {
+			error = bus_property_call_add(batch, property, BUS_PROPERTIES_GET_ALL, BUS_PROPERTIES_GET_ALL_SIGNATURE, value_format);
+			if (error < 0) {
+				goto error_out;
+			}
+
+			group = batch->calls_count;
+			error = hashmap_insert(groups, key.data, key.size, (void *) group);
+			if (error < 0) {
+				goto error_out;
+			}
+		}
+
+		property->call = group - 1;
+	}
+
+	hashmap_destroy(groups);
+	free(key.data);
+
+	return 0;
+
+error_out:
+	hashmap_destroy(groups);
+	free(key.data);
+	bus_property_batch_release(batch);
+
+	return error;
+}
+
+int bus_property_batch_collect(bus_property_batch_t *batch, bus_property_t *properties, size_t properties_count,
+							   bus_decode_format_t format)
+{
+	int error = 0;
+	hashmap_t *reads = NULL;
+	bus_property_key_t key = {0};
+
+	if (batch == NULL || (properties == NULL && properties_count > 0)) {
+		return -EINVAL;
+	}
+
+	error = hashmap_create(&reads, NULL);
+	if (error < 0) {
+		return error;
+	}
+
+	// properties to be read, keyed by the index of their GetAll call and their name
+	for (size_t i = 0; i < properties_count; i++) {
+		if (properties[i].value != NULL) {
+			continue;
+		}
+
+		error = bus_property_key_build(&key, 1, &properties[i].name, &properties[i].call, sizeof(size_t));
+		if (error < 0) {
+			goto out;
+		}
+
+		error = hashmap_insert(reads, key.data, key.size, &properties[i]);
+		if (error < 0) {
+			goto out;
+		}
+	}
+
+	for (size_t i = 0; i < batch->calls_count; i++) {
+		bus_call_t *call = &batch->calls[i];
+
+		if (call->error < 0 || call->reply == NULL || strcmp(call->method, BUS_PROPERTIES_GET_ALL) != 0) {
+			continue;
+		}
+
+		error = bus_property_reply_parse(call->reply, i, reads, &key, format);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to parse properties of %s: %s", call->object_path, strerror(-error));
+			// the properties not picked out yet share the failure of the call
+			call->error = error;
+		}
+	}
+
+	error = 0;
+
+	for (size_t i = 0; i < properties_count; i++) {
+		bus_property_t *property = &properties[i];
+		bus_call_t *call = &batch->calls[property->call];
+
+		if (property->done) {
+			continue;
+		}
+
+		if (call->error < 0 || call->reply == NULL) {
+			property->error = (call->error < 0) ? call->error : -EIO;
+			if (sd_bus_error_is_set(&call->bus_error)) {
+				sd_bus_error_copy(&property->bus_error, &call->bus_error);
+			}
+		} else if (property->value == NULL) {
+			// GetAll succeeded but did not return this property
+			property->error = -ENOENT;
+			sd_bus_error_set(&property->bus_error, SD_BUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
+		}
+
+		property->done = true;
+	}
+
+out:
+	hashmap_destroy(reads);
+	free(key.data);
+
+	return error;
+}
+
+void bus_property_batch_release(bus_property_batch_t *batch)
+{
+	if (batch == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < batch->calls_count; i++) {
+		bus_call_release(&batch->calls[i]);
+		free(batch->arguments[i]);
+	}
+
+	free(batch->calls);
+	free(batch->arguments);
+	memset(batch, 0, sizeof(bus_property_batch_t));
+}
+
+void bus_property_release(bus_property_t *property)
+{
+	if (property == NULL) {
+		return;
+	}
+
+	sd_bus_error_free(&property->bus_error);
+	free(property->signature);
+	property->signature = NULL;
+	free(property->response);
+	property->response = NULL;
+}
+
+static int bus_property_call_add(bus_property_batch_t *batch, const bus_property_t *property, const char *method,
+								 const char *signature, bus_encode_format_t format)
+{
+	bus_call_t *call = &batch->calls[batch->calls_count];
+	char *arguments = NULL;
+
+	arguments = bus_property_arguments(format, property->interface, (property->value != NULL) ? property->name : NULL, property->value);
+	if (arguments == NULL) {
+		return -ENOMEM;
+	}
+
+	call->bus_type = property->bus_type;
+	call->service = property->service;
+	call->object_path = property->object_path;
+	call->interface = BUS_PROPERTIES_INTERFACE;
+	call->method = method;
+	call->signature = signature;
+	call->arguments = arguments;
+	call->arguments_format = format;
+
+	batch->arguments[batch->calls_count] = arguments;
+	batch->calls_count++;
+
+	return 0;
+}
+
+static char *bus_property_arguments(bus_encode_format_t format, const char *interface, const char *name, const char *value)
+{
+	const char *strings[] = {interface, name};
+	const char *separator = (format == BUS_ENCODE_FORMAT_JSON) ? ", " : " ";
+	size_t size = 0;
+	char *arguments = NULL;
+	char *position = NULL;
+
+	// every character may need escaping, plus quotes, separators and brackets
+	for (size_t i = 0; i < 2; i++) {
+		size += (strings[i] != NULL) ? 2 * strlen(strings[i]) + 4 : 0;
+	}
+	size += ((value != NULL) ? strlen(value) + 2 : 0) + 3;
+
+	arguments = malloc(size);
+	if (arguments == NULL) {
+		return NULL;
+	}
+
+	position = arguments;
+	if (format == BUS_ENCODE_FORMAT_JSON) {
+		*position++ = '[';
+	}
+
+	// both formats quote strings and escape quotes and backslashes the same way
+	for (size_t i = 0; i < 2; i++) {
+		if (strings[i] == NULL) {
+			continue;
+		}
+
+		if (i > 0) {
+			position = stpcpy(position, separator);
+		}
+
+		*position++ = '"';
+		for (const char *character = strings[i]; *character != '\0'; character++) {
+			if (*character == '"' || *character == '\\') {
+				*position++ = '\\';
+			}
+			*position++ = *character;
+		}
+		*position++ = '"';
+	}
+
+	if (value != NULL) {
+		position = stpcpy(position, separator);
+		position = stpcpy(position, value);
+	}
+
+	if (format == BUS_ENCODE_FORMAT_JSON) {
+		*position++ = ']';
+	}
+	*position = '\0';
+
+	return arguments;
+}
+
+static int bus_property_reply_parse(sd_bus_message *reply, size_t call, hashmap_t *reads, bus_property_key_t *key,
+									bus_decode_format_t format)
+{
+	int error = 0;
+	const char *name = NULL;
+	const char *contents = NULL;
+	bus_property_t *property = NULL;
+
+	error = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "{sv}");
+	if (error < 0) {
+		return error;
+	}
+
+	while ((error = sd_bus_message_enter_container(reply, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+		error = sd_bus_message_read_basic(reply, SD_BUS_TYPE_STRING, &name);
+		if (error < 0) {
+			return error;
+		}
+
+		error = bus_property_key_build(key, 1, &name, &call, sizeof(size_t));
+		if (error < 0) {
+			return error;
+		}
+
+		property = hashmap_get(reads, key->data, key->size);
+		if (property == NULL || property->done) {
+			// not requested, only the requested properties are decoded
+			error = sd_bus_message_skip(reply, "v");
+			if (error < 0) {
+				return error;
+			}
+		} else {
+			error = sd_bus_message_peek_type(reply, NULL, &contents);
+			if (error < 0) {
+				return error;
+			}
+
+			property->signature = strdup(contents);
+			if (property->signature == NULL) {
+				return -ENOMEM;
+			}
+
+			error = sd_bus_message_enter_container(reply, SD_BUS_TYPE_VARIANT, contents);
+			if (error < 0) {
+				return error;
+			}
+
+			error = bus_message_decode_type_format(reply, contents, format, BUS_BYTES_FORMAT_ARRAY, &property->response);
+			if (error < 0) {
+				return error;
+			}
+
+			error = sd_bus_message_exit_container(reply);
+			if (error < 0) {
+				return error;
+			}
+
+			property->done = true;
+		}
+
+		error = sd_bus_message_exit_container(reply);
+		if (error < 0) {
+			return error;
+		}
+	}
+	if (error < 0) {
+		return error;
+	}
+
+	return sd_bus_message_exit_container(reply);
+}
+
+static int bus_property_key_build(bus_property_key_t *key, size_t strings_count, const char **strings, const void *id, size_t id_size)
+{
+	size_t size = id_size;
+	void *tmp = NULL;
+
+	for (size_t i = 0; i < strings_count; i++) {
+		size += strlen(strings[i]) + 1;
+	}
+
+	if (size > key->capacity) {
+		tmp = realloc(key->data, size);
+		if (tmp == NULL) {
+			return -ENOMEM;
+		}
+		key->data = tmp;
+		key->capacity = size;
+	}
+
+	// the strings keep their terminators so that their boundaries are part of the key
+	key->size = 0;
+	memcpy(key->data, id, id_size);
+	key->size += id_size;
+	for (size_t i = 0; i < strings_count; i++) {
+		size_t string_size = strlen(strings[i]) + 1;
+
+		memcpy(key->data + key->size, strings[i], string_size);
+		key->size += string_size;
+	}
+
+	return 0;
+}
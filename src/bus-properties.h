@@ -0,0 +1,74 @@
+/**
+ * @file bus-properties.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for reading and writing sd-bus properties in batches
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_PROPERTIES_H_
+#define _BUS_PROPERTIES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <systemd/sd-bus.h>
+
+#include "bus-call.h"
+#include "bus-connection.h"
+#include "transform-sd-bus.h"
+
+// single sd-bus-property entry of an sd-bus-properties RPC
+typedef struct bus_property_s {
+	bus_connection_type_t bus_type;
+	const char *service;
+	const char *object_path;
+	const char *interface;
+	const char *name;
+	// new value in the arguments format, NULL reads the property
+	const char *value;
+
+	// call of the batch serving this property
+	size_t call;
+	int error;
+	// D-Bus error name and message of a failed read or write
+	sd_bus_error bus_error;
+	bool done;
+	// signature and decoded value of a property that was read
+	char *signature;
+	char *response;
+} bus_property_t;
+
+// sd-bus calls serving a set of properties, reads of the same object and
+// interface share a single GetAll call
+typedef struct bus_property_batch_s {
+	bus_call_t *calls;
+	size_t calls_count;
+	// encoded arguments of every call
+	char **arguments;
+} bus_property_batch_t;
+
+int bus_property_batch_create(bus_property_batch_t *batch, bus_property_t *properties, size_t properties_count,
+							  bus_encode_format_t value_format);
+int bus_property_batch_collect(bus_property_batch_t *batch, bus_property_t *properties, size_t properties_count,
+							   bus_decode_format_t format);
+void bus_property_batch_release(bus_property_batch_t *batch);
+void bus_property_release(bus_property_t *property);
+
+#endif //_BUS_PROPERTIES_H_
@@ -0,0 +1,63 @@
+/**
+ * @file bus-trace.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Defines the static tracepoints of the sd-bus call path. With
+ *        ENABLE_USDT the tracepoints are USDT probes of the generic_sd_bus
+ *        provider that bpftrace or perf can attach to, a probe nobody is
+ *        attached to costs a single nop. Without it they compile to nothing,
+ *        their arguments are never evaluated.
+ *
+ *        Probes, all durations in microseconds:
+ *          rpc__entry(rpc path)
+ *          rpc__return(rpc path, entries, sysrepo error, duration)
+ *          encode__begin(service, method, arguments bytes)
+ *          encode__end(service, method, error, duration)
+ *          call__send(service, method)
+ *          call__done(service, method, error, duration)
+ *          decode__begin(service, method)
+ *          decode__end(service, method, error, response bytes, duration)
+ *          output__begin(method, index)
+ *          output__end(method, index, error, duration)
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_TRACE_H_
+#define _BUS_TRACE_H_
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+
+#define BUS_TRACE(name, ...) STAP_PROBEV(generic_sd_bus, name, __VA_ARGS__)
+#else
+// keeps the arguments referenced without ever evaluating them
+static inline void bus_trace_unused(int unused, ...)
+{
+	(void) unused;
+}
+
+#define BUS_TRACE(name, ...)                  \
+	do {                                      \
+		if (0) {                              \
+			bus_trace_unused(0, __VA_ARGS__); \
+		}                                     \
+	} while (0)
+#endif
+
+#endif //_BUS_TRACE_H_
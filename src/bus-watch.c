@@ -0,0 +1,1363 @@
+/**
+ * @file bus-watch.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements mirroring of the properties of watched sd-bus objects.
+ *        Every watched object interface is fetched once with GetAll and kept
+ *        current from its PropertiesChanged signals, so reading the mirror
+ *        costs no bus traffic at all. GetAll is sent asynchronously, a slow
+ *        service does not hold up the other objects and subscriptions. Properties that are invalidated without
+ *        a value, or whose service got a new owner, are fetched again.
+ *        The same thread installs the match rules of the signal subscriptions
+ *        and delivers their signals, either one by one or collected over a
+ *        coalescing window so that a storm of signals arrives as a few batches.
+ *        A single watcher thread owns the bus connections and is the only one
+ *        changing the cache, always under the cache lock, while readers only
+ *        take the lock to walk it. Given an sd-event loop, the watcher runs on
+ *        that loop instead of a thread of its own: the loop dispatches its bus
+ *        connections, and a post source takes the same step the thread takes
+ *        after every dispatch, with a timer for the coalescing windows.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <sysrepo.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-bus-protocol.h>
+#include <systemd/sd-event.h>
+
+#include "bus-watch.h"
+#include "hashmap.h"
+#include "transform-sd-bus.h"
+
+#define BUS_WATCH_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
+#define BUS_WATCH_RULE_PROPERTIES_CHANGED "type='signal',sender='%s',path='%s',"                            \
+										  "interface='org.freedesktop.DBus.Properties',member='PropertiesChanged'," \
+										  "arg0='%s'"
+#define BUS_WATCH_RULE_NAME_OWNER_CHANGED "type='signal',sender='org.freedesktop.DBus',path='/org/freedesktop/DBus'," \
+										  "interface='org.freedesktop.DBus',member='NameOwnerChanged',arg0='%s'"
+// objects that could not be subscribed are tried again after this long
+#define BUS_WATCH_RETRY_MSEC 5000
+// a coalesced batch is delivered early once it holds this many signals
+#define BUS_WATCH_SIGNALS_MAX 1024
+// coalescing windows are short, the timer on an event loop must not be batched with others
+#define BUS_WATCH_TIMER_ACCURACY_USEC 1000
+
+typedef struct bus_watch_property_s {
+	char *signature;
+	char *value;
+} bus_watch_property_t;
+
+typedef struct bus_watch_object_s {
+	bus_watch_t *watch;
+	// strings of the key point into id
+	bus_watch_key_t key;
+	// bus type and zero terminated key strings, the hashmap key of the object
+	char *id;
+	size_t id_size;
+	sd_bus *bus;
+	sd_bus_slot *properties_changed;
+	sd_bus_slot *name_owner_changed;
+	// GetAll waiting for its reply, a newer fetch cancels it
+	sd_bus_slot *fetch;
+	// property name -> bus_watch_property_t, NULL while not synchronized
+	hashmap_t *properties;
+	bool synchronized;
+	// the properties have to be fetched again with GetAll
+	bool stale;
+	// still part of the watched set, used while reconciling
+	bool wanted;
+} bus_watch_object_t;
+
+typedef struct bus_watch_subscription_s {
+	bus_watch_t *watch;
+	char *name;
+	bus_connection_type_t bus_type;
+	char *rule;
+	uint64_t coalesce_usec;
+	sd_bus *bus;
+	sd_bus_slot *slot;
+	// signals waiting for the coalescing window to close
+	bus_watch_signal_t *signals;
+	size_t signals_count;
+	size_t signals_size;
+	uint64_t deadline_usec;
+	// still part of the subscribed set, used while reconciling
+	bool wanted;
+} bus_watch_subscription_t;
+
+struct bus_watch_s {
+	pthread_t thread;
+	// event loop the watcher runs on instead of its thread, if any
+	sd_event *event;
+	sd_event_source *wakeup_source;
+	sd_event_source *timer_source;
+	sd_event_source *post_source;
+	pthread_mutex_t lock;
+	int wakeup_fd;
+	bool stop;
+	// watched set handed over by bus_watch_set, taken by the watcher thread
+	bus_watch_key_t *pending;
+	size_t pending_count;
+	bool pending_set;
+	// signal subscriptions handed over by bus_watch_signals_set
+	bus_watch_signal_key_t *pending_signals;
+	size_t pending_signals_count;
+	bool pending_signals_set;
+	// owned by the watcher thread, changed only under the lock
+	hashmap_t *objects;
+	// subscription name -> bus_watch_subscription_t, used by the watcher thread only
+	hashmap_t *subscriptions;
+	bus_connection_pool_t *connections;
+	bus_watch_signal_cb signal_cb;
+	void *userdata;
+	// set from the watcher thread when the loop must not sleep
+	bool refetch;
+	bool retry;
+};
+
+// reader callback and its userdata while walking the cache
+typedef struct bus_watch_visit_s {
+	bus_watch_visit_cb visit;
+	void *userdata;
+	const bus_watch_object_t *object;
+} bus_watch_visit_t;
+
+// distinct bus connections of the watched objects
+typedef struct bus_watch_buses_s {
+	sd_bus *bus[BUS_CONNECTION_TYPE_COUNT];
+	size_t count;
+} bus_watch_buses_t;
+
+static void *bus_watch_thread(void *arg);
+static bool bus_watch_step(bus_watch_t *watch);
+static void bus_watch_wakeup(bus_watch_t *watch);
+static void bus_watch_wait(bus_watch_t *watch);
+static uint64_t bus_watch_deadline(bus_watch_t *watch);
+static int bus_watch_event_attach(bus_watch_t *watch, sd_event *event);
+static int bus_watch_wakeup_cb(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int bus_watch_timer_cb(sd_event_source *source, uint64_t usec, void *userdata);
+static int bus_watch_post_cb(sd_event_source *source, void *userdata);
+static uint64_t bus_watch_now(void);
+static void bus_watch_reconcile(bus_watch_t *watch, const bus_watch_key_t *keys, size_t keys_count);
+static bus_watch_key_t *bus_watch_keys_copy(const bus_watch_key_t *keys, size_t keys_count);
+static int bus_watch_id_build(const bus_watch_key_t *key, char **id, size_t *id_size);
+static void bus_watch_signals_reconcile(bus_watch_t *watch, const bus_watch_signal_key_t *keys, size_t keys_count);
+static bus_watch_signal_key_t *bus_watch_signal_keys_copy(const bus_watch_signal_key_t *keys, size_t keys_count);
+static int bus_watch_rule_build(const bus_watch_signal_key_t *key, char **rule);
+static bool bus_watch_object_sync(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_object_unmark(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_object_unwanted(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_object_bus_collect(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_subscription_sync(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_subscription_unmark(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_subscription_unwanted(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_subscription_bus_collect(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_subscription_deadline(const void *key, size_t key_size, void *value, void *userdata);
+static void bus_watch_buses_add(bus_watch_buses_t *buses, sd_bus *bus);
+static bool bus_watch_object_visit(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_property_visit(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_property_move(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_watch_property_drop(const void *key, size_t key_size, void *value, void *userdata);
+static int bus_watch_object_subscribe(bus_watch_object_t *object, sd_bus *bus);
+static void bus_watch_object_fetch(bus_watch_object_t *object);
+static void bus_watch_object_fetched(bus_watch_object_t *object, hashmap_t *properties);
+static void bus_watch_object_free(void *object);
+static int bus_watch_properties_read(sd_bus_message *m, hashmap_t *properties);
+static void bus_watch_property_free(void *property);
+static void bus_watch_subscription_flush(bus_watch_subscription_t *subscription);
+static void bus_watch_subscription_free(void *subscription);
+static void bus_watch_signal_release(bus_watch_signal_t *signal);
+static int bus_watch_properties_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int bus_watch_name_owner_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int bus_watch_signal_received_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int bus_watch_object_fetch_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+
+int bus_watch_create(bus_watch_t **watch, sd_event *event, bus_watch_signal_cb signal_cb, void *userdata)
+{
+	int error = 0;
+	bus_watch_t *created = NULL;
+
+	if (watch == NULL) {
+		return -EINVAL;
+	}
+
+	created = calloc(1, sizeof(bus_watch_t));
+	if (created == NULL) {
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&created->lock, NULL);
+	created->signal_cb = signal_cb;
+	created->userdata = userdata;
+
+	created->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (created->wakeup_fd < 0) {
+		error = -errno;
+		goto error_out;
+	}
+
+	error = hashmap_create(&created->objects, bus_watch_object_free);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	error = hashmap_create(&created->subscriptions, bus_watch_subscription_free);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	error = bus_connection_pool_create(&created->connections);
+	if (error < 0) {
+		goto error_out;
+	}
+
+	if (event != NULL) {
+		error = bus_watch_event_attach(created, event);
+	} else {
+		error = -pthread_create(&created->thread, NULL, bus_watch_thread, created);
+	}
+	if (error < 0) {
+		goto error_out;
+	}
+
+	*watch = created;
+
+	return 0;
+
+error_out:
+	sd_event_source_unref(created->post_source);
+	sd_event_source_unref(created->timer_source);
+	sd_event_source_unref(created->wakeup_source);
+	sd_event_unref(created->event);
+	bus_connection_pool_destroy(created->connections);
+	hashmap_destroy(created->subscriptions);
+	hashmap_destroy(created->objects);
+	if (created->wakeup_fd >= 0) {
+		close(created->wakeup_fd);
+	}
+	pthread_mutex_destroy(&created->lock);
+	free(created);
+
+	return error;
+}
+
+void bus_watch_destroy(bus_watch_t *watch)
+{
+	if (watch == NULL) {
+		return;
+	}
+
+	if (watch->event != NULL) {
+		sd_event_source_unref(watch->post_source);
+		sd_event_source_unref(watch->timer_source);
+		sd_event_source_unref(watch->wakeup_source);
+		sd_event_unref(watch->event);
+	} else {
+		pthread_mutex_lock(&watch->lock);
+		watch->stop = true;
+		pthread_mutex_unlock(&watch->lock);
+
+		bus_watch_wakeup(watch);
+		pthread_join(watch->thread, NULL);
+	}
+
+	// the watcher thread is gone, its bus objects can be released from here
+	hashmap_destroy(watch->objects);
+	hashmap_destroy(watch->subscriptions);
+	bus_connection_pool_destroy(watch->connections);
+	close(watch->wakeup_fd);
+	free(watch->pending);
+	free(watch->pending_signals);
+	pthread_mutex_destroy(&watch->lock);
+	free(watch);
+}
+
+int bus_watch_set(bus_watch_t *watch, const bus_watch_key_t *keys, size_t keys_count)
+{
+	bus_watch_key_t *pending = NULL;
+
+	if (watch == NULL || (keys == NULL && keys_count > 0)) {
+		return -EINVAL;
+	}
+
+	pending = bus_watch_keys_copy(keys, keys_count);
+	if (pending == NULL) {
+		return -ENOMEM;
+	}
+
+	pthread_mutex_lock(&watch->lock);
+	// only the latest set matters, an earlier one not taken yet is dropped
+	free(watch->pending);
+	watch->pending = pending;
+	watch->pending_count = keys_count;
+	watch->pending_set = true;
+	pthread_mutex_unlock(&watch->lock);
+
+	bus_watch_wakeup(watch);
+
+	return 0;
+}
+
+int bus_watch_signals_set(bus_watch_t *watch, const bus_watch_signal_key_t *keys, size_t keys_count)
+{
+	bus_watch_signal_key_t *pending = NULL;
+
+	if (watch == NULL || (keys == NULL && keys_count > 0)) {
+		return -EINVAL;
+	}
+
+	pending = bus_watch_signal_keys_copy(keys, keys_count);
+	if (pending == NULL) {
+		return -ENOMEM;
+	}
+
+	pthread_mutex_lock(&watch->lock);
+	free(watch->pending_signals);
+	watch->pending_signals = pending;
+	watch->pending_signals_count = keys_count;
+	watch->pending_signals_set = true;
+	pthread_mutex_unlock(&watch->lock);
+
+	bus_watch_wakeup(watch);
+
+	return 0;
+}
+
+void bus_watch_foreach(bus_watch_t *watch, bus_watch_visit_cb visit, void *userdata)
+{
+	bus_watch_visit_t context = {.visit = visit, .userdata = userdata};
+
+	if (watch == NULL || visit == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&watch->lock);
+	hashmap_foreach(watch->objects, bus_watch_object_visit, &context);
+	pthread_mutex_unlock(&watch->lock);
+}
+
+static void *bus_watch_thread(void *arg)
+{
+	bus_watch_t *watch = (bus_watch_t *) arg;
+
+	while (bus_watch_step(watch)) {
+		bus_watch_wait(watch);
+	}
+
+	return NULL;
+}
+
+// takes the pending sets and brings the objects and subscriptions up to date, false once stopped
+static bool bus_watch_step(bus_watch_t *watch)
+{
+	bus_watch_key_t *keys = NULL;
+	size_t keys_count = 0;
+	bool changed = false;
+	bus_watch_signal_key_t *signal_keys = NULL;
+	size_t signal_keys_count = 0;
+	bool signals_changed = false;
+
+	pthread_mutex_lock(&watch->lock);
+	if (watch->stop) {
+		pthread_mutex_unlock(&watch->lock);
+		return false;
+	}
+	changed = watch->pending_set;
+	keys = watch->pending;
+	keys_count = watch->pending_count;
+	watch->pending = NULL;
+	watch->pending_count = 0;
+	watch->pending_set = false;
+	signals_changed = watch->pending_signals_set;
+	signal_keys = watch->pending_signals;
+	signal_keys_count = watch->pending_signals_count;
+	watch->pending_signals = NULL;
+	watch->pending_signals_count = 0;
+	watch->pending_signals_set = false;
+	pthread_mutex_unlock(&watch->lock);
+
+	if (changed) {
+		bus_watch_reconcile(watch, keys, keys_count);
+		free(keys);
+	}
+
+	if (signals_changed) {
+		bus_watch_signals_reconcile(watch, signal_keys, signal_keys_count);
+		free(signal_keys);
+	}
+
+	// subscribes objects on new connections and fetches the stale ones
+	watch->retry = false;
+	hashmap_foreach(watch->objects, bus_watch_object_sync, watch);
+	// installs the match rules on new connections and delivers coalesced signals that are due
+	hashmap_foreach(watch->subscriptions, bus_watch_subscription_sync, watch);
+
+	return true;
+}
+
+static void bus_watch_wakeup(bus_watch_t *watch)
+{
+	uint64_t value = 1;
+
+	if (write(watch->wakeup_fd, &value, sizeof(value)) < 0) {
+		// the counter is already non-zero, the thread wakes up anyway
+	}
+}
+
+static void bus_watch_wait(bus_watch_t *watch)
+{
+	bus_watch_buses_t buses = {0};
+	struct pollfd fds[BUS_CONNECTION_TYPE_COUNT + 1] = {0};
+	uint64_t timeout_usec = UINT64_MAX;
+	uint64_t until_usec = 0;
+	uint64_t value = 0;
+	int timeout_ms = -1;
+	int error = 0;
+
+	hashmap_foreach(watch->objects, bus_watch_object_bus_collect, &buses);
+	hashmap_foreach(watch->subscriptions, bus_watch_subscription_bus_collect, &buses);
+
+	for (size_t i = 0; i < buses.count; i++) {
+		while ((error = sd_bus_process(buses.bus[i], NULL)) > 0)
+			;
+
+		// the connection is gone, it is replaced on the next pass
+		if (error < 0) {
+			watch->retry = true;
+		}
+	}
+
+	// a signal asked for properties to be fetched again
+	if (watch->refetch) {
+		watch->refetch = false;
+		return;
+	}
+
+	fds[0].fd = watch->wakeup_fd;
+	fds[0].events = POLLIN;
+
+	for (size_t i = 0; i < buses.count; i++) {
+		int fd = sd_bus_get_fd(buses.bus[i]);
+		int events = sd_bus_get_events(buses.bus[i]);
+
+		// closed connections are ignored by poll()
+		fds[i + 1].fd = (fd < 0 || events < 0) ? -1 : fd;
+		fds[i + 1].events = (short) ((events < 0) ? 0 : events);
+
+		if (sd_bus_get_timeout(buses.bus[i], &until_usec) > 0 && until_usec != UINT64_MAX) {
+			uint64_t now_usec = bus_watch_now();
+
+			if (until_usec <= now_usec) {
+				timeout_usec = 0;
+			} else if (until_usec - now_usec < timeout_usec) {
+				timeout_usec = until_usec - now_usec;
+			}
+		}
+	}
+
+	until_usec = bus_watch_deadline(watch);
+	if (until_usec != UINT64_MAX) {
+		uint64_t now_usec = bus_watch_now();
+
+		if (until_usec <= now_usec) {
+			timeout_usec = 0;
+		} else if (until_usec - now_usec < timeout_usec) {
+			timeout_usec = until_usec - now_usec;
+		}
+	}
+
+	if (timeout_usec != UINT64_MAX) {
+		timeout_ms = (timeout_usec / 1000 >= INT_MAX) ? INT_MAX : (int) ((timeout_usec + 999) / 1000);
+	}
+
+	if (poll(fds, (nfds_t) buses.count + 1, timeout_ms) > 0 && (fds[0].revents & POLLIN)) {
+		if (read(watch->wakeup_fd, &value, sizeof(value)) < 0) {
+			// drained by someone else, nothing to do
+		}
+	}
+}
+
+// when the first coalescing window closes or failed connections are tried again, UINT64_MAX if never
+static uint64_t bus_watch_deadline(bus_watch_t *watch)
+{
+	uint64_t until_usec = UINT64_MAX;
+	uint64_t retry_usec = 0;
+
+	hashmap_foreach(watch->subscriptions, bus_watch_subscription_deadline, &until_usec);
+
+	if (watch->retry) {
+		retry_usec = bus_watch_now() + BUS_WATCH_RETRY_MSEC * 1000ULL;
+		if (retry_usec < until_usec) {
+			until_usec = retry_usec;
+		}
+	}
+
+	return until_usec;
+}
+
+// the event loop dispatches the bus connections, every dispatch is followed by a step
+static int bus_watch_event_attach(bus_watch_t *watch, sd_event *event)
+{
+	int error = 0;
+
+	watch->event = sd_event_ref(event);
+
+	error = bus_connection_pool_attach_event(watch->connections, event);
+	if (error < 0) {
+		return error;
+	}
+
+	error = sd_event_add_io(event, &watch->wakeup_source, watch->wakeup_fd, EPOLLIN, bus_watch_wakeup_cb, watch);
+	if (error < 0) {
+		return error;
+	}
+
+	// armed by the post source for the next deadline
+	error = sd_event_add_time(event, &watch->timer_source, CLOCK_MONOTONIC, 0, BUS_WATCH_TIMER_ACCURACY_USEC, bus_watch_timer_cb, watch);
+	if (error < 0) {
+		return error;
+	}
+
+	error = sd_event_source_set_enabled(watch->timer_source, SD_EVENT_OFF);
+	if (error < 0) {
+		return error;
+	}
+
+	return sd_event_add_post(event, &watch->post_source, bus_watch_post_cb, watch);
+}
+
+static int bus_watch_wakeup_cb(sd_event_source *source, int fd, uint32_t revents, void *userdata)
+{
+	uint64_t value = 0;
+
+	if (read(fd, &value, sizeof(value)) < 0) {
+		// drained already, the post source runs anyway
+	}
+
+	return 0;
+}
+
+static int bus_watch_timer_cb(sd_event_source *source, uint64_t usec, void *userdata)
+{
+	// the step itself is run by the post source
+	return 0;
+}
+
+static int bus_watch_post_cb(sd_event_source *source, void *userdata)
+{
+	bus_watch_t *watch = (bus_watch_t *) userdata;
+	uint64_t until_usec = 0;
+
+	watch->refetch = false;
+	bus_watch_step(watch);
+
+	// a signal dispatched during the step asked for another fetch
+	until_usec = watch->refetch ? 0 : bus_watch_deadline(watch);
+	if (until_usec == UINT64_MAX) {
+		return sd_event_source_set_enabled(watch->timer_source, SD_EVENT_OFF);
+	}
+
+	sd_event_source_set_time(watch->timer_source, until_usec);
+
+	return sd_event_source_set_enabled(watch->timer_source, SD_EVENT_ONESHOT);
+}
+
+static uint64_t bus_watch_now(void)
+{
+	struct timespec ts = {0};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void bus_watch_reconcile(bus_watch_t *watch, const bus_watch_key_t *keys, size_t keys_count)
+{
+	int error = 0;
+	char *id = NULL;
+	size_t id_size = 0;
+	bus_watch_object_t *object = NULL;
+
+	hashmap_foreach(watch->objects, bus_watch_object_unmark, NULL);
+
+	for (size_t i = 0; i < keys_count; i++) {
+		error = bus_watch_id_build(&keys[i], &id, &id_size);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to watch %s: %s", keys[i].object_path, strerror(-error));
+			continue;
+		}
+
+		object = hashmap_get(watch->objects, id, id_size);
+		if (object != NULL) {
+			object->wanted = true;
+			free(id);
+			continue;
+		}
+
+		object = calloc(1, sizeof(bus_watch_object_t));
+		if (object == NULL) {
+			SRP_LOG_ERR("failed to watch %s: %s", keys[i].object_path, strerror(ENOMEM));
+			free(id);
+			continue;
+		}
+
+		object->watch = watch;
+		object->id = id;
+		object->id_size = id_size;
+		object->key.bus_type = keys[i].bus_type;
+		object->key.service = id + 1;
+		object->key.object_path = object->key.service + strlen(object->key.service) + 1;
+		object->key.interface = object->key.object_path + strlen(object->key.object_path) + 1;
+		object->wanted = true;
+
+		pthread_mutex_lock(&watch->lock);
+		error = hashmap_insert(watch->objects, id, id_size, object);
+		pthread_mutex_unlock(&watch->lock);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to watch %s: %s", keys[i].object_path, strerror(-error));
+			bus_watch_object_free(object);
+		}
+	}
+
+	pthread_mutex_lock(&watch->lock);
+	hashmap_foreach(watch->objects, bus_watch_object_unwanted, NULL);
+	pthread_mutex_unlock(&watch->lock);
+}
+
+static void bus_watch_signals_reconcile(bus_watch_t *watch, const bus_watch_signal_key_t *keys, size_t keys_count)
+{
+	int error = 0;
+	char *rule = NULL;
+	bus_watch_subscription_t *subscription = NULL;
+
+	hashmap_foreach(watch->subscriptions, bus_watch_subscription_unmark, NULL);
+
+	for (size_t i = 0; i < keys_count; i++) {
+		error = bus_watch_rule_build(&keys[i], &rule);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to subscribe %s: %s", keys[i].name, strerror(-error));
+			continue;
+		}
+
+		// an unchanged rule keeps its match and the signals collected so far
+		subscription = hashmap_get(watch->subscriptions, keys[i].name, strlen(keys[i].name) + 1);
+		if (subscription != NULL && subscription->bus_type == keys[i].bus_type && strcmp(subscription->rule, rule) == 0) {
+			subscription->coalesce_usec = keys[i].coalesce_usec;
+			subscription->wanted = true;
+			free(rule);
+			continue;
+		}
+
+		subscription = calloc(1, sizeof(bus_watch_subscription_t));
+		if (subscription == NULL || (subscription->name = strdup(keys[i].name)) == NULL) {
+			SRP_LOG_ERR("failed to subscribe %s: %s", keys[i].name, strerror(ENOMEM));
+			free(subscription);
+			free(rule);
+			continue;
+		}
+
+		subscription->watch = watch;
+		subscription->bus_type = keys[i].bus_type;
+		subscription->rule = rule;
+		subscription->coalesce_usec = keys[i].coalesce_usec;
+		subscription->wanted = true;
+
+		// replaces a subscription of the same name with a different rule
+		error = hashmap_insert(watch->subscriptions, keys[i].name, strlen(keys[i].name) + 1, subscription);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to subscribe %s: %s", keys[i].name, strerror(-error));
+			bus_watch_subscription_free(subscription);
+		}
+	}
+
+	hashmap_foreach(watch->subscriptions, bus_watch_subscription_unwanted, NULL);
+}
+
+static bus_watch_signal_key_t *bus_watch_signal_keys_copy(const bus_watch_signal_key_t *keys, size_t keys_count)
+{
+	size_t size = keys_count * sizeof(bus_watch_signal_key_t);
+	bus_watch_signal_key_t *copy = NULL;
+	char *strings = NULL;
+
+	for (size_t i = 0; i < keys_count; i++) {
+		const char *fields[] = {keys[i].name, keys[i].sender, keys[i].object_path, keys[i].interface, keys[i].member, keys[i].arg0};
+
+		for (size_t j = 0; j < sizeof(fields) / sizeof(fields[0]); j++) {
+			size += (fields[j] != NULL) ? strlen(fields[j]) + 1 : 0;
+		}
+	}
+
+	// the keys and their strings share a single allocation
+	copy = malloc(size ? size : 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	strings = (char *) (copy + keys_count);
+	for (size_t i = 0; i < keys_count; i++) {
+		const char *fields[] = {keys[i].name, keys[i].sender, keys[i].object_path, keys[i].interface, keys[i].member, keys[i].arg0};
+		const char **copied[] = {&copy[i].name, &copy[i].sender, &copy[i].object_path, &copy[i].interface, &copy[i].member, &copy[i].arg0};
+
+		copy[i].bus_type = keys[i].bus_type;
+		copy[i].coalesce_usec = keys[i].coalesce_usec;
+		for (size_t j = 0; j < sizeof(fields) / sizeof(fields[0]); j++) {
+			*copied[j] = NULL;
+			if (fields[j] != NULL) {
+				*copied[j] = strings;
+				strings = stpcpy(strings, fields[j]) + 1;
+			}
+		}
+	}
+
+	return copy;
+}
+
+static int bus_watch_rule_build(const bus_watch_signal_key_t *key, char **rule)
+{
+	const char *names[] = {"sender", "path", "interface", "member", "arg0"};
+	const char *values[] = {key->sender, key->object_path, key->interface, key->member, key->arg0};
+	size_t size = sizeof("type='signal'");
+	char *position = NULL;
+
+	if (key->name == NULL) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (values[i] == NULL) {
+			continue;
+		}
+
+		// values are quoted, a quote inside one would end the rule early
+		if (strchr(values[i], '\'') != NULL) {
+			return -EINVAL;
+		}
+
+		size += strlen(",='") + strlen(names[i]) + strlen(values[i]) + 1;
+	}
+
+	*rule = malloc(size);
+	if (*rule == NULL) {
+		return -ENOMEM;
+	}
+
+	position = stpcpy(*rule, "type='signal'");
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (values[i] == NULL) {
+			continue;
+		}
+
+		position = stpcpy(position, ",");
+		position = stpcpy(position, names[i]);
+		position = stpcpy(position, "='");
+		position = stpcpy(position, values[i]);
+		position = stpcpy(position, "'");
+	}
+
+	return 0;
+}
+
+static bus_watch_key_t *bus_watch_keys_copy(const bus_watch_key_t *keys, size_t keys_count)
+{
+	size_t size = keys_count * sizeof(bus_watch_key_t);
+	bus_watch_key_t *copy = NULL;
+	char *strings = NULL;
+
+	for (size_t i = 0; i < keys_count; i++) {
+		size += strlen(keys[i].service) + strlen(keys[i].object_path) + strlen(keys[i].interface) + 3;
+	}
+
+	// the keys and their strings share a single allocation
+	copy = malloc(size ? size : 1);
+	if (copy == NULL) {
+		return NULL;
+	}
+
+	strings = (char *) (copy + keys_count);
+	for (size_t i = 0; i < keys_count; i++) {
+		copy[i].bus_type = keys[i].bus_type;
+		copy[i].service = strings;
+		strings = stpcpy(strings, keys[i].service) + 1;
+		copy[i].object_path = strings;
+		strings = stpcpy(strings, keys[i].object_path) + 1;
+		copy[i].interface = strings;
+		strings = stpcpy(strings, keys[i].interface) + 1;
+	}
+
+	return copy;
+}
+
+static int bus_watch_id_build(const bus_watch_key_t *key, char **id, size_t *id_size)
+{
+	const char *strings[] = {key->service, key->object_path, key->interface};
+	size_t size = 1;
+	char *position = NULL;
+
+	if (key->service == NULL || key->object_path == NULL || key->interface == NULL) {
+		return -EINVAL;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		size += strlen(strings[i]) + 1;
+	}
+
+	*id = malloc(size);
+	if (*id == NULL) {
+		return -ENOMEM;
+	}
+
+	position = *id;
+	*position++ = (char) key->bus_type;
+	for (size_t i = 0; i < 3; i++) {
+		position = stpcpy(position, strings[i]) + 1;
+	}
+	*id_size = size;
+
+	return 0;
+}
+
+static bool bus_watch_object_sync(const void *key, size_t key_size, void *value, void *userdata)
+{
+	int error = 0;
+	bus_watch_t *watch = (bus_watch_t *) userdata;
+	bus_watch_object_t *object = (bus_watch_object_t *) value;
+	sd_bus *bus = NULL;
+
+	error = bus_connection_get(watch->connections, object->key.bus_type, NULL, &bus);
+	if (error < 0) {
+		watch->retry = true;
+		return false;
+	}
+
+	// the connection is new, matches of the previous one went away with it
+	if (bus != object->bus) {
+		error = bus_watch_object_subscribe(object, bus);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to watch %s: %s", object->key.object_path, strerror(-error));
+			watch->retry = true;
+			return false;
+		}
+	}
+
+	if (object->stale) {
+		bus_watch_object_fetch(object);
+	}
+
+	return false;
+}
+
+static bool bus_watch_object_unmark(const void *key, size_t key_size, void *value, void *userdata)
+{
+	((bus_watch_object_t *) value)->wanted = false;
+
+	return false;
+}
+
+static bool bus_watch_object_unwanted(const void *key, size_t key_size, void *value, void *userdata)
+{
+	return !((bus_watch_object_t *) value)->wanted;
+}
+
+static bool bus_watch_object_bus_collect(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_buses_add((bus_watch_buses_t *) userdata, ((bus_watch_object_t *) value)->bus);
+
+	return false;
+}
+
+static bool bus_watch_subscription_sync(const void *key, size_t key_size, void *value, void *userdata)
+{
+	int error = 0;
+	bus_watch_t *watch = (bus_watch_t *) userdata;
+	bus_watch_subscription_t *subscription = (bus_watch_subscription_t *) value;
+	sd_bus *bus = NULL;
+
+	error = bus_connection_get(watch->connections, subscription->bus_type, NULL, &bus);
+	if (error < 0) {
+		watch->retry = true;
+	} else if (bus != subscription->bus) {
+		subscription->slot = sd_bus_slot_unref(subscription->slot);
+		subscription->bus = sd_bus_unref(subscription->bus);
+
+		error = sd_bus_add_match_async(bus, &subscription->slot, subscription->rule, bus_watch_signal_received_cb, NULL, subscription);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to subscribe %s: %s", subscription->name, strerror(-error));
+			watch->retry = true;
+		} else {
+			subscription->bus = sd_bus_ref(bus);
+		}
+	}
+
+	if (subscription->signals_count > 0 && bus_watch_now() >= subscription->deadline_usec) {
+		bus_watch_subscription_flush(subscription);
+	}
+
+	return false;
+}
+
+static bool bus_watch_subscription_unmark(const void *key, size_t key_size, void *value, void *userdata)
+{
+	((bus_watch_subscription_t *) value)->wanted = false;
+
+	return false;
+}
+
+static bool bus_watch_subscription_unwanted(const void *key, size_t key_size, void *value, void *userdata)
+{
+	return !((bus_watch_subscription_t *) value)->wanted;
+}
+
+static bool bus_watch_subscription_bus_collect(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_buses_add((bus_watch_buses_t *) userdata, ((bus_watch_subscription_t *) value)->bus);
+
+	return false;
+}
+
+static bool bus_watch_subscription_deadline(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_subscription_t *subscription = (bus_watch_subscription_t *) value;
+	uint64_t *deadline_usec = (uint64_t *) userdata;
+
+	if (subscription->signals_count > 0 && subscription->deadline_usec < *deadline_usec) {
+		*deadline_usec = subscription->deadline_usec;
+	}
+
+	return false;
+}
+
+static void bus_watch_buses_add(bus_watch_buses_t *buses, sd_bus *bus)
+{
+	size_t i = 0;
+
+	if (bus == NULL) {
+		return;
+	}
+
+	for (i = 0; i < buses->count && buses->bus[i] != bus; i++)
+		;
+	if (i == buses->count && buses->count < BUS_CONNECTION_TYPE_COUNT) {
+		buses->bus[buses->count++] = bus;
+	}
+}
+
+static bool bus_watch_object_visit(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_visit_t *context = (bus_watch_visit_t *) userdata;
+	bus_watch_object_t *object = (bus_watch_object_t *) value;
+
+	context->visit(&object->key, object->synchronized, NULL, NULL, NULL, context->userdata);
+
+	context->object = object;
+	hashmap_foreach(object->properties, bus_watch_property_visit, context);
+
+	return false;
+}
+
+static bool bus_watch_property_visit(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_visit_t *context = (bus_watch_visit_t *) userdata;
+	bus_watch_property_t *property = (bus_watch_property_t *) value;
+
+	// property names are stored with their terminator
+	context->visit(&context->object->key, context->object->synchronized, (const char *) key,
+				   property->signature, property->value, context->userdata);
+
+	return false;
+}
+
+static bool bus_watch_property_move(const void *key, size_t key_size, void *value, void *userdata)
+{
+	hashmap_t *properties = (hashmap_t *) userdata;
+
+	// a value that cannot be stored is dropped, the next fetch restores it
+	if (hashmap_insert(properties, key, key_size, value) < 0) {
+		bus_watch_property_free(value);
+	}
+
+	return true;
+}
+
+static bool bus_watch_property_drop(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_watch_property_free(value);
+
+	return true;
+}
+
+static int bus_watch_object_subscribe(bus_watch_object_t *object, sd_bus *bus)
+{
+	int error = 0;
+	char *rule = NULL;
+	int rule_size = 0;
+
+	object->properties_changed = sd_bus_slot_unref(object->properties_changed);
+	object->name_owner_changed = sd_bus_slot_unref(object->name_owner_changed);
+	object->fetch = sd_bus_slot_unref(object->fetch);
+	object->bus = sd_bus_unref(object->bus);
+
+	rule_size = snprintf(NULL, 0, BUS_WATCH_RULE_PROPERTIES_CHANGED, object->key.service, object->key.object_path, object->key.interface) + 1;
+	rule = malloc((size_t) rule_size);
+	if (rule == NULL) {
+		return -ENOMEM;
+	}
+	snprintf(rule, (size_t) rule_size, BUS_WATCH_RULE_PROPERTIES_CHANGED, object->key.service, object->key.object_path, object->key.interface);
+
+	error = sd_bus_add_match_async(bus, &object->properties_changed, rule, bus_watch_properties_changed_cb, NULL, object);
+	free(rule);
+	if (error < 0) {
+		return error;
+	}
+
+	rule_size = snprintf(NULL, 0, BUS_WATCH_RULE_NAME_OWNER_CHANGED, object->key.service) + 1;
+	rule = malloc((size_t) rule_size);
+	if (rule == NULL) {
+		return -ENOMEM;
+	}
+	snprintf(rule, (size_t) rule_size, BUS_WATCH_RULE_NAME_OWNER_CHANGED, object->key.service);
+
+	error = sd_bus_add_match_async(bus, &object->name_owner_changed, rule, bus_watch_name_owner_changed_cb, NULL, object);
+	free(rule);
+	if (error < 0) {
+		object->properties_changed = sd_bus_slot_unref(object->properties_changed);
+		return error;
+	}
+
+	// the matches are sent before GetAll, so no change between the two is lost
+	object->bus = sd_bus_ref(bus);
+	object->stale = true;
+
+	return 0;
+}
+
+static void bus_watch_object_fetch(bus_watch_object_t *object)
+{
+	int error = 0;
+
+	object->stale = false;
+
+	// the reply is applied by bus_watch_object_fetch_cb(), the watcher keeps serving everything else meanwhile
+	object->fetch = sd_bus_slot_unref(object->fetch);
+	error = sd_bus_call_method_async(object->bus, &object->fetch, object->key.service, object->key.object_path,
+									 BUS_WATCH_PROPERTIES_INTERFACE, "GetAll", bus_watch_object_fetch_cb, object,
+									 "s", object->key.interface);
+	if (error < 0) {
+		SRP_LOG_WRN("failed to fetch properties of %s: %s", object->key.object_path, strerror(-error));
+		bus_watch_object_fetched(object, NULL);
+	}
+}
+
+static void bus_watch_object_fetched(bus_watch_object_t *object, hashmap_t *properties)
+{
+	pthread_mutex_lock(&object->watch->lock);
+	hashmap_destroy(object->properties);
+	object->properties = properties;
+	object->synchronized = (properties != NULL);
+	pthread_mutex_unlock(&object->watch->lock);
+}
+
+static int bus_watch_object_fetch_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	int error = 0;
+	bus_watch_object_t *object = (bus_watch_object_t *) userdata;
+	const sd_bus_error *bus_error = sd_bus_message_get_error(m);
+	hashmap_t *properties = NULL;
+
+	object->fetch = sd_bus_slot_unref(object->fetch);
+
+	error = (bus_error != NULL) ? -sd_bus_error_get_errno(bus_error) : hashmap_create(&properties, bus_watch_property_free);
+	if (error >= 0) {
+		error = bus_watch_properties_read(m, properties);
+	}
+	if (error < 0) {
+		// the service may not be running yet, its arrival triggers another fetch
+		SRP_LOG_WRN("failed to fetch properties of %s: %s", object->key.object_path,
+					(bus_error != NULL && bus_error->message != NULL) ? bus_error->message : strerror(-error));
+		hashmap_destroy(properties);
+		properties = NULL;
+	}
+
+	bus_watch_object_fetched(object, properties);
+
+	return 0;
+}
+
+static void bus_watch_object_free(void *object)
+{
+	bus_watch_object_t *watched = (bus_watch_object_t *) object;
+
+	if (watched == NULL) {
+		return;
+	}
+
+	sd_bus_slot_unref(watched->properties_changed);
+	sd_bus_slot_unref(watched->name_owner_changed);
+	sd_bus_slot_unref(watched->fetch);
+	sd_bus_unref(watched->bus);
+	hashmap_destroy(watched->properties);
+	free(watched->id);
+	free(watched);
+}
+
+static int bus_watch_properties_read(sd_bus_message *m, hashmap_t *properties)
+{
+	int error = 0;
+	const char *name = NULL;
+	const char *contents = NULL;
+	bus_watch_property_t *property = NULL;
+
+	error = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "{sv}");
+	if (error < 0) {
+		return error;
+	}
+
+	while ((error = sd_bus_message_enter_container(m, SD_BUS_TYPE_DICT_ENTRY, "sv")) > 0) {
+		error = sd_bus_message_read_basic(m, SD_BUS_TYPE_STRING, &name);
+		if (error < 0) {
+			return error;
+		}
+
+		error = sd_bus_message_peek_type(m, NULL, &contents);
+		if (error < 0) {
+			return error;
+		}
+
+		property = calloc(1, sizeof(bus_watch_property_t));
+		if (property == NULL) {
+			return -ENOMEM;
+		}
+
+		property->signature = strdup(contents);
+		error = (property->signature == NULL) ? -ENOMEM : sd_bus_message_enter_container(m, SD_BUS_TYPE_VARIANT, contents);
+		if (error >= 0) {
+			error = bus_message_decode_type_format(m, contents, BUS_DECODE_FORMAT_BUSCTL, BUS_BYTES_FORMAT_ARRAY, &property->value);
+		}
+		if (error >= 0) {
+			error = sd_bus_message_exit_container(m);
+		}
+		if (error >= 0) {
+			error = hashmap_insert(properties, name, strlen(name) + 1, property);
+		}
+		if (error < 0) {
+			bus_watch_property_free(property);
+			return error;
+		}
+
+		error = sd_bus_message_exit_container(m);
+		if (error < 0) {
+			return error;
+		}
+	}
+	if (error < 0) {
+		return error;
+	}
+
+	return sd_bus_message_exit_container(m);
+}
+
+static void bus_watch_property_free(void *property)
+{
+	bus_watch_property_t *watched = (bus_watch_property_t *) property;
+
+	if (watched == NULL) {
+		return;
+	}
+
+	free(watched->signature);
+	free(watched->value);
+	free(watched);
+}
+
+static int bus_watch_properties_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	int error = 0;
+	bus_watch_object_t *object = (bus_watch_object_t *) userdata;
+	const char *interface = NULL;
+	hashmap_t *changed = NULL;
+
+	// changes are collected without a value free callback so that they can be moved
+	error = hashmap_create(&changed, NULL);
+	if (error == 0) {
+		error = sd_bus_message_read_basic(m, SD_BUS_TYPE_STRING, &interface);
+	}
+	if (error >= 0) {
+		error = bus_watch_properties_read(m, changed);
+	}
+	if (error >= 0) {
+		error = sd_bus_message_enter_container(m, SD_BUS_TYPE_ARRAY, "s");
+	}
+	if (error >= 0 && sd_bus_message_at_end(m, false) == 0) {
+		// invalidated properties come without their value
+		error = -ENODATA;
+	}
+
+	if (error < 0) {
+		object->stale = true;
+		object->watch->refetch = true;
+	} else {
+		pthread_mutex_lock(&object->watch->lock);
+		// an object that is not synchronized is about to be fetched as a whole
+		if (object->synchronized) {
+			hashmap_foreach(changed, bus_watch_property_move, object->properties);
+		}
+		pthread_mutex_unlock(&object->watch->lock);
+	}
+
+	hashmap_foreach(changed, bus_watch_property_drop, NULL);
+	hashmap_destroy(changed);
+
+	return 0;
+}
+
+static int bus_watch_name_owner_changed_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	bus_watch_object_t *object = (bus_watch_object_t *) userdata;
+	const char *name = NULL;
+	const char *old_owner = NULL;
+	const char *new_owner = NULL;
+	hashmap_t *properties = NULL;
+
+	if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) < 0) {
+		return 0;
+	}
+
+	// a new instance of the service may have different values
+	if (new_owner[0] != '\0') {
+		object->stale = true;
+		object->watch->refetch = true;
+		return 0;
+	}
+
+	// the service went away and its properties with it
+	pthread_mutex_lock(&object->watch->lock);
+	properties = object->properties;
+	object->properties = NULL;
+	object->synchronized = false;
+	pthread_mutex_unlock(&object->watch->lock);
+
+	hashmap_destroy(properties);
+
+	return 0;
+}
+
+static void bus_watch_subscription_flush(bus_watch_subscription_t *subscription)
+{
+	bus_watch_t *watch = subscription->watch;
+
+	if (watch->signal_cb != NULL) {
+		watch->signal_cb(subscription->name, subscription->signals, subscription->signals_count, watch->userdata);
+	}
+
+	for (size_t i = 0; i < subscription->signals_count; i++) {
+		bus_watch_signal_release(&subscription->signals[i]);
+	}
+	subscription->signals_count = 0;
+}
+
+static void bus_watch_subscription_free(void *subscription)
+{
+	bus_watch_subscription_t *subscribed = (bus_watch_subscription_t *) subscription;
+
+	if (subscribed == NULL) {
+		return;
+	}
+
+	// signals still waiting for their window are dropped with the subscription
+	for (size_t i = 0; i < subscribed->signals_count; i++) {
+		bus_watch_signal_release(&subscribed->signals[i]);
+	}
+	free(subscribed->signals);
+	sd_bus_slot_unref(subscribed->slot);
+	sd_bus_unref(subscribed->bus);
+	free(subscribed->rule);
+	free(subscribed->name);
+	free(subscribed);
+}
+
+static void bus_watch_signal_release(bus_watch_signal_t *signal)
+{
+	free(signal->sender);
+	free(signal->object_path);
+	free(signal->interface);
+	free(signal->member);
+	free(signal->signature);
+	free(signal->response);
+	memset(signal, 0, sizeof(bus_watch_signal_t));
+}
+
+static int bus_watch_signal_received_cb(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	int error = 0;
+	bus_watch_subscription_t *subscription = (bus_watch_subscription_t *) userdata;
+	const char *fields[] = {sd_bus_message_get_sender(m), sd_bus_message_get_path(m), sd_bus_message_get_interface(m),
+							sd_bus_message_get_member(m), sd_bus_message_get_signature(m, true)};
+	bus_watch_signal_t signal = {0};
+	char **copied[] = {&signal.sender, &signal.object_path, &signal.interface, &signal.member, &signal.signature};
+	void *tmp = NULL;
+
+	for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]) && error == 0; i++) {
+		if (fields[i] != NULL && (*copied[i] = strdup(fields[i])) == NULL) {
+			error = -ENOMEM;
+		}
+	}
+	if (error == 0) {
+		error = bus_message_decode(m, &signal.response);
+	}
+	if (error >= 0 && subscription->signals_count == subscription->signals_size) {
+		tmp = realloc(subscription->signals, sizeof(bus_watch_signal_t) * (subscription->signals_size ? subscription->signals_size * 2 : 1));
+		if (tmp == NULL) {
+			error = -ENOMEM;
+		} else {
+			subscription->signals = tmp;
+			subscription->signals_size = subscription->signals_size ? subscription->signals_size * 2 : 1;
+		}
+	}
+	if (error < 0) {
+		SRP_LOG_WRN("dropped a signal of %s: %s", subscription->name, strerror(-error));
+		bus_watch_signal_release(&signal);
+		return 0;
+	}
+
+	subscription->signals[subscription->signals_count++] = signal;
+	// the window opens with the first signal, later ones do not extend it
+	if (subscription->signals_count == 1) {
+		subscription->deadline_usec = bus_watch_now() + subscription->coalesce_usec;
+	}
+
+	if (subscription->coalesce_usec == 0 || subscription->signals_count >= BUS_WATCH_SIGNALS_MAX) {
+		bus_watch_subscription_flush(subscription);
+	}
+
+	return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file bus-watch.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for mirroring the properties of watched sd-bus objects
+ *        and for subscribing to sd-bus signals
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _BUS_WATCH_H_
+#define _BUS_WATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <systemd/sd-event.h>
+
+#include "bus-connection.h"
+
+typedef struct bus_watch_s bus_watch_t;
+
+// interface of an sd-bus object whose properties are mirrored
+typedef struct bus_watch_key_s {
+	bus_connection_type_t bus_type;
+	const char *service;
+	const char *object_path;
+	const char *interface;
+} bus_watch_key_t;
+
+// called with the cache locked, once per watched object with a NULL name
+// and then once per property of the object
+typedef void (*bus_watch_visit_cb)(const bus_watch_key_t *key, bool synchronized, const char *name,
+								   const char *signature, const char *value, void *userdata);
+
+// match rule of a signal subscription, NULL strings match anything
+typedef struct bus_watch_signal_key_s {
+	const char *name;
+	bus_connection_type_t bus_type;
+	const char *sender;
+	const char *object_path;
+	const char *interface;
+	const char *member;
+	const char *arg0;
+	// signals arriving within this long of the first one are delivered together, 0 delivers every signal on its own
+	uint64_t coalesce_usec;
+} bus_watch_signal_key_t;
+
+// a received signal, its arguments decoded in busctl format
+typedef struct bus_watch_signal_s {
+	char *sender;
+	char *object_path;
+	char *interface;
+	char *member;
+	char *signature;
+	char *response;
+} bus_watch_signal_t;
+
+// called on the watcher thread, or on the event loop of the watcher, with the signals of a subscription in the order they arrived
+typedef void (*bus_watch_signal_cb)(const char *name, const bus_watch_signal_t *signals, size_t signals_count, void *userdata);
+
+// with an event loop the watcher is run by that loop on its thread instead of starting a thread of its own
+int bus_watch_create(bus_watch_t **watch, sd_event *event, bus_watch_signal_cb signal_cb, void *userdata);
+void bus_watch_destroy(bus_watch_t *watch);
+
+int bus_watch_set(bus_watch_t *watch, const bus_watch_key_t *keys, size_t keys_count);
+void bus_watch_foreach(bus_watch_t *watch, bus_watch_visit_cb visit, void *userdata);
+
+int bus_watch_signals_set(bus_watch_t *watch, const bus_watch_signal_key_t *keys, size_t keys_count);
+
+#endif //_BUS_WATCH_H_
@@ -24,7 +24,9 @@
  */
 
 /*=========================Includes===========================================*/
+#include <errno.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -35,197 +37,1904 @@
 #include <sysrepo.h>
 #include <systemd/sd-bus.h>
 #include <systemd/sd-bus-protocol.h>
+#include <systemd/sd-event.h>
 
+#include "bus-cache.h"
+#include "bus-flight.h"
+#include "bus-metrics.h"
+#include "bus-offload.h"
+#include "bus-trace.h"
+#include "bus-call.h"
+#include "bus-connection.h"
+#include "bus-properties.h"
+#include "bus-watch.h"
+#include "signature-sd-bus.h"
 #include "transform-sd-bus.h"
+#include "worker-pool.h"
 
 #define YANG_MODEL "generic-sd-bus"
 
+#define RPC_SD_BUS_CALL_PATH "/" YANG_MODEL ":sd-bus-call"
+#define RPC_SD_BUS_PROPERTIES_PATH "/" YANG_MODEL ":sd-bus-properties"
+#define RPC_SD_BUS_MESSAGE "sd-bus-message"
+#define RPC_SD_BUS_PROPERTY "sd-bus-property"
+#define RPC_SD_BUS_PIPELINED "sd-bus-pipelined"
+#define RPC_SD_BUS_MAX_IN_FLIGHT "sd-bus-max-in-flight"
+#define RPC_SD_BUS_MAX_IN_FLIGHT_DEFAULT 16
+#define RPC_SD_BUS_RPC_TIMEOUT "sd-bus-rpc-timeout"
+#define RPC_SD_BUS_THREADED "sd-bus-threaded"
+#define RPC_SD_BUS_RESPONSE_FORMAT "sd-bus-response-format"
+#define RPC_SD_BUS_ARGUMENTS_FORMAT "sd-bus-arguments-format"
+#define RPC_SD_BUS_ARGUMENTS_FORMAT_JSON "json"
+#define RPC_SD_BUS_RESPONSE_FORMAT_TYPED "typed"
+#define RPC_SD_BUS_BYTE_ARRAY_FORMAT "sd-bus-byte-array-format"
+#define RPC_SD_BUS_BYTE_ARRAY_FORMAT_BASE64 "base64"
+#define RPC_SD_BUS_BYTE_ARRAY_FORMAT_HEX "hex"
+
 #define RPC_SD_BUS "sd-bus"
+#define RPC_SD_BUS_ADDRESS "sd-bus-address"
 #define RPC_SD_BUS_SERVICE "sd-bus-service"
 #define RPC_SD_BUS_OBJPATH "sd-bus-object-path"
 #define RPC_SD_BUS_INTERFACE "sd-bus-interface"
 #define RPC_SD_BUS_METHOD "sd-bus-method"
 #define RPC_SD_BUS_SIGNATURE "sd-bus-method-signature"
 #define RPC_SD_BUS_ARGUMENTS "sd-bus-method-arguments"
+#define RPC_SD_BUS_TIMEOUT "sd-bus-timeout"
+#define RPC_SD_BUS_SINGLE_FLIGHT "sd-bus-single-flight"
+#define RPC_SD_BUS_PROPERTY_NAME "sd-bus-property-name"
+#define RPC_SD_BUS_PROPERTY_VALUE "sd-bus-property-value"
+
+#define USEC_PER_MSEC 1000ULL
+#define USEC_PER_SEC 1000000ULL
+
+#define RPC_SD_BUS_RESULT "sd-bus-result"
+#define RPC_SD_BUS_PROPERTY_RESULT "sd-bus-property-result"
+#define RPC_SD_BUS_INDEX "sd-bus-index"
+#define RPC_SD_BUS_RESULT_XPATH "%s[sd-bus-index='%zu']/%s"
+#define RPC_SD_BUS_RESULT_XPATH_SIZE 256
+#define RPC_SD_BUS_STATUS "sd-bus-status"
+#define RPC_SD_BUS_STATUS_OK "ok"
+#define RPC_SD_BUS_STATUS_ERROR "error"
+#define RPC_SD_BUS_ERROR_NAME "sd-bus-error-name"
+#define RPC_SD_BUS_ERROR_MESSAGE "sd-bus-error-message"
+#define RPC_SD_BUS_RESPONSE "sd-bus-response"
+#define RPC_SD_BUS_DATA "sd-bus-data"
+#define RPC_SD_BUS_REPLY_SIGNATURE "sd-bus-signature"
+#define RPC_SD_BUS_RESPONSE_HANDLE "sd-bus-response-handle"
+#define RPC_SD_BUS_RESPONSE_SIZE "sd-bus-response-size"
+
+#define WATCH_SD_BUS_PATH "/" YANG_MODEL ":sd-bus-watch"
+#define WATCH_SD_BUS_OBJECT_XPATH WATCH_SD_BUS_PATH "/sd-bus-watched-object[sd-bus='%s'][sd-bus-service='%s']" \
+												   "[sd-bus-object-path='%s'][sd-bus-interface='%s']"
+#define WATCH_SD_BUS_LEAF_XPATH "%s/%s"
+#define WATCH_SD_BUS_PROPERTY_XPATH "%s/sd-bus-watched-property[sd-bus-property-name='%s']/%s"
+#define WATCH_SD_BUS_SYNCHRONIZED "sd-bus-synchronized"
+#define WATCH_SD_BUS_OBJECT "sd-bus-watched-object"
+#define WATCH_SD_BUS_SIGNAL_SUBSCRIPTION "sd-bus-signal-subscription"
+
+#define SIGNAL_SD_BUS_SUBSCRIPTION "sd-bus-subscription"
+#define SIGNAL_SD_BUS_SENDER "sd-bus-sender"
+#define SIGNAL_SD_BUS_MEMBER "sd-bus-member"
+#define SIGNAL_SD_BUS_ARG0 "sd-bus-arg0"
+#define SIGNAL_SD_BUS_COALESCE_WINDOW "sd-bus-coalesce-window"
+#define CACHE_SD_BUS_PATH "/" YANG_MODEL ":sd-bus-cache"
+#define CACHE_SD_BUS_SIZE "sd-bus-cache-size"
+#define CACHE_SD_BUS_SIZE_DEFAULT 4194304
+#define CACHE_SD_BUS_METHOD "sd-bus-cached-method"
+#define CACHE_SD_BUS_TTL "sd-bus-ttl"
+#define CACHE_SD_BUS_HITS "sd-bus-cache-hits"
+#define CACHE_SD_BUS_MISSES "sd-bus-cache-misses"
+#define CACHE_SD_BUS_EVICTIONS "sd-bus-cache-evictions"
+#define CACHE_SD_BUS_ENTRIES "sd-bus-cache-entries"
+#define CACHE_SD_BUS_BYTES "sd-bus-cache-bytes"
+
+#define OFFLOAD_SD_BUS_PATH "/" YANG_MODEL ":sd-bus-offload"
+#define OFFLOAD_SD_BUS_THRESHOLD "sd-bus-offload-threshold"
+#define OFFLOAD_SD_BUS_DIRECTORY "sd-bus-offload-directory"
+#define OFFLOAD_SD_BUS_RETENTION "sd-bus-offload-retention"
+#define OFFLOAD_SD_BUS_RETENTION_DEFAULT 300
+#define OFFLOAD_SD_BUS_SIZE "sd-bus-offload-size"
+#define OFFLOAD_SD_BUS_SIZE_DEFAULT 268435456
+#define OFFLOAD_SD_BUS_EVICTIONS "sd-bus-offload-evictions"
+#define OFFLOAD_SD_BUS_ENTRIES "sd-bus-offload-entries"
+#define OFFLOAD_SD_BUS_BYTES "sd-bus-offload-bytes"
+
+#define METRICS_SD_BUS_PATH "/" YANG_MODEL ":sd-bus-metrics"
+#define METRICS_SD_BUS_TARGET_XPATH METRICS_SD_BUS_PATH "/sd-bus-target[sd-bus='%s'][sd-bus-service='%s']" \
+													   "[sd-bus-interface='%s'][sd-bus-method='%s']"
+#define METRICS_SD_BUS_LEAF_XPATH "%s/%s"
+#define METRICS_SD_BUS_PHASE_XPATH "sd-bus-phase[sd-bus-phase-name='%s']/%s"
+#define METRICS_SD_BUS_BUCKET_XPATH "sd-bus-phase[sd-bus-phase-name='%s']/sd-bus-bucket[sd-bus-bucket-index='%zu']/%s"
+#define METRICS_SD_BUS_ERROR_XPATH "sd-bus-error[sd-bus-error-name='%s']/sd-bus-count"
+#define METRICS_SD_BUS_NAME_SIZE 512
+#define METRICS_SD_BUS_CALLS "sd-bus-calls"
+#define METRICS_SD_BUS_ERRORS "sd-bus-errors"
+#define METRICS_SD_BUS_IN_FLIGHT "sd-bus-in-flight"
+#define METRICS_SD_BUS_COUNT "sd-bus-count"
+#define METRICS_SD_BUS_TOTAL "sd-bus-total-time"
+#define METRICS_SD_BUS_MAX "sd-bus-max-time"
+#define METRICS_SD_BUS_UPPER_BOUND "sd-bus-upper-bound"
+
+#define SIGNAL_SD_BUS_NOTIFICATION "/" YANG_MODEL ":sd-bus-signal"
+#define SIGNAL_SD_BUS_MESSAGE SIGNAL_SD_BUS_NOTIFICATION "/sd-bus-signal-message"
+
+// RPC input leaves, matched by their schema node
+typedef enum generic_sdbus_leaf_e {
+	// leaves of the sd-bus-message and sd-bus-property entries
+	GENERIC_SDBUS_LEAF_BUS = 0,
+	GENERIC_SDBUS_LEAF_ADDRESS,
+	GENERIC_SDBUS_LEAF_SERVICE,
+	GENERIC_SDBUS_LEAF_OBJPATH,
+	GENERIC_SDBUS_LEAF_INTERFACE,
+	GENERIC_SDBUS_LEAF_METHOD,
+	GENERIC_SDBUS_LEAF_SIGNATURE,
+	GENERIC_SDBUS_LEAF_ARGUMENTS,
+	GENERIC_SDBUS_LEAF_TIMEOUT,
+	GENERIC_SDBUS_LEAF_SINGLE_FLIGHT,
+	GENERIC_SDBUS_LEAF_PROPERTY_NAME,
+	GENERIC_SDBUS_LEAF_PROPERTY_VALUE,
+	// options of the whole RPC
+	GENERIC_SDBUS_LEAF_PIPELINED,
+	GENERIC_SDBUS_LEAF_MAX_IN_FLIGHT,
+	GENERIC_SDBUS_LEAF_RPC_TIMEOUT,
+	GENERIC_SDBUS_LEAF_THREADED,
+	GENERIC_SDBUS_LEAF_RESPONSE_FORMAT,
+	GENERIC_SDBUS_LEAF_ARGUMENTS_FORMAT,
+	GENERIC_SDBUS_LEAF_BYTE_ARRAY_FORMAT,
+	GENERIC_SDBUS_LEAF_COUNT,
+} generic_sdbus_leaf_t;
+
+static const char *generic_sdbus_leaf_names[GENERIC_SDBUS_LEAF_COUNT] = {
+	[GENERIC_SDBUS_LEAF_BUS] = RPC_SD_BUS,
+	[GENERIC_SDBUS_LEAF_ADDRESS] = RPC_SD_BUS_ADDRESS,
+	[GENERIC_SDBUS_LEAF_SERVICE] = RPC_SD_BUS_SERVICE,
+	[GENERIC_SDBUS_LEAF_OBJPATH] = RPC_SD_BUS_OBJPATH,
+	[GENERIC_SDBUS_LEAF_INTERFACE] = RPC_SD_BUS_INTERFACE,
+	[GENERIC_SDBUS_LEAF_METHOD] = RPC_SD_BUS_METHOD,
+	[GENERIC_SDBUS_LEAF_SIGNATURE] = RPC_SD_BUS_SIGNATURE,
+	[GENERIC_SDBUS_LEAF_ARGUMENTS] = RPC_SD_BUS_ARGUMENTS,
+	[GENERIC_SDBUS_LEAF_TIMEOUT] = RPC_SD_BUS_TIMEOUT,
+	[GENERIC_SDBUS_LEAF_SINGLE_FLIGHT] = RPC_SD_BUS_SINGLE_FLIGHT,
+	[GENERIC_SDBUS_LEAF_PROPERTY_NAME] = RPC_SD_BUS_PROPERTY_NAME,
+	[GENERIC_SDBUS_LEAF_PROPERTY_VALUE] = RPC_SD_BUS_PROPERTY_VALUE,
+	[GENERIC_SDBUS_LEAF_PIPELINED] = RPC_SD_BUS_PIPELINED,
+	[GENERIC_SDBUS_LEAF_MAX_IN_FLIGHT] = RPC_SD_BUS_MAX_IN_FLIGHT,
+	[GENERIC_SDBUS_LEAF_RPC_TIMEOUT] = RPC_SD_BUS_RPC_TIMEOUT,
+	[GENERIC_SDBUS_LEAF_THREADED] = RPC_SD_BUS_THREADED,
+	[GENERIC_SDBUS_LEAF_RESPONSE_FORMAT] = RPC_SD_BUS_RESPONSE_FORMAT,
+	[GENERIC_SDBUS_LEAF_ARGUMENTS_FORMAT] = RPC_SD_BUS_ARGUMENTS_FORMAT,
+	[GENERIC_SDBUS_LEAF_BYTE_ARRAY_FORMAT] = RPC_SD_BUS_BYTE_ARRAY_FORMAT,
+};
+
+// schema nodes of an RPC input
+typedef struct generic_sdbus_rpc_schema_s {
+	// the sd-bus-message or sd-bus-property list
+	const struct lys_node *entry;
+	// NULL for the leaves the RPC does not have
+	const struct lys_node *leaves[GENERIC_SDBUS_LEAF_COUNT];
+} generic_sdbus_rpc_schema_t;
+
+// RPC input leaves shared by sd-bus-call and sd-bus-properties
+typedef struct generic_sdbus_options_s {
+	bool pipelined;
+	bool threaded;
+	size_t max_in_flight;
+	uint64_t rpc_timeout_usec;
+	bus_encode_format_t arguments_format;
+	bus_decode_format_t response_format;
+	bus_bytes_format_t bytes_format;
+} generic_sdbus_options_t;
+
+// sd-bus calls of a single RPC, shared by every worker taking part in it
+typedef struct generic_sdbus_batch_s {
+	bus_call_t *calls;
+	size_t calls_count;
+	size_t parts_count;
+	bool pipelined;
+	size_t max_in_flight;
+	uint64_t deadline_usec;
+	// replies are decoded into the response format of their call
+	bool decode;
+	// decoded replies of allow-listed methods are looked up and stored here, NULL disables caching
+	bus_cache_t *cache;
+	// identical calls in flight across RPCs share a single sd-bus call, NULL disables sharing
+	bus_flight_group_t *flights;
+	// latency and error metrics of the calls sent, NULL disables them
+	bus_metrics_t *metrics;
+	// decoded replies above the offload threshold are moved out of memory, NULL disables offloading
+	bus_offload_t *offload;
+} generic_sdbus_batch_t;
+
+// operational data being built
+typedef struct generic_sdbus_oper_s {
+	const struct ly_ctx *ctx;
+	struct lyd_node **parent;
+	int error;
+} generic_sdbus_oper_t;
+
+static bus_connection_pool_t *bus_connections = NULL;
+// every worker thread owns its own bus connections, sd-bus connections are not thread safe
+static worker_pool_t *bus_workers = NULL;
+// mirrors the properties of the watched objects, owns its own bus connections and a thread unless there is an event loop
+static bus_watch_t *bus_watch = NULL;
+// decoded replies of allow-listed methods, shared by all threads
+static bus_cache_t *bus_cache = NULL;
+// sd-bus calls in flight, shared by all threads
+static bus_flight_group_t *bus_flights = NULL;
+// latency and error metrics of the sd-bus calls, shared by all threads
+static bus_metrics_t *bus_metrics = NULL;
+// large decoded replies of sd-bus-call are handed out as a memfd or spool file
+static bus_offload_t *bus_offload = NULL;
+// resolved once when the plugin is initialized, read-only afterwards
+static generic_sdbus_rpc_schema_t rpc_call_schema = {0};
+static generic_sdbus_rpc_schema_t rpc_properties_schema = {0};
+// the standalone binary dispatches the subscriptions from its own event loop
+static sr_subscr_options_t subscription_options = SR_SUBSCR_CTX_REUSE;
+// event loop of the standalone binary, the watcher runs on it instead of a thread
+static sd_event *bus_event = NULL;
+
+/*
+ * @brief Creates the bus connection pool of a worker thread.
+ *
+ * @return bus connection pool, or NULL if it could not be created.
+ */
+static void *generic_sdbus_worker_state_create(void)
+{
+	bus_connection_pool_t *connections = NULL;
+
+	if (bus_connection_pool_create(&connections) < 0) {
+		SRP_LOG_ERRMSG("failed to create the bus connection pool of a worker");
+		return NULL;
+	}
+
+	return connections;
+}
+
+/*
+ * @brief Closes the bus connections of a worker thread.
+ *
+ * @param[in] state bus connection pool of the worker.
+ */
+static void generic_sdbus_worker_state_destroy(void *state)
+{
+	bus_connection_pool_destroy((bus_connection_pool_t *) state);
+}
+
+/*
+ * @brief Moves the decoded reply of a call to the offload when it is above
+ *        the offload threshold. A reply that cannot be offloaded stays inline.
+ *
+ * @param[in] batch batch the call belongs to.
+ * @param[in,out] call call whose reply is offloaded.
+ */
+static void generic_sdbus_call_offload(generic_sdbus_batch_t *batch, bus_call_t *call)
+{
+	int offloaded = 0;
+	size_t response_size = 0;
+
+	if (batch->offload == NULL || call->response == NULL || call->response_handle != NULL) {
+		return;
+	}
+
+	response_size = strlen(call->response);
+	offloaded = bus_offload_store(batch->offload, call->response, response_size, &call->response_handle);
+	if (offloaded < 0) {
+		SRP_LOG_ERR("failed to offload the reply of sd-bus method %s: %s", call->method, strerror(-offloaded));
+		return;
+	}
+
+	if (offloaded > 0) {
+		FREE_SAFE(call->response);
+		call->response_size = response_size;
+	}
+}
+
+/*
+ * @brief Prepares, calls and optionally decodes a contiguous range of the batch.
+ *        Entries are called one after another or, in pipelined mode, sent
+ *        together. The outcome of every entry is left in its call, a failing
+ *        entry does not stop the rest of the range. Entries found in the
+ *        response cache are neither called nor decoded.
+ *        An entry identical to a call already in flight waits for the reply
+ *        of that call instead of sending its own. Flights led by the range
+ *        are completed before any flight it follows is waited for, so parts
+ *        following each other's calls do not deadlock.
+ *        Only entries actually sent to the bus are accounted in the metrics.
+ *        A reply above the offload threshold is offloaded as soon as it is
+ *        decoded, so the range never holds more than one large reply. Replies
+ *        shared with other flights or taken from the cache are offloaded once
+ *        the flights are done.
+ *
+ * @param[in] batch batch the range belongs to.
+ * @param[in] begin first entry of the range.
+ * @param[in] end entry following the last one of the range.
+ * @param[in] connections bus connections of the calling thread.
+ */
+static void generic_sdbus_calls_run(generic_sdbus_batch_t *batch, size_t begin, size_t end, bus_connection_pool_t *connections)
+{
+	int error = 0;
+	bus_call_t *calls = batch->calls;
+	uint64_t phase_begin = 0;
+	uint64_t phase_duration = 0;
+
+	for (size_t i = begin; i < end; i++) {
+		// entries rejected while reading the input are never called
+		if (calls[i].done) {
+			continue;
+		}
+
+		if (batch->cache != NULL && bus_cache_lookup(batch->cache, &calls[i]) == 0) {
+			calls[i].done = true;
+			continue;
+		}
+
+		// calls that cannot join a flight are simply sent on their own
+		if (batch->flights != NULL && calls[i].single_flight && bus_flight_join(batch->flights, &calls[i]) == 0 &&
+			!calls[i].flight_leader) {
+			continue;
+		}
+
+		bus_metrics_call_begin(batch->metrics, &calls[i]);
+		BUS_TRACE(encode__begin, calls[i].service, calls[i].method, (calls[i].arguments != NULL) ? strlen(calls[i].arguments) : 0);
+		phase_begin = bus_metrics_now();
+		error = (connections == NULL) ? -ENOMEM : bus_call_prepare(&calls[i], connections, batch->deadline_usec);
+		phase_duration = bus_metrics_now() - phase_begin;
+		BUS_TRACE(encode__end, calls[i].service, calls[i].method, error, phase_duration);
+		bus_metrics_phase_record(batch->metrics, &calls[i], BUS_METRICS_PHASE_ENCODE, phase_duration);
+		if (error < 0) {
+			calls[i].error = error;
+			calls[i].done = true;
+			continue;
+		}
+
+		if (!batch->pipelined) {
+			bus_call_run(&calls[i], batch->deadline_usec);
+		}
+	}
+
+	if (batch->pipelined) {
+		error = bus_call_run_pipelined(&calls[begin], end - begin, batch->max_in_flight, batch->deadline_usec);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to dispatch sd-bus calls: %s", strerror(-error));
+			for (size_t i = begin; i < end; i++) {
+				if (!calls[i].done) {
+					calls[i].error = error;
+					calls[i].done = true;
+				}
+			}
+		}
+	}
+
+	for (size_t i = begin; i < end && batch->decode; i++) {
+		if (calls[i].error != 0 || calls[i].reply == NULL) {
+			continue;
+		}
+
+		BUS_TRACE(decode__begin, calls[i].service, calls[i].method);
+		phase_begin = bus_metrics_now();
+		error = bus_call_decode(&calls[i]);
+		phase_duration = bus_metrics_now() - phase_begin;
+		BUS_TRACE(decode__end, calls[i].service, calls[i].method, error, (calls[i].response != NULL) ? strlen(calls[i].response) : 0,
+				  phase_duration);
+		bus_metrics_phase_record(batch->metrics, &calls[i], BUS_METRICS_PHASE_DECODE, phase_duration);
+		if (error == 0 && batch->cache != NULL) {
+			bus_cache_store(batch->cache, &calls[i]);
+		}
+		// the reply of a flight leader is still copied to its followers
+		if (error == 0 && calls[i].flight == NULL) {
+			generic_sdbus_call_offload(batch, &calls[i]);
+		}
+	}
+
+	for (size_t i = begin; i < end && batch->metrics != NULL; i++) {
+		if (calls[i].metrics == NULL) {
+			continue;
+		}
+
+		if (calls[i].sent_usec != 0 && calls[i].completed_usec >= calls[i].sent_usec) {
+			bus_metrics_phase_record(batch->metrics, &calls[i], BUS_METRICS_PHASE_CALL, calls[i].completed_usec - calls[i].sent_usec);
+		}
+		// a reply that could not be decoded fails the call as well
+		error = (calls[i].error < 0) ? calls[i].error : ((batch->decode && calls[i].reply_signature == NULL) ? -EIO : 0);
+		bus_metrics_call_end(batch->metrics, &calls[i], error);
+	}
+
+	for (size_t i = begin; i < end && batch->flights != NULL; i++) {
+		if (calls[i].flight != NULL && calls[i].flight_leader) {
+			bus_flight_complete(batch->flights, &calls[i]);
+		}
+	}
+
+	for (size_t i = begin; i < end && batch->flights != NULL; i++) {
+		if (calls[i].flight != NULL) {
+			bus_flight_wait(batch->flights, &calls[i], batch->deadline_usec);
+		}
+	}
+
+	for (size_t i = begin; i < end && batch->offload != NULL; i++) {
+		generic_sdbus_call_offload(batch, &calls[i]);
+	}
+}
+
+/*
+ * @brief Worker job running one part of a threaded batch.
+ *
+ * @param[in] part index of the part, parts are contiguous ranges of entries.
+ * @param[in] state bus connection pool of the worker.
+ * @param[in] userdata batch the part belongs to.
+ */
+static void generic_sdbus_batch_part_cb(size_t part, void *state, void *userdata)
+{
+	generic_sdbus_batch_t *batch = (generic_sdbus_batch_t *) userdata;
+	size_t begin = part * batch->calls_count / batch->parts_count;
+	size_t end = (part + 1) * batch->calls_count / batch->parts_count;
+
+	generic_sdbus_calls_run(batch, begin, end, (bus_connection_pool_t *) state);
+}
+
+/*
+ * @brief Runs all calls of a batch, on the worker threads in threaded mode.
+ *
+ * @param[in] batch batch to be run.
+ * @param[in] threaded split the batch between the worker threads.
+ * @param[in] connections bus connections of the calling thread.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_batch_run(generic_sdbus_batch_t *batch, bool threaded, bus_connection_pool_t *connections)
+{
+	int error = 0;
+
+	if (threaded && batch->calls_count > 1) {
+		batch->parts_count = worker_pool_size(bus_workers) < batch->calls_count ? worker_pool_size(bus_workers) : batch->calls_count;
+		error = worker_pool_run(bus_workers, batch->parts_count, generic_sdbus_batch_part_cb, batch);
+		if (error < 0) {
+			SRP_LOG_ERR("failed to run sd-bus calls on the workers: %s", strerror(-error));
+			return SR_ERR_INTERNAL;
+		}
+	} else {
+		generic_sdbus_calls_run(batch, 0, batch->calls_count, connections);
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Resolves the schema nodes of the leaves under the given parent.
+ *
+ * @param[in] parent schema node whose leaves are resolved.
+ * @param[in] begin first leaf looked up.
+ * @param[in] end leaf after the last one looked up.
+ * @param[out] schema RPC input schema to be updated.
+ */
+static void generic_sdbus_rpc_schema_leaves_resolve(const struct lys_node *parent, generic_sdbus_leaf_t begin, generic_sdbus_leaf_t end,
+													generic_sdbus_rpc_schema_t *schema)
+{
+	const struct lys_node *node = NULL;
+
+	while ((node = lys_getnext(node, parent, NULL, 0)) != NULL) {
+		if (node->nodetype != LYS_LEAF) {
+			continue;
+		}
+
+		for (size_t i = begin; i < end; i++) {
+			if (strcmp(generic_sdbus_leaf_names[i], node->name) == 0) {
+				schema->leaves[i] = node;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * @brief Resolves the schema nodes of an RPC input.
+ *
+ * @param[in] ctx libyang context of the plugin module.
+ * @param[in] entry_path schema path of the sd-bus-message or sd-bus-property list.
+ * @param[out] schema RPC input schema to be filled.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_rpc_schema_resolve(const struct ly_ctx *ctx, const char *entry_path, generic_sdbus_rpc_schema_t *schema)
+{
+	memset(schema, 0, sizeof(generic_sdbus_rpc_schema_t));
+
+	schema->entry = ly_ctx_get_node(ctx, NULL, entry_path, 0);
+	if (schema->entry == NULL || schema->entry->parent == NULL) {
+		SRP_LOG_ERR("schema node %s not found", entry_path);
+		return SR_ERR_NOT_FOUND;
+	}
+
+	// the entry leaves are children of the list, the options are its siblings in the RPC input
+	generic_sdbus_rpc_schema_leaves_resolve(schema->entry, 0, GENERIC_SDBUS_LEAF_PIPELINED, schema);
+	generic_sdbus_rpc_schema_leaves_resolve(schema->entry->parent, GENERIC_SDBUS_LEAF_PIPELINED, GENERIC_SDBUS_LEAF_COUNT, schema);
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Resolves the schema nodes of the sd-bus-call and sd-bus-properties
+ *        input, so that the RPC callbacks match the input leaves by their
+ *        schema node instead of comparing names.
+ *
+ * @param[in] ctx libyang context of the plugin module.
+ *
+ * @return error code.
+ */
+int generic_sdbus_schema_init(const struct ly_ctx *ctx)
+{
+	int rc = SR_ERR_OK;
+
+	rc = generic_sdbus_rpc_schema_resolve(ctx, RPC_SD_BUS_CALL_PATH "/" RPC_SD_BUS_MESSAGE, &rpc_call_schema);
+	if (rc == SR_ERR_OK) {
+		rc = generic_sdbus_rpc_schema_resolve(ctx, RPC_SD_BUS_PROPERTIES_PATH "/" RPC_SD_BUS_PROPERTY, &rpc_properties_schema);
+	}
+
+	return rc;
+}
+
+/*
+ * @brief Reads an RPC input leaf shared by sd-bus-call and sd-bus-properties.
+ *
+ * @param[in] schema schema of the RPC input.
+ * @param[in] node input leaf.
+ * @param[out] options options to be updated with the leaf value.
+ *
+ * @return true if the leaf is one of the shared options.
+ */
+static bool generic_sdbus_option_parse(const generic_sdbus_rpc_schema_t *schema, const struct lyd_node *node, generic_sdbus_options_t *options)
+{
+	const struct lyd_node_leaf_list *leaf = (const struct lyd_node_leaf_list *) node;
+	const struct lys_node *const *leaves = schema->leaves;
+
+	if (node->schema->nodetype != LYS_LEAF) {
+		return false;
+	}
+
+	if (node->schema == leaves[GENERIC_SDBUS_LEAF_PIPELINED]) {
+		options->pipelined = leaf->value.bln;
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_MAX_IN_FLIGHT]) {
+		options->max_in_flight = leaf->value.uint16;
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_RPC_TIMEOUT]) {
+		options->rpc_timeout_usec = leaf->value.uint32 * USEC_PER_MSEC;
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_THREADED]) {
+		options->threaded = leaf->value.bln;
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_RESPONSE_FORMAT]) {
+		if (strcmp(RPC_SD_BUS_RESPONSE_FORMAT_TYPED, leaf->value.enm->name) == 0) {
+			options->response_format = BUS_DECODE_FORMAT_XML;
+		}
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_ARGUMENTS_FORMAT]) {
+		if (strcmp(RPC_SD_BUS_ARGUMENTS_FORMAT_JSON, leaf->value.enm->name) == 0) {
+			options->arguments_format = BUS_ENCODE_FORMAT_JSON;
+		}
+	} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_BYTE_ARRAY_FORMAT]) {
+		if (strcmp(RPC_SD_BUS_BYTE_ARRAY_FORMAT_BASE64, leaf->value.enm->name) == 0) {
+			options->bytes_format = BUS_BYTES_FORMAT_BASE64;
+		} else if (strcmp(RPC_SD_BUS_BYTE_ARRAY_FORMAT_HEX, leaf->value.enm->name) == 0) {
+			options->bytes_format = BUS_BYTES_FORMAT_HEX;
+		}
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * @brief Creates the result entry of the given request index. The entry is
+ *        created directly under the RPC output, its leaves are then attached
+ *        to it without resolving any xpath.
+ *
+ * @param[in] output sysrepo RPC output data.
+ * @param[in] result name of the result list.
+ * @param[in] index position of the entry in the request.
+ * @param[out] entry created result entry.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_result_create(struct lyd_node *output, const char *result, size_t index, struct lyd_node **entry)
+{
+	char index_string[24] = {0};
+
+	snprintf(index_string, sizeof(index_string), "%zu", index);
+
+	*entry = lyd_new_output(output, NULL, result);
+	if (*entry == NULL) {
+		SRP_LOG_ERR("failed to create output %s", result);
+		return SR_ERR_INTERNAL;
+	}
+
+	// the key has to be the first child of the entry
+	if (lyd_new_output_leaf(*entry, NULL, RPC_SD_BUS_INDEX, index_string) == NULL) {
+		SRP_LOG_ERR("failed to set output %s %s", result, index_string);
+		lyd_free(*entry);
+		*entry = NULL;
+		return SR_ERR_INTERNAL;
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Sets a node of a result entry.
+ *
+ * @param[in] entry result entry.
+ * @param[in] name name of the leaf or anydata node.
+ * @param[in] value value of the node.
+ * @param[in] value_type type of the value, LYD_ANYDATA_STRING for leaves.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_result_set(struct lyd_node *entry, const char *name, void *value, LYD_ANYDATA_VALUETYPE value_type)
+{
+	struct lyd_node *node = NULL;
+
+	if (value_type == LYD_ANYDATA_STRING) {
+		node = lyd_new_output_leaf(entry, NULL, name, (value != NULL) ? (const char *) value : "");
+	} else {
+		node = lyd_new_output_anydata(entry, NULL, name, value, value_type);
+	}
+	if (node == NULL) {
+		SRP_LOG_ERR("failed to set output %s", name);
+		return SR_ERR_INTERNAL;
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Sets the error status of a result entry.
+ *
+ * @param[in] entry result entry.
+ * @param[in] error negative errno of the failure.
+ * @param[in,out] bus_error D-Bus error of the failure, set from error if empty.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_result_error_set(struct lyd_node *entry, int error, sd_bus_error *bus_error)
+{
+	int rc = SR_ERR_OK;
+
+	// local failures carry no D-Bus error of their own
+	if (!sd_bus_error_is_set(bus_error)) {
+		sd_bus_error_set_errno(bus_error, (error < 0) ? error : -EIO);
+	}
+
+	rc = generic_sdbus_result_set(entry, RPC_SD_BUS_STATUS, RPC_SD_BUS_STATUS_ERROR, LYD_ANYDATA_STRING);
+	if (rc == SR_ERR_OK) {
+		rc = generic_sdbus_result_set(entry, RPC_SD_BUS_ERROR_NAME, (void *) bus_error->name, LYD_ANYDATA_STRING);
+	}
+	if (rc == SR_ERR_OK && bus_error->message != NULL) {
+		rc = generic_sdbus_result_set(entry, RPC_SD_BUS_ERROR_MESSAGE, (void *) bus_error->message, LYD_ANYDATA_STRING);
+	}
+
+	return rc;
+}
+
+/*
+ * @brief Reads a single sd-bus-message list entry of the RPC input.
+ *        An invalid entry is left failed with the reason in its D-Bus error,
+ *        so it is answered in its own result and the rest are still called.
+ *
+ * @param[in] schema schema of the sd-bus-call input.
+ * @param[in] list sd-bus-message list instance.
+ * @param[out] call sd-bus call to be filled with the entry leaves.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_message_input_parse(const generic_sdbus_rpc_schema_t *schema, const struct lyd_node *list, bus_call_t *call)
+{
+	int rc = SR_ERR_OK;
+	const char *sd_bus_bus = NULL;
+	struct lyd_node *node = NULL;
+	const struct lyd_node_leaf_list *leaf = NULL;
+	const struct lys_node *const *leaves = schema->leaves;
+
+	LY_TREE_FOR(list->child, node)
+	{
+		if (node->schema == NULL || node->schema->nodetype != LYS_LEAF) {
+			continue;
+		}
+		leaf = (const struct lyd_node_leaf_list *) node;
+
+		if (node->schema == leaves[GENERIC_SDBUS_LEAF_BUS]) {
+			sd_bus_bus = leaf->value.enm->name;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_ADDRESS]) {
+			call->address = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_SERVICE]) {
+			call->service = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_OBJPATH]) {
+			call->object_path = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_INTERFACE]) {
+			call->interface = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_METHOD]) {
+			call->method = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_SIGNATURE]) {
+			call->signature = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_ARGUMENTS]) {
+			call->arguments = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_TIMEOUT]) {
+			call->timeout_usec = leaf->value.uint32 * USEC_PER_MSEC;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_SINGLE_FLIGHT]) {
+			call->single_flight = leaf->value.bln;
+		}
+	}
+
+	if (sd_bus_bus == NULL || call->service == NULL || call->object_path == NULL ||
+		call->interface == NULL || call->method == NULL || call->arguments == NULL) {
+		SRP_LOG_ERRMSG("incomplete sd-bus-message entry");
+		sd_bus_error_set(&call->bus_error, SD_BUS_ERROR_INVALID_ARGS, "incomplete sd-bus-message entry");
+		rc = SR_ERR_VALIDATION_FAILED;
+	} else if (!sd_bus_object_path_is_valid(call->object_path)) {
+		SRP_LOG_ERR("invalid sd-bus object path: %s", call->object_path);
+		sd_bus_error_setf(&call->bus_error, SD_BUS_ERROR_INVALID_ARGS, "invalid sd-bus-object-path: %s", call->object_path);
+		rc = SR_ERR_VALIDATION_FAILED;
+	} else if (bus_connection_type_parse(sd_bus_bus, &call->bus_type) < 0) {
+		SRP_LOG_ERR("unknown sd-bus type: %s", sd_bus_bus);
+		sd_bus_error_setf(&call->bus_error, SD_BUS_ERROR_INVALID_ARGS, "unknown sd-bus type: %s", sd_bus_bus);
+		rc = SR_ERR_INVAL_ARG;
+	}
+
+	if (rc != SR_ERR_OK) {
+		call->error = -EINVAL;
+		call->done = true;
+	}
+
+	return rc;
+}
+
+/*
+ * @brief Reads a single sd-bus-property list entry of the RPC input.
+ *
+ * @param[in] schema schema of the sd-bus-properties input.
+ * @param[in] list sd-bus-property list instance.
+ * @param[out] property sd-bus property to be filled with the entry leaves.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_property_input_parse(const generic_sdbus_rpc_schema_t *schema, const struct lyd_node *list, bus_property_t *property)
+{
+	int rc = SR_ERR_OK;
+	const char *sd_bus_bus = NULL;
+	struct lyd_node *node = NULL;
+	const struct lyd_node_leaf_list *leaf = NULL;
+	const struct lys_node *const *leaves = schema->leaves;
+
+	LY_TREE_FOR(list->child, node)
+	{
+		if (node->schema == NULL || node->schema->nodetype != LYS_LEAF) {
+			continue;
+		}
+		leaf = (const struct lyd_node_leaf_list *) node;
+
+		if (node->schema == leaves[GENERIC_SDBUS_LEAF_BUS]) {
+			sd_bus_bus = leaf->value.enm->name;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_SERVICE]) {
+			property->service = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_OBJPATH]) {
+			property->object_path = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_INTERFACE]) {
+			property->interface = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_PROPERTY_NAME]) {
+			property->name = leaf->value.string;
+		} else if (node->schema == leaves[GENERIC_SDBUS_LEAF_PROPERTY_VALUE]) {
+			property->value = leaf->value.string;
+		}
+	}
+
+	if (sd_bus_bus == NULL || property->service == NULL || property->object_path == NULL ||
+		property->interface == NULL || property->name == NULL) {
+		SRP_LOG_ERRMSG("incomplete sd-bus-property entry");
+		return SR_ERR_VALIDATION_FAILED;
+	}
+
+	rc = bus_connection_type_parse(sd_bus_bus, &property->bus_type);
+	if (rc < 0) {
+		SRP_LOG_ERR("unknown sd-bus type: %s", sd_bus_bus);
+		return SR_ERR_INVAL_ARG;
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Callback for sd-bus call RPC method. Used to invoke an sd-bus call and
+ *        retreive sd-bus call result data.
+ *        All entries are prepared first, then either called one after another
+ *        or, in pipelined mode, sent together and collected in request order.
+ *        In threaded mode the entries are split into contiguous parts that
+ *        are called and decoded on the worker threads in parallel.
+ *        The optional RPC timeout is turned into a deadline when the callback
+ *        is entered, every call only gets the part of it that is still left.
+ *        Every entry gets its own result keyed by its index in the request,
+ *        an invalid entry or a failed call is reported in its result and
+ *        does not fail the RPC.
+ *
+ * @param[in] xpath xpath to the module RPC.
+ * @param[in] input sysrepo RPC input data.
+ * @param[out] output sysrepo RPC output data to be set.
+ * @param[in] private_ctx bus connection pool used to reach the sd-bus services.
+ *
+ * @return error code.
+ */
+int generic_sdbus_call_rpc_tree_cb(sr_session_ctx_t *session, const char *op_path,
+								   const struct lyd_node *input, sr_event_t event,
+								   uint32_t request_id, struct lyd_node *output,
+								   void *private_data)
+{
+	int rc = SR_ERR_OK;
+	bus_connection_pool_t *connections = (bus_connection_pool_t *) private_data;
+	bus_call_t *calls = NULL;
+	size_t calls_count = 0;
+	generic_sdbus_options_t options = {.max_in_flight = RPC_SD_BUS_MAX_IN_FLIGHT_DEFAULT};
+	generic_sdbus_batch_t batch = {0};
+	struct lyd_node *node = NULL;
+	struct lyd_node *result = NULL;
+	void *tmp = NULL;
+	uint64_t rpc_begin = bus_metrics_now();
+	char size_string[24] = {0};
+
+	BUS_TRACE(rpc__entry, op_path);
+
+	// offloaded replies expire even while no large replies are stored
+	bus_offload_collect(bus_offload);
+
+	if (NULL == input) {
+		rc = SR_ERR_INTERNAL;
+		SRP_LOG_ERRMSG("input is invalid");
+		goto cleanup;
+	}
+
+	LY_TREE_FOR(input->child, node)
+	{
+		if (node->schema == NULL) {
+			continue;
+		}
+
+		if (node->schema == rpc_call_schema.entry) {
+			tmp = realloc(calls, sizeof(bus_call_t) * (calls_count + 1));
+			if (NULL == tmp) {
+				rc = SR_ERR_NOMEM;
+				goto cleanup;
+			}
+			calls = tmp;
+			memset(&calls[calls_count], 0, sizeof(bus_call_t));
+			calls_count++;
+
+			// an invalid entry only fails its own result
+			generic_sdbus_message_input_parse(&rpc_call_schema, node, &calls[calls_count - 1]);
+		} else {
+			generic_sdbus_option_parse(&rpc_call_schema, node, &options);
+		}
+	}
+
+	for (size_t i = 0; i < calls_count; i++) {
+		calls[i].arguments_format = options.arguments_format;
+		calls[i].response_format = options.response_format;
+		calls[i].bytes_format = options.bytes_format;
+	}
+
+	batch.calls = calls;
+	batch.calls_count = calls_count;
+	batch.pipelined = options.pipelined;
+	batch.max_in_flight = options.max_in_flight ? options.max_in_flight : 1;
+	batch.deadline_usec = bus_call_deadline(options.rpc_timeout_usec);
+	batch.decode = true;
+	batch.cache = bus_cache;
+	batch.flights = bus_flights;
+	batch.metrics = bus_metrics;
+	batch.offload = bus_offload;
+
+	rc = generic_sdbus_batch_run(&batch, options.threaded, connections);
+	if (rc != SR_ERR_OK) {
+		goto cleanup;
+	}
+
+	for (size_t i = 0; i < calls_count; i++) {
+		bus_call_t *call = &calls[i];
+		uint64_t output_begin = bus_metrics_now();
+		uint64_t output_duration = 0;
+
+		BUS_TRACE(output__begin, call->method, i);
+
+		rc = generic_sdbus_result_create(output, RPC_SD_BUS_RESULT, i, &result);
+		if (rc == SR_ERR_OK && call->method != NULL) {
+			rc = generic_sdbus_result_set(result, RPC_SD_BUS_METHOD, (void *) call->method, LYD_ANYDATA_STRING);
+		}
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		if (call->error < 0 || call->reply_signature == NULL) {
+			SRP_LOG_ERR("failed to call sd-bus method %s: %s", (call->method != NULL) ? call->method : "",
+						strerror((call->error < 0) ? -call->error : EIO));
+			rc = generic_sdbus_result_error_set(result, call->error, &call->bus_error);
+			if (rc != SR_ERR_OK) {
+				goto cleanup;
+			}
+
+			output_duration = bus_metrics_now() - output_begin;
+			BUS_TRACE(output__end, call->method, i, call->error, output_duration);
+			bus_metrics_phase_record(bus_metrics, call, BUS_METRICS_PHASE_OUTPUT, output_duration);
+			bus_call_release(call);
+			continue;
+		}
+
+		rc = generic_sdbus_result_set(result, RPC_SD_BUS_STATUS, RPC_SD_BUS_STATUS_OK, LYD_ANYDATA_STRING);
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		// a reply above the offload threshold is handed out by its handle and never enters the tree
+		if (call->response_handle != NULL) {
+			snprintf(size_string, sizeof(size_string), "%zu", call->response_size);
+			rc = generic_sdbus_result_set(result, RPC_SD_BUS_RESPONSE_HANDLE, call->response_handle, LYD_ANYDATA_STRING);
+			if (rc == SR_ERR_OK) {
+				rc = generic_sdbus_result_set(result, RPC_SD_BUS_RESPONSE_SIZE, size_string, LYD_ANYDATA_STRING);
+			}
+		} else if (options.response_format == BUS_DECODE_FORMAT_XML) {
+			// a reply without arguments has no typed data
+			if (call->response != NULL) {
+				// libyang takes over the decoded XML instead of copying it
+				tmp = call->response;
+				call->response = NULL;
+				rc = generic_sdbus_result_set(result, RPC_SD_BUS_DATA, tmp, LYD_ANYDATA_SXMLD);
+			}
+		} else {
+			rc = generic_sdbus_result_set(result, RPC_SD_BUS_RESPONSE, (void *) call->response, LYD_ANYDATA_STRING);
+		}
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		rc = generic_sdbus_result_set(result, RPC_SD_BUS_REPLY_SIGNATURE, (void *) call->reply_signature, LYD_ANYDATA_STRING);
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		output_duration = bus_metrics_now() - output_begin;
+		BUS_TRACE(output__end, call->method, i, 0, output_duration);
+		bus_metrics_phase_record(bus_metrics, call, BUS_METRICS_PHASE_OUTPUT, output_duration);
+		bus_call_release(call);
+	}
+
+cleanup:
+	for (size_t i = 0; i < calls_count; i++) {
+		bus_call_release(&calls[i]);
+	}
+	free(calls);
+
+	BUS_TRACE(rpc__return, op_path, calls_count, rc, bus_metrics_now() - rpc_begin);
+
+	return rc;
+}
+
+/*
+ * @brief Callback for sd-bus properties RPC method. Used to read and write
+ *        sd-bus properties in a batch.
+ *        Properties read from the same object and interface are served by a
+ *        single GetAll call, every written property gets its own Set call.
+ *        The calls are run like the entries of sd-bus-call and every property
+ *        gets its own result keyed by its index in the request.
+ *
+ * @param[in] xpath xpath to the module RPC.
+ * @param[in] input sysrepo RPC input data.
+ * @param[out] output sysrepo RPC output data to be set.
+ * @param[in] private_ctx bus connection pool used to reach the sd-bus services.
+ *
+ * @return error code.
+ */
+int generic_sdbus_properties_rpc_tree_cb(sr_session_ctx_t *session, const char *op_path,
+										 const struct lyd_node *input, sr_event_t event,
+										 uint32_t request_id, struct lyd_node *output,
+										 void *private_data)
+{
+	int rc = SR_ERR_OK;
+	bus_connection_pool_t *connections = (bus_connection_pool_t *) private_data;
+	bus_property_t *properties = NULL;
+	size_t properties_count = 0;
+	bus_property_batch_t property_batch = {0};
+	generic_sdbus_options_t options = {.max_in_flight = RPC_SD_BUS_MAX_IN_FLIGHT_DEFAULT};
+	generic_sdbus_batch_t batch = {0};
+	struct lyd_node *node = NULL;
+	struct lyd_node *result = NULL;
+	void *tmp = NULL;
+	uint64_t rpc_begin = bus_metrics_now();
+
+	BUS_TRACE(rpc__entry, op_path);
+
+	if (NULL == input) {
+		rc = SR_ERR_INTERNAL;
+		SRP_LOG_ERRMSG("input is invalid");
+		goto cleanup;
+	}
+
+	LY_TREE_FOR(input->child, node)
+	{
+		if (node->schema == NULL) {
+			continue;
+		}
+
+		if (node->schema == rpc_properties_schema.entry) {
+			tmp = realloc(properties, sizeof(bus_property_t) * (properties_count + 1));
+			if (NULL == tmp) {
+				rc = SR_ERR_NOMEM;
+				goto cleanup;
+			}
+			properties = tmp;
+			memset(&properties[properties_count], 0, sizeof(bus_property_t));
+			properties_count++;
+
+			rc = generic_sdbus_property_input_parse(&rpc_properties_schema, node, &properties[properties_count - 1]);
+			if (rc != SR_ERR_OK) {
+				goto cleanup;
+			}
+		} else {
+			generic_sdbus_option_parse(&rpc_properties_schema, node, &options);
+		}
+	}
+
+	rc = bus_property_batch_create(&property_batch, properties, properties_count, options.arguments_format);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to group sd-bus properties: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	batch.calls = property_batch.calls;
+	batch.calls_count = property_batch.calls_count;
+	batch.pipelined = options.pipelined;
+	batch.max_in_flight = options.max_in_flight ? options.max_in_flight : 1;
+	batch.deadline_usec = bus_call_deadline(options.rpc_timeout_usec);
+	// the GetAll replies are picked apart below, only the requested properties are decoded
+	batch.decode = false;
+	batch.metrics = bus_metrics;
+
+	rc = generic_sdbus_batch_run(&batch, options.threaded, connections);
+	if (rc != SR_ERR_OK) {
+		goto cleanup;
+	}
+
+	rc = bus_property_batch_collect(&property_batch, properties, properties_count, options.response_format);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to collect sd-bus properties: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	for (size_t i = 0; i < properties_count; i++) {
+		bus_property_t *property = &properties[i];
+
+		rc = generic_sdbus_result_create(output, RPC_SD_BUS_PROPERTY_RESULT, i, &result);
+		if (rc == SR_ERR_OK) {
+			rc = generic_sdbus_result_set(result, RPC_SD_BUS_PROPERTY_NAME, (void *) property->name, LYD_ANYDATA_STRING);
+		}
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		if (property->error < 0) {
+			SRP_LOG_ERR("failed to access sd-bus property %s: %s", property->name, strerror(-property->error));
+			rc = generic_sdbus_result_error_set(result, property->error, &property->bus_error);
+			if (rc != SR_ERR_OK) {
+				goto cleanup;
+			}
+			continue;
+		}
+
+		rc = generic_sdbus_result_set(result, RPC_SD_BUS_STATUS, RPC_SD_BUS_STATUS_OK, LYD_ANYDATA_STRING);
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		// written properties only report their status
+		if (property->signature == NULL) {
+			continue;
+		}
+
+		if (options.response_format == BUS_DECODE_FORMAT_XML) {
+			if (property->response != NULL) {
+				// libyang takes over the decoded XML instead of copying it
+				tmp = property->response;
+				property->response = NULL;
+				rc = generic_sdbus_result_set(result, RPC_SD_BUS_DATA, tmp, LYD_ANYDATA_SXMLD);
+			}
+		} else {
+			rc = generic_sdbus_result_set(result, RPC_SD_BUS_RESPONSE, (void *) property->response, LYD_ANYDATA_STRING);
+		}
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+
+		rc = generic_sdbus_result_set(result, RPC_SD_BUS_REPLY_SIGNATURE, (void *) property->signature, LYD_ANYDATA_STRING);
+		if (rc != SR_ERR_OK) {
+			goto cleanup;
+		}
+	}
+
+cleanup:
+	bus_property_batch_release(&property_batch);
+	for (size_t i = 0; i < properties_count; i++) {
+		bus_property_release(&properties[i]);
+	}
+	free(properties);
+
+	BUS_TRACE(rpc__return, op_path, properties_count, rc, bus_metrics_now() - rpc_begin);
+
+	return rc;
+}
+
+/*
+ * @brief Reads the key of a watched object from a sd-bus-watched-object entry.
+ *
+ * @param[in] list sd-bus-watched-object list entry.
+ * @param[out] key key of the watched object, its strings point into the tree.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_watch_key_parse(const struct lyd_node *list, bus_watch_key_t *key)
+{
+	const char *sd_bus_bus = NULL;
+	struct lyd_node *node = NULL;
+
+	LY_TREE_FOR(list->child, node)
+	{
+		if (node->schema == NULL || node->schema->nodetype != LYS_LEAF) {
+			continue;
+		}
+
+		if (strcmp(RPC_SD_BUS, node->schema->name) == 0) {
+			sd_bus_bus = ((struct lyd_node_leaf_list *) node)->value.enm->name;
+		} else if (strcmp(RPC_SD_BUS_SERVICE, node->schema->name) == 0) {
+			key->service = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(RPC_SD_BUS_OBJPATH, node->schema->name) == 0) {
+			key->object_path = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(RPC_SD_BUS_INTERFACE, node->schema->name) == 0) {
+			key->interface = ((struct lyd_node_leaf_list *) node)->value.string;
+		}
+	}
+
+	if (sd_bus_bus == NULL || key->service == NULL || key->object_path == NULL || key->interface == NULL) {
+		SRP_LOG_ERRMSG("incomplete sd-bus-watched-object entry");
+		return SR_ERR_VALIDATION_FAILED;
+	}
+
+	if (bus_connection_type_parse(sd_bus_bus, &key->bus_type) < 0) {
+		SRP_LOG_ERR("unknown sd-bus type: %s", sd_bus_bus);
+		return SR_ERR_INVAL_ARG;
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Reads a sd-bus-signal-subscription entry.
+ *
+ * @param[in] list sd-bus-signal-subscription list entry.
+ * @param[out] key match rule of the subscription, its strings point into the tree.
+ *
+ * @return error code.
+ */
+static int generic_sdbus_signal_key_parse(const struct lyd_node *list, bus_watch_signal_key_t *key)
+{
+	const char *sd_bus_bus = NULL;
+	struct lyd_node *node = NULL;
+
+	LY_TREE_FOR(list->child, node)
+	{
+		if (node->schema == NULL || node->schema->nodetype != LYS_LEAF) {
+			continue;
+		}
+
+		if (strcmp(SIGNAL_SD_BUS_SUBSCRIPTION, node->schema->name) == 0) {
+			key->name = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(RPC_SD_BUS, node->schema->name) == 0) {
+			sd_bus_bus = ((struct lyd_node_leaf_list *) node)->value.enm->name;
+		} else if (strcmp(SIGNAL_SD_BUS_SENDER, node->schema->name) == 0) {
+			key->sender = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(RPC_SD_BUS_OBJPATH, node->schema->name) == 0) {
+			key->object_path = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(RPC_SD_BUS_INTERFACE, node->schema->name) == 0) {
+			key->interface = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(SIGNAL_SD_BUS_MEMBER, node->schema->name) == 0) {
+			key->member = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(SIGNAL_SD_BUS_ARG0, node->schema->name) == 0) {
+			key->arg0 = ((struct lyd_node_leaf_list *) node)->value.string;
+		} else if (strcmp(SIGNAL_SD_BUS_COALESCE_WINDOW, node->schema->name) == 0) {
+			key->coalesce_usec = ((struct lyd_node_leaf_list *) node)->value.uint32 * USEC_PER_MSEC;
+		}
+	}
+
+	if (key->name == NULL || sd_bus_bus == NULL) {
+		SRP_LOG_ERRMSG("incomplete sd-bus-signal-subscription entry");
+		return SR_ERR_VALIDATION_FAILED;
+	}
+
+	if (bus_connection_type_parse(sd_bus_bus, &key->bus_type) < 0) {
+		SRP_LOG_ERR("unknown sd-bus type: %s", sd_bus_bus);
+		return SR_ERR_INVAL_ARG;
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Callback for changes of the sd-bus-watch configuration. Hands the
+ *        whole set of watched objects and signal subscriptions to the watcher
+ *        once the change is applied, the watcher subscribes to new entries
+ *        and drops the rest.
+ *
+ * @param[in] session session context of the change.
+ * @param[in] module_name name of the changed module.
+ * @param[in] xpath subscription xpath.
+ * @param[in] event change event.
+ * @param[in] request_id request id.
+ * @param[in] private_data the bus watcher.
+ *
+ * @return error code.
+ */
+int generic_sdbus_watch_change_cb(sr_session_ctx_t *session, const char *module_name,
+								  const char *xpath, sr_event_t event,
+								  uint32_t request_id, void *private_data)
+{
+	int rc = SR_ERR_OK;
+	bus_watch_t *watch = (bus_watch_t *) private_data;
+	struct lyd_node *data = NULL;
+	struct lyd_node *node = NULL;
+	bus_watch_key_t *keys = NULL;
+	size_t keys_count = 0;
+	bus_watch_signal_key_t *signal_keys = NULL;
+	size_t signal_keys_count = 0;
+
+	if (event != SR_EV_DONE && event != SR_EV_ENABLED) {
+		return SR_ERR_OK;
+	}
+
+	rc = sr_get_data(session, WATCH_SD_BUS_PATH "//.", 0, 0, SR_OPER_DEFAULT, &data);
+	if (rc != SR_ERR_OK) {
+		SRP_LOG_ERR("sr_get_data error: %s", sr_strerror(rc));
+		goto cleanup;
+	}
+
+	if (data != NULL) {
+		LY_TREE_FOR(data->child, node)
+		{
+			keys_count++;
+		}
+	}
+
+	keys = calloc(keys_count ? keys_count : 1, sizeof(bus_watch_key_t));
+	signal_keys = calloc(keys_count ? keys_count : 1, sizeof(bus_watch_signal_key_t));
+	if (keys == NULL || signal_keys == NULL) {
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	keys_count = 0;
+	if (data != NULL) {
+		LY_TREE_FOR(data->child, node)
+		{
+			if (node->schema == NULL || node->schema->nodetype != LYS_LIST) {
+				continue;
+			}
+
+			// a broken entry does not stop the others from being watched
+			if (strcmp(WATCH_SD_BUS_OBJECT, node->schema->name) == 0) {
+				if (generic_sdbus_watch_key_parse(node, &keys[keys_count]) == SR_ERR_OK) {
+					keys_count++;
+				}
+			} else if (strcmp(WATCH_SD_BUS_SIGNAL_SUBSCRIPTION, node->schema->name) == 0) {
+				if (generic_sdbus_signal_key_parse(node, &signal_keys[signal_keys_count]) == SR_ERR_OK) {
+					signal_keys_count++;
+				}
+			}
+		}
+	}
+
+	rc = bus_watch_set(watch, keys, keys_count);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to update watched sd-bus objects: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	rc = bus_watch_signals_set(watch, signal_keys, signal_keys_count);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to update sd-bus signal subscriptions: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+cleanup:
+	free(signal_keys);
+	free(keys);
+	lyd_free_withsiblings(data);
+
+	return rc;
+}
+
+/*
+ * @brief Adds a leaf of a watched object to the operational data.
+ *
+ * @param[in] oper operational data being built.
+ * @param[in] object xpath of the watched object.
+ * @param[in] property name of the property, NULL for a leaf of the object itself.
+ * @param[in] name name of the leaf.
+ * @param[in] value value of the leaf.
+ */
+static void generic_sdbus_watch_leaf_set(generic_sdbus_oper_t *oper, const char *object, const char *property,
+										 const char *name, const char *value)
+{
+	char *xpath = NULL;
+	int xpath_size = 0;
+	struct lyd_node *node = NULL;
+
+	if (property == NULL) {
+		xpath_size = snprintf(NULL, 0, WATCH_SD_BUS_LEAF_XPATH, object, name) + 1;
+	} else {
+		xpath_size = snprintf(NULL, 0, WATCH_SD_BUS_PROPERTY_XPATH, object, property, name) + 1;
+	}
+
+	xpath = malloc((size_t) xpath_size);
+	if (xpath == NULL) {
+		oper->error = SR_ERR_NOMEM;
+		return;
+	}
+
+	if (property == NULL) {
+		snprintf(xpath, (size_t) xpath_size, WATCH_SD_BUS_LEAF_XPATH, object, name);
+	} else {
+		snprintf(xpath, (size_t) xpath_size, WATCH_SD_BUS_PROPERTY_XPATH, object, property, name);
+	}
+
+	if (*oper->parent == NULL) {
+		node = lyd_new_path(NULL, oper->ctx, xpath, (void *) value, LYD_ANYDATA_STRING, 0);
+		*oper->parent = node;
+	} else {
+		node = lyd_new_path(*oper->parent, NULL, xpath, (void *) value, LYD_ANYDATA_STRING, 0);
+	}
+	if (node == NULL) {
+		SRP_LOG_ERR("failed to create %s", xpath);
+		oper->error = SR_ERR_LY;
+	}
+
+	free(xpath);
+}
+
+/*
+ * @brief Visits the cached state of a watched object, called with the cache locked.
+ */
+static void generic_sdbus_watch_visit_cb(const bus_watch_key_t *key, bool synchronized, const char *name,
+										 const char *signature, const char *value, void *userdata)
+{
+	generic_sdbus_oper_t *oper = (generic_sdbus_oper_t *) userdata;
+	const char *bus_type = bus_connection_type_name(key->bus_type);
+	char *object = NULL;
+	int object_size = 0;
+
+	if (oper->error != SR_ERR_OK || bus_type == NULL) {
+		return;
+	}
+
+	object_size = snprintf(NULL, 0, WATCH_SD_BUS_OBJECT_XPATH, bus_type, key->service, key->object_path, key->interface) + 1;
+	object = malloc((size_t) object_size);
+	if (object == NULL) {
+		oper->error = SR_ERR_NOMEM;
+		return;
+	}
+	snprintf(object, (size_t) object_size, WATCH_SD_BUS_OBJECT_XPATH, bus_type, key->service, key->object_path, key->interface);
+
+	if (name == NULL) {
+		generic_sdbus_watch_leaf_set(oper, object, NULL, WATCH_SD_BUS_SYNCHRONIZED, synchronized ? "true" : "false");
+	} else {
+		generic_sdbus_watch_leaf_set(oper, object, name, RPC_SD_BUS_REPLY_SIGNATURE, signature);
+		if (value != NULL) {
+			generic_sdbus_watch_leaf_set(oper, object, name, RPC_SD_BUS_RESPONSE, value);
+		}
+	}
+
+	free(object);
+}
+
+/*
+ * @brief Callback for operational data of the watched sd-bus objects. Served
+ *        from the property cache of the watcher without any sd-bus call.
+ *
+ * @param[in] session session context of the request.
+ * @param[in] module_name name of the requested module.
+ * @param[in] path subscription path.
+ * @param[in] request_xpath requested xpath.
+ * @param[in] request_id request id.
+ * @param[in,out] parent operational data tree.
+ * @param[in] private_data the bus watcher.
+ *
+ * @return error code.
+ */
+int generic_sdbus_watch_oper_cb(sr_session_ctx_t *session, const char *module_name,
+								const char *path, const char *request_xpath,
+								uint32_t request_id, struct lyd_node **parent,
+								void *private_data)
+{
+	generic_sdbus_oper_t oper = {
+		.ctx = sr_get_context(sr_session_get_connection(session)),
+		.parent = parent,
+		.error = SR_ERR_OK,
+	};
+
+	bus_watch_foreach((bus_watch_t *) private_data, generic_sdbus_watch_visit_cb, &oper);
 
-#define RPC_SD_BUS_METHOD_XPATH "/generic-sd-bus:sd-bus-call/" \
-								"sd-bus-result[sd-bus-method='%s']/sd-bus-method"
-#define RPC_SD_BUS_RESPONSE_XPATH "/generic-sd-bus:sd-bus-call/" \
-								  "sd-bus-result[sd-bus-method='%s']/sd-bus-response"
-#define RPC_SD_BUS_SIGNATURE_XPATH "/generic-sd-bus:sd-bus-call/" \
-								   "sd-bus-result[sd-bus-method='%s']/sd-bus-signature"
+	return oper.error;
+}
 
 /*
- * @brief Callback for sd-bus call RPC method. Used to invoke an sd-bus call and
- *        retreive sd-bus call result data.
+ * @brief Callback for changes of the sd-bus-cache configuration. Replaces the
+ *        allow-list and the memory cap of the response cache once the change
+ *        is applied, dropping everything cached so far.
  *
- * @param[in] xpath xpath to the module RPC.
- * @param[in] input sysrepo RPC input data.
- * @param[out] output sysrepo RPC output data to be set.
- * @param[in] private_ctx context being passed to the callback function.
+ * @param[in] session session context of the change.
+ * @param[in] module_name name of the changed module.
+ * @param[in] xpath subscription xpath.
+ * @param[in] event change event.
+ * @param[in] request_id request id.
+ * @param[in] private_data the response cache.
  *
  * @return error code.
  */
-int generic_sdbus_call_rpc_tree_cb(sr_session_ctx_t *session, const char *op_path,
-								   const struct lyd_node *input, sr_event_t event,
-								   uint32_t request_id, struct lyd_node *output,
-								   void *private_data)
+int generic_sdbus_cache_change_cb(sr_session_ctx_t *session, const char *module_name,
+								  const char *xpath, sr_event_t event,
+								  uint32_t request_id, void *private_data)
 {
 	int rc = SR_ERR_OK;
-	char *xpath = NULL;
-	const char *sd_bus_bus = NULL;
-	const char *sd_bus_service = NULL;
-	const char *sd_bus_object_path = NULL;
-	const char *sd_bus_interface = NULL;
-	const char *sd_bus_method = NULL;
-	const char *sd_bus_method_signature = NULL;
-	const char *sd_bus_method_arguments = NULL;
-	char *sd_bus_reply_string = NULL;
-	const char *sd_bus_reply_signature = NULL;
-	sd_bus *bus = NULL;
-	sd_bus_message *sd_message = NULL;
-	sd_bus_message *sd_message_reply = NULL;
-	sd_bus_error *error = NULL;
+	bus_cache_t *cache = (bus_cache_t *) private_data;
+	struct lyd_node *data = NULL;
 	struct lyd_node *node = NULL;
-	struct lyd_node *child = NULL;
-	struct lyd_node *next = NULL;
-	struct lyd_node *ret = NULL;
+	struct lyd_node *leaf = NULL;
+	bus_cache_rule_t *rules = NULL;
+	size_t rules_count = 0;
+	uint64_t max_bytes = CACHE_SD_BUS_SIZE_DEFAULT;
 
-	if (NULL == input) {
-		rc = SR_ERR_INTERNAL;
-		SRP_LOG_ERRMSG("input is invalid");
+	if (event != SR_EV_DONE && event != SR_EV_ENABLED) {
+		return SR_ERR_OK;
+	}
+
+	rc = sr_get_data(session, CACHE_SD_BUS_PATH "//.", 0, 0, SR_OPER_DEFAULT, &data);
+	if (rc != SR_ERR_OK) {
+		SRP_LOG_ERR("sr_get_data error: %s", sr_strerror(rc));
 		goto cleanup;
 	}
 
-	LY_TREE_FOR(input->child, child)
-	{
-		LY_TREE_DFS_BEGIN(child, next, node)
+	if (data != NULL) {
+		LY_TREE_FOR(data->child, node)
+		{
+			rules_count++;
+		}
+	}
+
+	rules = calloc(rules_count ? rules_count : 1, sizeof(bus_cache_rule_t));
+	if (rules == NULL) {
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	rules_count = 0;
+	if (data != NULL) {
+		LY_TREE_FOR(data->child, node)
 		{
-			if (node->schema) {
-				if (node->schema->nodetype == LYS_LEAF) {
-					if (strcmp(RPC_SD_BUS, node->schema->name) == 0) {
-						sd_bus_bus = ((struct lyd_node_leaf_list *) node)->value.enm->name;
-					} else if (strcmp(RPC_SD_BUS_SERVICE, node->schema->name) == 0) {
-						sd_bus_service = ((struct lyd_node_leaf_list *) node)->value.string;
-					} else if (strcmp(RPC_SD_BUS_OBJPATH, node->schema->name) == 0) {
-						sd_bus_object_path = ((struct lyd_node_leaf_list *) node)->value.string;
-					} else if (strcmp(RPC_SD_BUS_INTERFACE, node->schema->name) == 0) {
-						sd_bus_interface = ((struct lyd_node_leaf_list *) node)->value.string;
-					} else if (strcmp(RPC_SD_BUS_METHOD, node->schema->name) == 0) {
-						sd_bus_method = ((struct lyd_node_leaf_list *) node)->value.string;
-					} else if (strcmp(RPC_SD_BUS_SIGNATURE, node->schema->name) == 0) {
-						sd_bus_method_signature = ((struct lyd_node_leaf_list *) node)->value.string;
-					} else if (strcmp(RPC_SD_BUS_ARGUMENTS, node->schema->name) == 0) {
-						sd_bus_method_arguments = ((struct lyd_node_leaf_list *) node)->value.string;
-					}
+			if (node->schema == NULL) {
+				continue;
+			}
+
+			if (node->schema->nodetype == LYS_LEAF && strcmp(CACHE_SD_BUS_SIZE, node->schema->name) == 0) {
+				max_bytes = ((struct lyd_node_leaf_list *) node)->value.uint64;
+				continue;
+			}
+
+			if (node->schema->nodetype != LYS_LIST || strcmp(CACHE_SD_BUS_METHOD, node->schema->name) != 0) {
+				continue;
+			}
+
+			LY_TREE_FOR(node->child, leaf)
+			{
+				if (leaf->schema == NULL || leaf->schema->nodetype != LYS_LEAF) {
+					continue;
 				}
-				if ((node->schema->nodetype == LYS_LIST || !child->next) &&
-					sd_bus_bus != NULL && sd_bus_service != NULL &&
-					sd_bus_object_path != NULL && sd_bus_interface != NULL &&
-					sd_bus_method != NULL && sd_bus_method_signature != NULL && sd_bus_method_arguments != NULL) {
-					if (strcmp(sd_bus_bus, "SYSTEM") == 0)
-						rc = sd_bus_open_system(&bus);
-					else
-						rc = sd_bus_open_user(&bus);
-					if (rc < SR_ERR_OK) {
-						SRP_LOG_ERR("failed to connect to system bus: %s", strerror(-rc));
-						goto cleanup;
-					}
-
-					rc = sd_bus_message_new_method_call(
-						bus, &sd_message, sd_bus_service, sd_bus_object_path,
-						sd_bus_interface, sd_bus_method);
-					if (rc < SR_ERR_OK) {
-						SRP_LOG_ERR("failed to create a new message: %s", strerror(-rc));
-						goto cleanup;
-					}
-
-					rc = bus_message_encode(sd_bus_method_signature, sd_bus_method_arguments, sd_message);
-					if (rc < SR_ERR_OK) {
-						SRP_LOG_ERR("failed to parse reply: %s", strerror(-rc));
-						goto cleanup;
-					}
-
-					rc = sd_bus_call(bus, sd_message, 0, error, &sd_message_reply);
-					if (rc < SR_ERR_OK) {
-						SRP_LOG_ERR("failed to call sd-bus method: %s", strerror(-rc));
-						goto cleanup;
-					}
-
-					sd_bus_reply_signature = sd_bus_message_get_signature(sd_message_reply, 1);
-					if (NULL == sd_bus_reply_signature) {
-						rc = SR_ERR_INTERNAL;
-						SRP_LOG_ERRMSG("failed get reply message signature");
-						goto cleanup;
-					}
-
-					rc = bus_message_decode(sd_message_reply, &sd_bus_reply_string);
-					if (rc < SR_ERR_OK) {
-						SRP_LOG_ERR("failed to parse reply: %s", strerror(-rc));
-						goto cleanup;
-					}
-
-					xpath = realloc(xpath, strlen(RPC_SD_BUS_METHOD_XPATH) + strlen(sd_bus_method) + 1);
-					sprintf(xpath, RPC_SD_BUS_METHOD_XPATH, sd_bus_method);
-					ret = lyd_new_path(output, NULL, xpath, (void *) sd_bus_method, LYD_ANYDATA_STRING, LYD_PATH_OPT_OUTPUT);
-					if (NULL == ret) {
-						rc = SR_ERR_INTERNAL;
-						SRP_LOG_ERRMSG("failed to set output");
-						goto cleanup;
-					}
-
-					xpath = realloc(xpath, strlen(RPC_SD_BUS_RESPONSE_XPATH) + strlen(sd_bus_method) + 1);
-					sprintf(xpath, RPC_SD_BUS_RESPONSE_XPATH, sd_bus_method);
-					ret = lyd_new_path(output, NULL, xpath, (void *) sd_bus_reply_string, LYD_ANYDATA_STRING, LYD_PATH_OPT_OUTPUT);
-					if (NULL == ret) {
-						rc = SR_ERR_INTERNAL;
-						SRP_LOG_ERRMSG("failed to set output");
-						goto cleanup;
-					}
-
-					xpath = realloc(xpath, strlen(RPC_SD_BUS_SIGNATURE_XPATH) + strlen(sd_bus_method) + 1);
-					sprintf(xpath, RPC_SD_BUS_SIGNATURE_XPATH, sd_bus_method);
-					ret = lyd_new_path(output, NULL, xpath, (void *) sd_bus_reply_signature, LYD_ANYDATA_STRING, LYD_PATH_OPT_OUTPUT);
-					if (NULL == ret) {
-						rc = SR_ERR_INTERNAL;
-						SRP_LOG_ERRMSG("failed to set output");
-						goto cleanup;
-					}
-
-					sd_bus_bus = NULL;
-					sd_bus_service = NULL;
-					sd_bus_object_path = NULL;
-					sd_bus_interface = NULL;
-					sd_bus_method = NULL;
-					sd_bus_method_signature = NULL;
-					sd_bus_method_arguments = NULL;
-
-					free(sd_bus_reply_string);
-					sd_bus_reply_string = NULL;
-					sd_bus_error_free(error);
-					sd_message = sd_bus_message_unref(sd_message);
-					sd_message_reply = sd_bus_message_unref(sd_message_reply);
-					bus = sd_bus_close_unref(bus);
+
+				if (strcmp(RPC_SD_BUS_SERVICE, leaf->schema->name) == 0) {
+					rules[rules_count].service = ((struct lyd_node_leaf_list *) leaf)->value.string;
+				} else if (strcmp(RPC_SD_BUS_INTERFACE, leaf->schema->name) == 0) {
+					rules[rules_count].interface = ((struct lyd_node_leaf_list *) leaf)->value.string;
+				} else if (strcmp(RPC_SD_BUS_METHOD, leaf->schema->name) == 0) {
+					rules[rules_count].method = ((struct lyd_node_leaf_list *) leaf)->value.string;
+				} else if (strcmp(CACHE_SD_BUS_TTL, leaf->schema->name) == 0) {
+					rules[rules_count].ttl_usec = ((struct lyd_node_leaf_list *) leaf)->value.uint32 * USEC_PER_MSEC;
 				}
 			}
 
-			LY_TREE_DFS_END(child, next, node)
-		};
-	};
+			if (rules[rules_count].service == NULL || rules[rules_count].interface == NULL ||
+				rules[rules_count].method == NULL || rules[rules_count].ttl_usec == 0) {
+				SRP_LOG_ERRMSG("incomplete sd-bus-cached-method entry");
+				memset(&rules[rules_count], 0, sizeof(bus_cache_rule_t));
+				continue;
+			}
+			rules_count++;
+		}
+	}
+
+	rc = bus_cache_configure(cache, rules, rules_count, (size_t) max_bytes);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to configure the sd-bus response cache: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
 cleanup:
-	free(xpath);
-	sd_bus_message_unref(sd_message);
-	sd_message_reply = sd_bus_message_unref(sd_message_reply);
-	sd_bus_error_free(error);
-	sd_bus_close_unref(bus);
-	free(sd_bus_reply_string);
+	free(rules);
+	lyd_free_withsiblings(data);
+
+	return rc;
+}
+
+/*
+ * @brief Callback for changes of the sd-bus-offload configuration. Replaces
+ *        the threshold, the spool directory, the retention and the size limit
+ *        of offloaded replies, replies offloaded so far stay until they expire
+ *        or are evicted by a lower size limit.
+ *
+ * @param[in] session session context of the change.
+ * @param[in] module_name name of the changed module.
+ * @param[in] xpath subscription xpath.
+ * @param[in] event change event.
+ * @param[in] request_id request id.
+ * @param[in] private_data the reply offload.
+ *
+ * @return error code.
+ */
+int generic_sdbus_offload_change_cb(sr_session_ctx_t *session, const char *module_name,
+									const char *xpath, sr_event_t event,
+									uint32_t request_id, void *private_data)
+{
+	int rc = SR_ERR_OK;
+	bus_offload_t *offload = (bus_offload_t *) private_data;
+	struct lyd_node *data = NULL;
+	struct lyd_node *node = NULL;
+	uint64_t threshold = 0;
+	const char *directory = NULL;
+	uint64_t retention_usec = OFFLOAD_SD_BUS_RETENTION_DEFAULT * USEC_PER_SEC;
+	uint64_t max_bytes = OFFLOAD_SD_BUS_SIZE_DEFAULT;
+
+	if (event != SR_EV_DONE && event != SR_EV_ENABLED) {
+		return SR_ERR_OK;
+	}
+
+	rc = sr_get_data(session, OFFLOAD_SD_BUS_PATH "//.", 0, 0, SR_OPER_DEFAULT, &data);
+	if (rc != SR_ERR_OK) {
+		SRP_LOG_ERR("sr_get_data error: %s", sr_strerror(rc));
+		goto cleanup;
+	}
+
+	if (data != NULL) {
+		LY_TREE_FOR(data->child, node)
+		{
+			if (node->schema == NULL || node->schema->nodetype != LYS_LEAF) {
+				continue;
+			}
+
+			if (strcmp(OFFLOAD_SD_BUS_THRESHOLD, node->schema->name) == 0) {
+				threshold = ((struct lyd_node_leaf_list *) node)->value.uint64;
+			} else if (strcmp(OFFLOAD_SD_BUS_DIRECTORY, node->schema->name) == 0) {
+				directory = ((struct lyd_node_leaf_list *) node)->value.string;
+			} else if (strcmp(OFFLOAD_SD_BUS_RETENTION, node->schema->name) == 0) {
+				retention_usec = ((struct lyd_node_leaf_list *) node)->value.uint32 * USEC_PER_SEC;
+			} else if (strcmp(OFFLOAD_SD_BUS_SIZE, node->schema->name) == 0) {
+				max_bytes = ((struct lyd_node_leaf_list *) node)->value.uint64;
+			}
+		}
+	}
+
+	rc = bus_offload_configure(offload, (size_t) threshold, directory, retention_usec, (size_t) max_bytes);
+	if (rc < 0) {
+		SRP_LOG_ERR("failed to configure the sd-bus reply offload: %s", strerror(-rc));
+		rc = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+cleanup:
+	lyd_free_withsiblings(data);
 
 	return rc;
 }
 
+/*
+ * @brief Callback for the operational counters of the reply offload.
+ *
+ * @param[in] session session context of the request.
+ * @param[in] module_name name of the requested module.
+ * @param[in] path subscription path.
+ * @param[in] request_xpath requested xpath.
+ * @param[in] request_id request id.
+ * @param[in,out] parent operational data tree.
+ * @param[in] private_data the reply offload.
+ *
+ * @return error code.
+ */
+int generic_sdbus_offload_oper_cb(sr_session_ctx_t *session, const char *module_name,
+								  const char *path, const char *request_xpath,
+								  uint32_t request_id, struct lyd_node **parent,
+								  void *private_data)
+{
+	bus_offload_stats_t stats = {0};
+	const char *names[] = {OFFLOAD_SD_BUS_EVICTIONS, OFFLOAD_SD_BUS_ENTRIES, OFFLOAD_SD_BUS_BYTES};
+	uint64_t values[3] = {0};
+	char xpath[RPC_SD_BUS_RESULT_XPATH_SIZE] = {0};
+	char value[32] = {0};
+	const struct ly_ctx *ctx = sr_get_context(sr_session_get_connection(session));
+	struct lyd_node *node = NULL;
+
+	// expired replies are not reported even while no RPC released them
+	bus_offload_stats((bus_offload_t *) private_data, &stats);
+	values[0] = stats.evictions;
+	values[1] = stats.entries;
+	values[2] = stats.bytes;
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		snprintf(xpath, sizeof(xpath), "%s/%s", OFFLOAD_SD_BUS_PATH, names[i]);
+		snprintf(value, sizeof(value), "%" PRIu64, values[i]);
+
+		node = lyd_new_path(*parent, (*parent == NULL) ? ctx : NULL, xpath, value, LYD_ANYDATA_STRING, 0);
+		if (node == NULL) {
+			SRP_LOG_ERR("failed to create %s", xpath);
+			return SR_ERR_LY;
+		}
+		if (*parent == NULL) {
+			*parent = node;
+		}
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Callback for the operational counters of the response cache.
+ *
+ * @param[in] session session context of the request.
+ * @param[in] module_name name of the requested module.
+ * @param[in] path subscription path.
+ * @param[in] request_xpath requested xpath.
+ * @param[in] request_id request id.
+ * @param[in,out] parent operational data tree.
+ * @param[in] private_data the response cache.
+ *
+ * @return error code.
+ */
+int generic_sdbus_cache_oper_cb(sr_session_ctx_t *session, const char *module_name,
+								const char *path, const char *request_xpath,
+								uint32_t request_id, struct lyd_node **parent,
+								void *private_data)
+{
+	bus_cache_stats_t stats = {0};
+	const char *names[] = {CACHE_SD_BUS_HITS, CACHE_SD_BUS_MISSES, CACHE_SD_BUS_EVICTIONS, CACHE_SD_BUS_ENTRIES, CACHE_SD_BUS_BYTES};
+	uint64_t values[5] = {0};
+	char xpath[RPC_SD_BUS_RESULT_XPATH_SIZE] = {0};
+	char value[32] = {0};
+	const struct ly_ctx *ctx = sr_get_context(sr_session_get_connection(session));
+	struct lyd_node *node = NULL;
+
+	bus_cache_stats((bus_cache_t *) private_data, &stats);
+	values[0] = stats.hits;
+	values[1] = stats.misses;
+	values[2] = stats.evictions;
+	values[3] = stats.entries;
+	values[4] = stats.bytes;
+
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		snprintf(xpath, sizeof(xpath), "%s/%s", CACHE_SD_BUS_PATH, names[i]);
+		snprintf(value, sizeof(value), "%" PRIu64, values[i]);
+
+		node = lyd_new_path(*parent, (*parent == NULL) ? ctx : NULL, xpath, value, LYD_ANYDATA_STRING, 0);
+		if (node == NULL) {
+			SRP_LOG_ERR("failed to create %s", xpath);
+			return SR_ERR_LY;
+		}
+		if (*parent == NULL) {
+			*parent = node;
+		}
+	}
+
+	return SR_ERR_OK;
+}
+
+/*
+ * @brief Sets a leaf of the metrics of a method.
+ *
+ * @param[in,out] oper operational data being built.
+ * @param[in] target xpath of the sd-bus-target entry.
+ * @param[in] name path of the leaf relative to the entry.
+ * @param[in] value value of the leaf.
+ */
+static void generic_sdbus_metrics_leaf_set(generic_sdbus_oper_t *oper, const char *target, const char *name, uint64_t value)
+{
+	char *xpath = NULL;
+	int xpath_size = 0;
+	char value_string[32] = {0};
+	struct lyd_node *node = NULL;
+
+	if (oper->error != SR_ERR_OK) {
+		return;
+	}
+
+	xpath_size = snprintf(NULL, 0, METRICS_SD_BUS_LEAF_XPATH, target, name) + 1;
+	xpath = malloc((size_t) xpath_size);
+	if (xpath == NULL) {
+		oper->error = SR_ERR_NOMEM;
+		return;
+	}
+	snprintf(xpath, (size_t) xpath_size, METRICS_SD_BUS_LEAF_XPATH, target, name);
+	snprintf(value_string, sizeof(value_string), "%" PRIu64, value);
+
+	node = lyd_new_path(*oper->parent, (*oper->parent == NULL) ? oper->ctx : NULL, xpath, value_string, LYD_ANYDATA_STRING, 0);
+	if (node == NULL) {
+		SRP_LOG_ERR("failed to create %s", xpath);
+		oper->error = SR_ERR_LY;
+	} else if (*oper->parent == NULL) {
+		*oper->parent = node;
+	}
+
+	free(xpath);
+}
+
+/*
+ * @brief Visits the metrics of a single method, called with the metrics locked.
+ *        Only the buckets that counted a call are reported.
+ */
+static void generic_sdbus_metrics_visit_cb(const bus_metrics_target_t *target, void *userdata)
+{
+	generic_sdbus_oper_t *oper = (generic_sdbus_oper_t *) userdata;
+	const char *bus_type = bus_connection_type_name(target->bus_type);
+	char *entry = NULL;
+	int entry_size = 0;
+	char name[METRICS_SD_BUS_NAME_SIZE] = {0};
+
+	if (oper->error != SR_ERR_OK || bus_type == NULL) {
+		return;
+	}
+
+	entry_size = snprintf(NULL, 0, METRICS_SD_BUS_TARGET_XPATH, bus_type, target->service, target->interface, target->method) + 1;
+	entry = malloc((size_t) entry_size);
+	if (entry == NULL) {
+		oper->error = SR_ERR_NOMEM;
+		return;
+	}
+	snprintf(entry, (size_t) entry_size, METRICS_SD_BUS_TARGET_XPATH, bus_type, target->service, target->interface, target->method);
+
+	generic_sdbus_metrics_leaf_set(oper, entry, METRICS_SD_BUS_CALLS, target->calls);
+	generic_sdbus_metrics_leaf_set(oper, entry, METRICS_SD_BUS_ERRORS, target->errors);
+	generic_sdbus_metrics_leaf_set(oper, entry, METRICS_SD_BUS_IN_FLIGHT, target->in_flight);
+
+	for (size_t i = 0; i < BUS_METRICS_PHASE_COUNT; i++) {
+		const bus_metrics_histogram_t *histogram = &target->phases[i];
+		const char *phase = bus_metrics_phase_name((bus_metrics_phase_t) i);
+
+		if (histogram->count == 0) {
+			continue;
+		}
+
+		snprintf(name, sizeof(name), METRICS_SD_BUS_PHASE_XPATH, phase, METRICS_SD_BUS_COUNT);
+		generic_sdbus_metrics_leaf_set(oper, entry, name, histogram->count);
+		snprintf(name, sizeof(name), METRICS_SD_BUS_PHASE_XPATH, phase, METRICS_SD_BUS_TOTAL);
+		generic_sdbus_metrics_leaf_set(oper, entry, name, histogram->sum_usec);
+		snprintf(name, sizeof(name), METRICS_SD_BUS_PHASE_XPATH, phase, METRICS_SD_BUS_MAX);
+		generic_sdbus_metrics_leaf_set(oper, entry, name, histogram->max_usec);
+
+		for (size_t j = 0; j < BUS_METRICS_BUCKETS; j++) {
+			if (histogram->buckets[j] == 0) {
+				continue;
+			}
+
+			snprintf(name, sizeof(name), METRICS_SD_BUS_BUCKET_XPATH, phase, j, METRICS_SD_BUS_COUNT);
+			generic_sdbus_metrics_leaf_set(oper, entry, name, histogram->buckets[j]);
+			// the last bucket has no upper bound
+			if (j < BUS_METRICS_BUCKETS - 1) {
+				snprintf(name, sizeof(name), METRICS_SD_BUS_BUCKET_XPATH, phase, j, METRICS_SD_BUS_UPPER_BOUND);
+				generic_sdbus_metrics_leaf_set(oper, entry, name, 1ULL << j);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < target->error_names_count; i++) {
+		snprintf(name, sizeof(name), METRICS_SD_BUS_ERROR_XPATH, target->error_names[i].name);
+		generic_sdbus_metrics_leaf_set(oper, entry, name, target->error_names[i].count);
+	}
+
+	free(entry);
+}
+
+/*
+ * @brief Callback for the operational metrics of the sd-bus calls, served
+ *        from the counters without any sd-bus call.
+ *
+ * @param[in] session session context of the request.
+ * @param[in] module_name name of the requested module.
+ * @param[in] path subscription path.
+ * @param[in] request_xpath requested xpath.
+ * @param[in] request_id request id.
+ * @param[in,out] parent operational data tree.
+ * @param[in] private_data the call metrics.
+ *
+ * @return error code.
+ */
+int generic_sdbus_metrics_oper_cb(sr_session_ctx_t *session, const char *module_name,
+								  const char *path, const char *request_xpath,
+								  uint32_t request_id, struct lyd_node **parent,
+								  void *private_data)
+{
+	generic_sdbus_oper_t oper = {
+		.ctx = sr_get_context(sr_session_get_connection(session)),
+		.parent = parent,
+		.error = SR_ERR_OK,
+	};
+
+	bus_metrics_foreach((bus_metrics_t *) private_data, generic_sdbus_metrics_visit_cb, &oper);
+
+	return oper.error;
+}
+
+/*
+ * @brief Sends the signals of a subscription as a single sd-bus-signal
+ *        notification. Called on the watcher thread.
+ *
+ * @param[in] name name of the subscription.
+ * @param[in] signals signals in the order they arrived.
+ * @param[in] signals_count number of signals.
+ * @param[in] userdata plugin session used for sending.
+ */
+static void generic_sdbus_signal_send_cb(const char *name, const bus_watch_signal_t *signals, size_t signals_count, void *userdata)
+{
+	int rc = SR_ERR_OK;
+	sr_session_ctx_t *session = (sr_session_ctx_t *) userdata;
+	struct lyd_node *notification = NULL;
+	char xpath[RPC_SD_BUS_RESULT_XPATH_SIZE] = {0};
+
+	notification = lyd_new_path(NULL, sr_get_context(sr_session_get_connection(session)),
+								SIGNAL_SD_BUS_NOTIFICATION "/" SIGNAL_SD_BUS_SUBSCRIPTION, (void *) name, LYD_ANYDATA_STRING, 0);
+	if (notification == NULL) {
+		SRP_LOG_ERR("failed to create the notification of %s", name);
+		return;
+	}
+
+	for (size_t i = 0; i < signals_count && rc == SR_ERR_OK; i++) {
+		const char *names[] = {SIGNAL_SD_BUS_SENDER, RPC_SD_BUS_OBJPATH, RPC_SD_BUS_INTERFACE, SIGNAL_SD_BUS_MEMBER,
+							   RPC_SD_BUS_REPLY_SIGNATURE, RPC_SD_BUS_RESPONSE};
+		const char *values[] = {signals[i].sender, signals[i].object_path, signals[i].interface, signals[i].member,
+								signals[i].signature, signals[i].response};
+
+		for (size_t j = 0; j < sizeof(names) / sizeof(names[0]) && rc == SR_ERR_OK; j++) {
+			if (values[j] == NULL) {
+				continue;
+			}
+
+			snprintf(xpath, sizeof(xpath), RPC_SD_BUS_RESULT_XPATH, SIGNAL_SD_BUS_MESSAGE, i, names[j]);
+			if (NULL == lyd_new_path(notification, NULL, xpath, (void *) values[j], LYD_ANYDATA_STRING, 0)) {
+				SRP_LOG_ERR("failed to set notification %s", xpath);
+				rc = SR_ERR_INTERNAL;
+			}
+		}
+	}
+
+	if (rc == SR_ERR_OK) {
+		rc = sr_event_notif_send_tree(session, notification);
+		if (rc != SR_ERR_OK) {
+			SRP_LOG_ERR("failed to send the signals of %s: %s", name, sr_strerror(rc));
+		}
+	}
+
+	lyd_free_withsiblings(notification);
+}
+
 /*
  * @brief Callback for initializing the plugin.
- * 		  Subscribes to generic sd-bus call.
+ * 		  Creates the bus connection pool and the worker threads, one per online
+ * 		  CPU and the bus watcher, and subscribes to generic sd-bus call, the
+ * 		  sd-bus-watch configuration and its operational data.
  *
  * @param[in] session session context used for subscribiscions.
  * @param[out] subscription subscription to be unsubscribed on program termination.
@@ -238,14 +1947,131 @@ int sr_plugin_init_cb(sr_session_ctx_t *session, sr_subscription_ctx_t **subscri
 	SRP_LOG_INF("%s", __func__);
 
 	int error = 0;
+	long workers_count = 0;
+
+	error = generic_sdbus_schema_init(sr_get_context(sr_session_get_connection(session)));
+	if (error != SR_ERR_OK) {
+		goto cleanup;
+	}
+
+	error = bus_connection_pool_create(&bus_connections);
+	if (error < 0) {
+		SRP_LOG_ERR("bus connection pool error: %s", strerror(-error));
+		error = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	workers_count = sysconf(_SC_NPROCESSORS_ONLN);
+	error = worker_pool_create(&bus_workers, (workers_count > 0) ? (size_t) workers_count : 1,
+							   generic_sdbus_worker_state_create, generic_sdbus_worker_state_destroy);
+	if (error < 0) {
+		SRP_LOG_ERR("worker pool error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
+		goto cleanup;
+	}
+
+	error = bus_watch_create(&bus_watch, bus_event, generic_sdbus_signal_send_cb, session);
+	if (error < 0) {
+		SRP_LOG_ERR("bus watch error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
+		goto cleanup;
+	}
+
+	error = bus_cache_create(&bus_cache);
+	if (error < 0) {
+		SRP_LOG_ERR("response cache error: %s", strerror(-error));
+		error = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	error = bus_flight_group_create(&bus_flights);
+	if (error < 0) {
+		SRP_LOG_ERR("call flight error: %s", strerror(-error));
+		error = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	error = bus_metrics_create(&bus_metrics);
+	if (error < 0) {
+		SRP_LOG_ERR("call metrics error: %s", strerror(-error));
+		error = SR_ERR_NOMEM;
+		goto cleanup;
+	}
+
+	error = bus_offload_create(&bus_offload);
+	if (error < 0) {
+		SRP_LOG_ERR("reply offload error: %s", strerror(-error));
+		error = SR_ERR_NOMEM;
+		goto cleanup;
+	}
 
 	SRP_LOG_INFMSG("Subscribing to sd-bus call rpc");
-	error = sr_rpc_subscribe_tree(session, "/" YANG_MODEL ":sd-bus-call", generic_sdbus_call_rpc_tree_cb, NULL, 0, SR_SUBSCR_CTX_REUSE, subscription);
+	error = sr_rpc_subscribe_tree(session, RPC_SD_BUS_CALL_PATH, generic_sdbus_call_rpc_tree_cb, bus_connections, 0, subscription_options, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("rpc subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	SRP_LOG_INFMSG("Subscribing to sd-bus properties rpc");
+	error = sr_rpc_subscribe_tree(session, RPC_SD_BUS_PROPERTIES_PATH, generic_sdbus_properties_rpc_tree_cb, bus_connections, 0, subscription_options, subscription);
 	if (SR_ERR_OK != error) {
 		SRP_LOG_ERR("rpc subscription error: %s", sr_strerror(error));
 		goto cleanup;
 	}
 
+	SRP_LOG_INFMSG("Subscribing to sd-bus watch changes");
+	error = sr_module_change_subscribe(session, YANG_MODEL, WATCH_SD_BUS_PATH, generic_sdbus_watch_change_cb, bus_watch, 0,
+									   subscription_options | SR_SUBSCR_ENABLED | SR_SUBSCR_DONE_ONLY, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("module change subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	error = sr_oper_get_items_subscribe(session, YANG_MODEL, WATCH_SD_BUS_PATH, generic_sdbus_watch_oper_cb, bus_watch,
+										subscription_options, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("operational subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	SRP_LOG_INFMSG("Subscribing to sd-bus cache changes");
+	error = sr_module_change_subscribe(session, YANG_MODEL, CACHE_SD_BUS_PATH, generic_sdbus_cache_change_cb, bus_cache, 0,
+									   subscription_options | SR_SUBSCR_ENABLED | SR_SUBSCR_DONE_ONLY, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("module change subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	error = sr_oper_get_items_subscribe(session, YANG_MODEL, CACHE_SD_BUS_PATH, generic_sdbus_cache_oper_cb, bus_cache,
+										subscription_options, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("operational subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	SRP_LOG_INFMSG("Subscribing to sd-bus offload changes");
+	error = sr_module_change_subscribe(session, YANG_MODEL, OFFLOAD_SD_BUS_PATH, generic_sdbus_offload_change_cb, bus_offload, 0,
+									   subscription_options | SR_SUBSCR_ENABLED | SR_SUBSCR_DONE_ONLY, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("module change subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	error = sr_oper_get_items_subscribe(session, YANG_MODEL, OFFLOAD_SD_BUS_PATH, generic_sdbus_offload_oper_cb, bus_offload,
+										subscription_options, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("operational subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
+	SRP_LOG_INFMSG("Subscribing to sd-bus metrics");
+	error = sr_oper_get_items_subscribe(session, YANG_MODEL, METRICS_SD_BUS_PATH, generic_sdbus_metrics_oper_cb, bus_metrics,
+										subscription_options, subscription);
+	if (SR_ERR_OK != error) {
+		SRP_LOG_ERR("operational subscription error: %s", sr_strerror(error));
+		goto cleanup;
+	}
+
 	SRP_LOG_INFMSG("Succesfull init");
 	return SR_ERR_OK;
 
@@ -254,11 +2080,27 @@ cleanup:
 		sr_unsubscribe(*subscription);
 		*subscription = NULL;
 	}
+	bus_watch_destroy(bus_watch);
+	bus_watch = NULL;
+	bus_cache_destroy(bus_cache);
+	bus_cache = NULL;
+	bus_flight_group_destroy(bus_flights);
+	bus_flights = NULL;
+	bus_metrics_destroy(bus_metrics);
+	bus_metrics = NULL;
+	bus_offload_destroy(bus_offload);
+	bus_offload = NULL;
+	worker_pool_destroy(bus_workers);
+	bus_workers = NULL;
+	bus_connection_pool_destroy(bus_connections);
+	bus_connections = NULL;
 	return error;
 }
 
 /*
- * @brief Unsubscribes from all subscriptions, stops the plugin session and connection.
+ * @brief Unsubscribes from all subscriptions, stops the bus watcher and the worker threads, closes the
+ *        pooled bus connections, drops the compiled signatures, stops the plugin
+ *        session and connection.
  *
  * @param[in] connection connection for unsubscribing.
  * @param[in] session session for unsubscribing.
@@ -271,6 +2113,21 @@ void sr_plugin_cleanup_cb(sr_conn_ctx_t *connection, sr_session_ctx_t *session,
 	if (subscription != NULL) {
 		sr_unsubscribe(subscription);
 	}
+	bus_watch_destroy(bus_watch);
+	bus_watch = NULL;
+	bus_cache_destroy(bus_cache);
+	bus_cache = NULL;
+	bus_flight_group_destroy(bus_flights);
+	bus_flights = NULL;
+	bus_metrics_destroy(bus_metrics);
+	bus_metrics = NULL;
+	bus_offload_destroy(bus_offload);
+	bus_offload = NULL;
+	worker_pool_destroy(bus_workers);
+	bus_workers = NULL;
+	bus_connection_pool_destroy(bus_connections);
+	bus_connections = NULL;
+	bus_signature_program_cache_clear();
 	if (session != NULL) {
 		sr_session_stop(session);
 	}
@@ -282,15 +2139,15 @@ void sr_plugin_cleanup_cb(sr_conn_ctx_t *connection, sr_session_ctx_t *session,
 
 #ifndef PLUGIN
 #include <signal.h>
-#include <unistd.h>
-
-volatile int exit_application = 0;
 
-static void sigint_handler(__attribute__((unused)) int signum);
+static int generic_sdbus_sysrepo_event_cb(sd_event_source *source, int fd, uint32_t revents, void *userdata);
+static int generic_sdbus_exit_signal_cb(sd_event_source *source, const struct signalfd_siginfo *si, void *userdata);
 
 /*
  * @brief Initializes the connection to sysrepo and initializes the plugin.
- * 		  When the program is interupted the cleanup code is called.
+ * 		  The sysrepo subscriptions, the bus connections of the plugin and the
+ * 		  bus watcher are dispatched from a single sd-event loop on the main thread, which runs
+ * 		  until SIGINT or SIGTERM is received and the cleanup code is called.
  *
  * @return error code.
  *
@@ -301,9 +2158,34 @@ int main(void)
 	sr_conn_ctx_t *connection = NULL;
 	sr_session_ctx_t *session = NULL;
 	sr_subscription_ctx_t *subscription = NULL;
+	sd_event *event = NULL;
+	sd_event_source *sysrepo_source = NULL;
+	sigset_t exit_signals;
+	int event_pipe = -1;
 
 	sr_log_stderr(SR_LL_DBG);
 
+	// blocked before any thread is started so that only the event loop receives them
+	sigemptyset(&exit_signals);
+	sigaddset(&exit_signals, SIGINT);
+	sigaddset(&exit_signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &exit_signals, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	error = sd_event_default(&event);
+	if (error < 0) {
+		SRP_LOG_ERR("sd_event_default error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
+		goto out;
+	}
+
+	if (sd_event_add_signal(event, NULL, SIGINT, generic_sdbus_exit_signal_cb, NULL) < 0 ||
+		sd_event_add_signal(event, NULL, SIGTERM, generic_sdbus_exit_signal_cb, NULL) < 0) {
+		SRP_LOG_ERRMSG("failed to handle the termination signals");
+		error = SR_ERR_INTERNAL;
+		goto out;
+	}
+
 	/* connect to sysrepo */
 	error = sr_connect(SR_CONN_DEFAULT, &connection);
 	if (error) {
@@ -317,35 +2199,85 @@ int main(void)
 		goto out;
 	}
 
+	// callbacks are run from the event loop instead of a sysrepo thread, and so is the watcher
+	subscription_options |= SR_SUBSCR_NO_THREAD;
+	bus_event = event;
+
 	error = sr_plugin_init_cb(session, &subscription);
 	if (error) {
-		SRP_LOG_ERRMSG("dhcp_plugin_init_cb error");
+		SRP_LOG_ERRMSG("generic sd-bus plugin init error");
 		goto out;
 	}
 
-	/* loop until ctrl-c is pressed / SIGINT is received */
-	signal(SIGINT, sigint_handler);
-	signal(SIGPIPE, SIG_IGN);
-	while (!exit_application) {
-		sleep(1); /* or do some more useful work... */
+	error = sr_get_event_pipe(subscription, &event_pipe);
+	if (error) {
+		SRP_LOG_ERR("sr_get_event_pipe error (%d): %s", error, sr_strerror(error));
+		goto out;
+	}
+
+	error = sd_event_add_io(event, &sysrepo_source, event_pipe, EPOLLIN, generic_sdbus_sysrepo_event_cb, subscription);
+	if (error < 0) {
+		SRP_LOG_ERR("sd_event_add_io error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
+		goto out;
+	}
+
+	error = bus_connection_pool_attach_event(bus_connections, event);
+	if (error < 0) {
+		SRP_LOG_ERR("sd_bus_attach_event error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
+		goto out;
+	}
+
+	error = sd_event_loop(event);
+	if (error < 0) {
+		SRP_LOG_ERR("sd_event_loop error: %s", strerror(-error));
+		error = SR_ERR_INTERNAL;
 	}
 
 out:
+	sd_event_source_unref(sysrepo_source);
 	sr_plugin_cleanup_cb(connection, session, subscription);
+	sd_event_unref(event);
 	return error;
 }
 
 /*
- * @brief Termination signal handeling
+ * @brief Processes the sysrepo events signalled on the subscription event pipe.
+ *
+ * @param[in] source event source of the pipe.
+ * @param[in] fd subscription event pipe.
+ * @param[in] revents received epoll events.
+ * @param[in] userdata sysrepo subscription.
+ *
+ * @return 0, a failing event does not stop the loop.
+ */
+static int generic_sdbus_sysrepo_event_cb(sd_event_source *source, int fd, uint32_t revents, void *userdata)
+{
+	int error = SR_ERR_OK;
+
+	error = sr_process_events((sr_subscription_ctx_t *) userdata, NULL, NULL);
+	if (error != SR_ERR_OK) {
+		SRP_LOG_ERR("sr_process_events error (%d): %s", error, sr_strerror(error));
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Termination signal handling, leaves the event loop.
  *
- * @param[in] signum signal identifier.
+ * @param[in] source event source of the signal.
+ * @param[in] si received signal.
+ * @param[in] userdata unused.
  *
- * @note signum is not used.
+ * @return result of leaving the event loop.
  */
-static void sigint_handler(__attribute__((unused)) int signum)
+static int generic_sdbus_exit_signal_cb(sd_event_source *source, const struct signalfd_siginfo *si, void *userdata)
 {
-	SRP_LOG_INFMSG("Sigint called, exiting...");
-	exit_application = 1;
+	SRP_LOG_INF("signal %u received, exiting...", si->ssi_signo);
+
+	return sd_event_exit(sd_event_source_get_event(source), 0);
 }
 
 #endif
@@ -0,0 +1,272 @@
+/**
+ * @file hashmap.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements a chained hash table with byte string keys.
+ *        Keys are copied on insert, values are owned by the map and released
+ *        with the free callback given on creation. The table doubles its
+ *        bucket count once the load factor exceeds 3/4.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hashmap.h"
+
+#define HASHMAP_BUCKETS_INITIAL 16
+
+typedef struct hashmap_entry_s {
+	struct hashmap_entry_s *next;
+	uint64_t hash;
+	void *value;
+	size_t key_size;
+	char key[];
+} hashmap_entry_t;
+
+struct hashmap_s {
+	hashmap_entry_t **buckets;
+	size_t buckets_count;
+	size_t size;
+	hashmap_value_free_cb value_free;
+};
+
+static uint64_t hashmap_hash(const void *key, size_t key_size);
+static hashmap_entry_t **hashmap_slot_find(hashmap_t *map, const void *key, size_t key_size, uint64_t hash);
+static int hashmap_grow(hashmap_t *map);
+static void hashmap_entry_free(hashmap_t *map, hashmap_entry_t *entry);
+
+int hashmap_create(hashmap_t **map, hashmap_value_free_cb value_free)
+{
+	if (map == NULL) {
+		return -EINVAL;
+	}
+
+	*map = calloc(1, sizeof(hashmap_t));
+	if (*map == NULL) {
+		return -ENOMEM;
+	}
+
+	(*map)->buckets = calloc(HASHMAP_BUCKETS_INITIAL, sizeof(hashmap_entry_t *));
+	if ((*map)->buckets == NULL) {
+		free(*map);
+		*map = NULL;
+		return -ENOMEM;
+	}
+
+	(*map)->buckets_count = HASHMAP_BUCKETS_INITIAL;
+	(*map)->value_free = value_free;
+
+	return 0;
+}
+
+void hashmap_destroy(hashmap_t *map)
+{
+	if (map == NULL) {
+		return;
+	}
+
+	hashmap_clear(map);
+	free(map->buckets);
+	free(map);
+}
+
+int hashmap_insert(hashmap_t *map, const void *key, size_t key_size, void *value)
+{
+	uint64_t hash = 0;
+	hashmap_entry_t **slot = NULL;
+	hashmap_entry_t *entry = NULL;
+
+	if (map == NULL || key == NULL) {
+		return -EINVAL;
+	}
+
+	hash = hashmap_hash(key, key_size);
+	slot = hashmap_slot_find(map, key, key_size, hash);
+	if (*slot != NULL) {
+		if (map->value_free && (*slot)->value != value) {
+			map->value_free((*slot)->value);
+		}
+		(*slot)->value = value;
+		return 0;
+	}
+
+	entry = malloc(sizeof(hashmap_entry_t) + key_size);
+	if (entry == NULL) {
+		return -ENOMEM;
+	}
+
+	entry->next = NULL;
+	entry->hash = hash;
+	entry->value = value;
+	entry->key_size = key_size;
+	memcpy(entry->key, key, key_size);
+
+	*slot = entry;
+	map->size++;
+
+	if (map->size * 4 > map->buckets_count * 3) {
+		// a failed resize only makes the chains longer
+		hashmap_grow(map);
+	}
+
+	return 0;
+}
+
+void *hashmap_get(hashmap_t *map, const void *key, size_t key_size)
+{
+	hashmap_entry_t **slot = NULL;
+
+	if (map == NULL || key == NULL) {
+		return NULL;
+	}
+
+	slot = hashmap_slot_find(map, key, key_size, hashmap_hash(key, key_size));
+
+	return (*slot != NULL) ? (*slot)->value : NULL;
+}
+
+int hashmap_remove(hashmap_t *map, const void *key, size_t key_size)
+{
+	hashmap_entry_t **slot = NULL;
+	hashmap_entry_t *entry = NULL;
+
+	if (map == NULL || key == NULL) {
+		return -EINVAL;
+	}
+
+	slot = hashmap_slot_find(map, key, key_size, hashmap_hash(key, key_size));
+	if (*slot == NULL) {
+		return -ENOENT;
+	}
+
+	entry = *slot;
+	*slot = entry->next;
+	hashmap_entry_free(map, entry);
+
+	return 0;
+}
+
+void hashmap_foreach(hashmap_t *map, hashmap_visit_cb visit, void *userdata)
+{
+	hashmap_entry_t **slot = NULL;
+	hashmap_entry_t *entry = NULL;
+
+	if (map == NULL || visit == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < map->buckets_count; i++) {
+		slot = &map->buckets[i];
+		while (*slot != NULL) {
+			entry = *slot;
+			if (visit(entry->key, entry->key_size, entry->value, userdata)) {
+				*slot = entry->next;
+				hashmap_entry_free(map, entry);
+			} else {
+				slot = &entry->next;
+			}
+		}
+	}
+}
+
+void hashmap_clear(hashmap_t *map)
+{
+	hashmap_entry_t *entry = NULL;
+
+	if (map == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < map->buckets_count; i++) {
+		while ((entry = map->buckets[i]) != NULL) {
+			map->buckets[i] = entry->next;
+			hashmap_entry_free(map, entry);
+		}
+	}
+}
+
+size_t hashmap_size(hashmap_t *map)
+{
+	return (map != NULL) ? map->size : 0;
+}
+
+static uint64_t hashmap_hash(const void *key, size_t key_size)
+{
+	// 64-bit FNV-1a
+	const unsigned char *byte = key;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < key_size; i++) {
+		hash ^= byte[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static hashmap_entry_t **hashmap_slot_find(hashmap_t *map, const void *key, size_t key_size, uint64_t hash)
+{
+	hashmap_entry_t **slot = &map->buckets[hash & (map->buckets_count - 1)];
+
+	for (; *slot != NULL; slot = &(*slot)->next) {
+		if ((*slot)->hash == hash && (*slot)->key_size == key_size && memcmp((*slot)->key, key, key_size) == 0) {
+			break;
+		}
+	}
+
+	return slot;
+}
+
+static int hashmap_grow(hashmap_t *map)
+{
+	hashmap_entry_t **buckets = NULL;
+	hashmap_entry_t *entry = NULL;
+	size_t buckets_count = map->buckets_count * 2;
+
+	buckets = calloc(buckets_count, sizeof(hashmap_entry_t *));
+	if (buckets == NULL) {
+		return -ENOMEM;
+	}
+
+	for (size_t i = 0; i < map->buckets_count; i++) {
+		while ((entry = map->buckets[i]) != NULL) {
+			map->buckets[i] = entry->next;
+			entry->next = buckets[entry->hash & (buckets_count - 1)];
+			buckets[entry->hash & (buckets_count - 1)] = entry;
+		}
+	}
+
+	free(map->buckets);
+	map->buckets = buckets;
+	map->buckets_count = buckets_count;
+
+	return 0;
+}
+
+static void hashmap_entry_free(hashmap_t *map, hashmap_entry_t *entry)
+{
+	if (map->value_free) {
+		map->value_free(entry->value);
+	}
+	free(entry);
+	map->size--;
+}
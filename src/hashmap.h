@@ -0,0 +1,48 @@
+/**
+ * @file hashmap.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions of a chained hash table with byte string keys
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _HASHMAP_H_
+#define _HASHMAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct hashmap_s hashmap_t;
+
+// called for a value when it is replaced, removed or the map is destroyed
+typedef void (*hashmap_value_free_cb)(void *value);
+// called for every entry, returning true removes the entry from the map
+typedef bool (*hashmap_visit_cb)(const void *key, size_t key_size, void *value, void *userdata);
+
+int hashmap_create(hashmap_t **map, hashmap_value_free_cb value_free);
+void hashmap_destroy(hashmap_t *map);
+
+int hashmap_insert(hashmap_t *map, const void *key, size_t key_size, void *value);
+void *hashmap_get(hashmap_t *map, const void *key, size_t key_size);
+int hashmap_remove(hashmap_t *map, const void *key, size_t key_size);
+void hashmap_foreach(hashmap_t *map, hashmap_visit_cb visit, void *userdata);
+void hashmap_clear(hashmap_t *map);
+size_t hashmap_size(hashmap_t *map);
+
+#endif //_HASHMAP_H_
@@ -0,0 +1,536 @@
+/**
+ * @file introspect-sd-bus.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements the introspection backed method signature cache.
+ *        The first lookup for a service and object path calls
+ *        org.freedesktop.DBus.Introspectable.Introspect, parses the input
+ *        signatures of every method on every interface of the object and
+ *        caches them keyed by service, object path, interface and method.
+ *        Entries of a service are dropped when its name owner changes, and
+ *        the least recently used objects are dropped once the cache holds
+ *        too many of them.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <systemd/sd-bus.h>
+#include <systemd/sd-bus-protocol.h>
+
+#include "hashmap.h"
+#include "introspect-sd-bus.h"
+
+#define INTROSPECT_INTERFACE "org.freedesktop.DBus.Introspectable"
+#define INTROSPECT_METHOD "Introspect"
+#define INTROSPECT_OBJECTS_MAX 256
+
+typedef struct bus_signature_object_s {
+	// least recently used list, most recent first
+	struct bus_signature_object_s *prev;
+	struct bus_signature_object_s *next;
+	// "service\0path\0", the prefix of the keys of all its methods
+	char *key;
+	size_t key_size;
+} bus_signature_object_t;
+
+struct bus_signature_cache_s {
+	// "service\0path\0interface\0method" -> input signature
+	hashmap_t *signatures;
+	// "service\0path" -> bus_signature_object_t of an object already introspected,
+	// objects are freed by the cache itself
+	hashmap_t *objects;
+	bus_signature_object_t *head;
+	bus_signature_object_t *tail;
+};
+
+typedef struct bus_signature_prefix_s {
+	bus_signature_cache_t *cache;
+	const char *prefix;
+	size_t prefix_size;
+} bus_signature_prefix_t;
+
+static char *bus_signature_key(size_t *key_size, const char **parts, size_t parts_count);
+static int bus_signature_store(bus_signature_cache_t *cache, const char *service, const char *object_path,
+							   const char *interface, const char *method, const char *signature);
+static bool bus_signature_prefix_match(const void *key, size_t key_size, void *value, void *userdata);
+static bool bus_signature_object_match(const void *key, size_t key_size, void *value, void *userdata);
+static int bus_signature_object_add(bus_signature_cache_t *cache, const char *object_key, size_t object_key_size);
+static void bus_signature_object_link(bus_signature_cache_t *cache, bus_signature_object_t *object);
+static void bus_signature_object_unlink(bus_signature_cache_t *cache, bus_signature_object_t *object);
+static void bus_signature_object_remove(bus_signature_cache_t *cache, bus_signature_object_t *object);
+static void bus_signature_object_forget(bus_signature_cache_t *cache, const char *object_key, size_t object_key_size);
+static int bus_introspect_parse(bus_signature_cache_t *cache, const char *service, const char *object_path, const char *xml);
+static bool bus_introspect_tag_is(const char *tag, size_t tag_size, const char *name);
+static int bus_introspect_attribute(const char *tag, const char *tag_end, const char *attribute, char *value, size_t value_size);
+
+int bus_signature_cache_create(bus_signature_cache_t **cache)
+{
+	int error = 0;
+
+	if (cache == NULL) {
+		return -EINVAL;
+	}
+
+	*cache = calloc(1, sizeof(bus_signature_cache_t));
+	if (*cache == NULL) {
+		return -ENOMEM;
+	}
+
+	error = hashmap_create(&(*cache)->signatures, free);
+	if (error == 0) {
+		error = hashmap_create(&(*cache)->objects, NULL);
+	}
+	if (error < 0) {
+		hashmap_destroy((*cache)->signatures);
+		free(*cache);
+		*cache = NULL;
+		return error;
+	}
+
+	return 0;
+}
+
+void bus_signature_cache_destroy(bus_signature_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	bus_signature_cache_clear(cache);
+	hashmap_destroy(cache->objects);
+	hashmap_destroy(cache->signatures);
+	free(cache);
+}
+
+int bus_signature_cache_lookup(bus_signature_cache_t *cache, sd_bus *bus, uint64_t timeout_usec, const char *service,
+							   const char *object_path, const char *interface, const char *method, char *signature,
+							   size_t signature_size)
+{
+	int error = 0;
+	const char *parts[] = {service, object_path, interface, method};
+	char *key = NULL;
+	size_t key_size = 0;
+	char *object_key = NULL;
+	size_t object_key_size = 0;
+	bus_signature_object_t *object = NULL;
+	const char *cached = NULL;
+	sd_bus_error bus_error = SD_BUS_ERROR_NULL;
+	sd_bus_message *request = NULL;
+	sd_bus_message *reply = NULL;
+	const char *xml = NULL;
+
+	if (cache == NULL || bus == NULL || service == NULL || object_path == NULL ||
+		interface == NULL || method == NULL || signature == NULL) {
+		return -EINVAL;
+	}
+
+	key = bus_signature_key(&key_size, parts, 4);
+	object_key = bus_signature_key(&object_key_size, parts, 2);
+	if (key == NULL || object_key == NULL) {
+		error = -ENOMEM;
+		goto out;
+	}
+
+	object = hashmap_get(cache->objects, object_key, object_key_size);
+	if (object != NULL) {
+		bus_signature_object_unlink(cache, object);
+		bus_signature_object_link(cache, object);
+	} else {
+		// bounded like the call itself, a timeout fails only the entry being prepared
+		error = sd_bus_message_new_method_call(bus, &request, service, object_path, INTROSPECT_INTERFACE, INTROSPECT_METHOD);
+		if (error < 0) {
+			goto out;
+		}
+
+		error = sd_bus_call(bus, request, timeout_usec, &bus_error, &reply);
+		if (error < 0) {
+			goto out;
+		}
+
+		error = sd_bus_message_read(reply, "s", &xml);
+		if (error < 0) {
+			goto out;
+		}
+
+		error = bus_introspect_parse(cache, service, object_path, xml);
+		if (error == 0) {
+			// remember the object even if it does not have the method, so unknown methods do not introspect again
+			error = bus_signature_object_add(cache, object_key, object_key_size);
+		}
+		if (error < 0) {
+			// the signatures stored so far have no object that would evict them
+			bus_signature_object_forget(cache, object_key, object_key_size);
+			goto out;
+		}
+	}
+
+	cached = hashmap_get(cache->signatures, key, key_size);
+
+	if (cached == NULL) {
+		error = -ENOENT;
+		goto out;
+	}
+
+	if (strlen(cached) >= signature_size) {
+		error = -ENOBUFS;
+		goto out;
+	}
+
+	strcpy(signature, cached);
+	error = 0;
+
+out:
+	sd_bus_error_free(&bus_error);
+	sd_bus_message_unref(reply);
+	sd_bus_message_unref(request);
+	free(object_key);
+	free(key);
+
+	return error;
+}
+
+void bus_signature_cache_invalidate(bus_signature_cache_t *cache, const char *service)
+{
+	bus_signature_prefix_t prefix = {0};
+
+	if (cache == NULL || service == NULL) {
+		return;
+	}
+
+	// include the terminating zero so "org.foo" does not match "org.foobar"
+	prefix.cache = cache;
+	prefix.prefix = service;
+	prefix.prefix_size = strlen(service) + 1;
+
+	hashmap_foreach(cache->signatures, bus_signature_prefix_match, &prefix);
+	hashmap_foreach(cache->objects, bus_signature_object_match, &prefix);
+}
+
+void bus_signature_cache_clear(bus_signature_cache_t *cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	while (cache->head != NULL) {
+		bus_signature_object_remove(cache, cache->head);
+	}
+	hashmap_clear(cache->signatures);
+}
+
+static char *bus_signature_key(size_t *key_size, const char **parts, size_t parts_count)
+{
+	char *key = NULL;
+	size_t offset = 0;
+
+	*key_size = 0;
+	for (size_t i = 0; i < parts_count; i++) {
+		*key_size += strlen(parts[i]) + 1;
+	}
+
+	key = malloc(*key_size);
+	if (key == NULL) {
+		return NULL;
+	}
+
+	for (size_t i = 0; i < parts_count; i++) {
+		size_t part_size = strlen(parts[i]) + 1;
+		memcpy(key + offset, parts[i], part_size);
+		offset += part_size;
+	}
+
+	return key;
+}
+
+static int bus_signature_store(bus_signature_cache_t *cache, const char *service, const char *object_path,
+							   const char *interface, const char *method, const char *signature)
+{
+	int error = 0;
+	const char *parts[] = {service, object_path, interface, method};
+	char *key = NULL;
+	size_t key_size = 0;
+	char *value = NULL;
+
+	key = bus_signature_key(&key_size, parts, 4);
+	value = strdup(signature);
+	if (key == NULL || value == NULL) {
+		free(key);
+		free(value);
+		return -ENOMEM;
+	}
+
+	error = hashmap_insert(cache->signatures, key, key_size, value);
+	if (error < 0) {
+		free(value);
+	}
+
+	free(key);
+
+	return error;
+}
+
+static bool bus_signature_prefix_match(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_signature_prefix_t *prefix = (bus_signature_prefix_t *) userdata;
+
+	return key_size >= prefix->prefix_size && memcmp(key, prefix->prefix, prefix->prefix_size) == 0;
+}
+
+static bool bus_signature_object_match(const void *key, size_t key_size, void *value, void *userdata)
+{
+	bus_signature_prefix_t *prefix = (bus_signature_prefix_t *) userdata;
+	bus_signature_object_t *object = (bus_signature_object_t *) value;
+
+	if (!bus_signature_prefix_match(key, key_size, value, userdata)) {
+		return false;
+	}
+
+	// the map drops the entry itself, only the list and the object are left
+	bus_signature_object_unlink(prefix->cache, object);
+	free(object->key);
+	free(object);
+
+	return true;
+}
+
+static int bus_signature_object_add(bus_signature_cache_t *cache, const char *object_key, size_t object_key_size)
+{
+	int error = 0;
+	bus_signature_object_t *object = NULL;
+
+	while (hashmap_size(cache->objects) >= INTROSPECT_OBJECTS_MAX && cache->tail != NULL) {
+		bus_signature_object_remove(cache, cache->tail);
+	}
+
+	object = calloc(1, sizeof(bus_signature_object_t));
+	if (object == NULL) {
+		return -ENOMEM;
+	}
+
+	object->key = malloc(object_key_size);
+	if (object->key == NULL) {
+		free(object);
+		return -ENOMEM;
+	}
+	memcpy(object->key, object_key, object_key_size);
+	object->key_size = object_key_size;
+
+	error = hashmap_insert(cache->objects, object_key, object_key_size, object);
+	if (error < 0) {
+		free(object->key);
+		free(object);
+		return error;
+	}
+
+	bus_signature_object_link(cache, object);
+
+	return 0;
+}
+
+static void bus_signature_object_link(bus_signature_cache_t *cache, bus_signature_object_t *object)
+{
+	object->prev = NULL;
+	object->next = cache->head;
+	if (cache->head != NULL) {
+		cache->head->prev = object;
+	}
+	cache->head = object;
+	if (cache->tail == NULL) {
+		cache->tail = object;
+	}
+}
+
+static void bus_signature_object_unlink(bus_signature_cache_t *cache, bus_signature_object_t *object)
+{
+	if (object->prev != NULL) {
+		object->prev->next = object->next;
+	} else {
+		cache->head = object->next;
+	}
+
+	if (object->next != NULL) {
+		object->next->prev = object->prev;
+	} else {
+		cache->tail = object->prev;
+	}
+
+	object->prev = NULL;
+	object->next = NULL;
+}
+
+static void bus_signature_object_remove(bus_signature_cache_t *cache, bus_signature_object_t *object)
+{
+	bus_signature_object_forget(cache, object->key, object->key_size);
+
+	bus_signature_object_unlink(cache, object);
+	hashmap_remove(cache->objects, object->key, object->key_size);
+	free(object->key);
+	free(object);
+}
+
+static void bus_signature_object_forget(bus_signature_cache_t *cache, const char *object_key, size_t object_key_size)
+{
+	bus_signature_prefix_t prefix = {0};
+
+	// "service\0path\0" matches the methods of the object but not of its children
+	prefix.cache = cache;
+	prefix.prefix = object_key;
+	prefix.prefix_size = object_key_size;
+	hashmap_foreach(cache->signatures, bus_signature_prefix_match, &prefix);
+}
+
+static int bus_introspect_parse(bus_signature_cache_t *cache, const char *service, const char *object_path, const char *xml)
+{
+	int error = 0;
+	const char *tag = xml;
+	const char *tag_end = NULL;
+	size_t tag_size = 0;
+	bool is_closing = false;
+	bool is_self_closing = false;
+	bool in_method = false;
+	int node_depth = 0;
+	char interface[SD_BUS_MAXIMUM_NAME_LENGTH + 1] = {0};
+	char method[SD_BUS_MAXIMUM_NAME_LENGTH + 1] = {0};
+	char signature[SD_BUS_MAXIMUM_SIGNATURE_LENGTH + 1] = {0};
+	char direction[8] = {0};
+	char type[SD_BUS_MAXIMUM_SIGNATURE_LENGTH + 1] = {0};
+
+	while ((tag = strchr(tag, '<')) != NULL) {
+		tag++;
+
+		if (strncmp(tag, "!--", 3) == 0) {
+			tag = strstr(tag, "-->");
+			if (tag == NULL) {
+				return -EBADMSG;
+			}
+			continue;
+		}
+
+		tag_end = strchr(tag, '>');
+		if (tag_end == NULL) {
+			return -EBADMSG;
+		}
+
+		// processing instructions and the doctype declaration
+		if (*tag == '?' || *tag == '!') {
+			tag = tag_end + 1;
+			continue;
+		}
+
+		is_closing = (*tag == '/');
+		if (is_closing) {
+			tag++;
+		}
+		is_self_closing = (tag_end > tag && *(tag_end - 1) == '/');
+
+		for (tag_size = 0; isalpha((unsigned char) tag[tag_size]); tag_size++)
+			;
+
+		if (bus_introspect_tag_is(tag, tag_size, "node")) {
+			if (is_closing) {
+				node_depth--;
+			} else if (!is_self_closing) {
+				node_depth++;
+			}
+		} else if (node_depth != 1) {
+			// interfaces of child nodes belong to another object path
+		} else if (bus_introspect_tag_is(tag, tag_size, "interface")) {
+			if (is_closing) {
+				interface[0] = '\0';
+			} else if (bus_introspect_attribute(tag, tag_end, "name", interface, sizeof(interface)) < 0) {
+				return -EBADMSG;
+			}
+		} else if (bus_introspect_tag_is(tag, tag_size, "method") && interface[0] != '\0') {
+			if (!is_closing) {
+				if (bus_introspect_attribute(tag, tag_end, "name", method, sizeof(method)) < 0) {
+					return -EBADMSG;
+				}
+				signature[0] = '\0';
+				in_method = true;
+			}
+
+			if ((is_closing || is_self_closing) && in_method) {
+				error = bus_signature_store(cache, service, object_path, interface, method, signature);
+				if (error < 0) {
+					return error;
+				}
+				in_method = false;
+			}
+		} else if (bus_introspect_tag_is(tag, tag_size, "arg") && in_method && !is_closing) {
+			if (bus_introspect_attribute(tag, tag_end, "type", type, sizeof(type)) < 0) {
+				return -EBADMSG;
+			}
+
+			// the direction of method arguments defaults to "in"
+			if (bus_introspect_attribute(tag, tag_end, "direction", direction, sizeof(direction)) < 0 ||
+				strcmp(direction, "in") == 0) {
+				if (strlen(signature) + strlen(type) >= sizeof(signature)) {
+					return -EBADMSG;
+				}
+				strcat(signature, type);
+			}
+		}
+
+		tag = tag_end + 1;
+	}
+
+	return 0;
+}
+
+static bool bus_introspect_tag_is(const char *tag, size_t tag_size, const char *name)
+{
+	return strlen(name) == tag_size && strncmp(tag, name, tag_size) == 0;
+}
+
+static int bus_introspect_attribute(const char *tag, const char *tag_end, const char *attribute, char *value, size_t value_size)
+{
+	size_t attribute_size = strlen(attribute);
+	const char *position = tag;
+	const char *value_end = NULL;
+	char quote = 0;
+
+	for (; position + attribute_size < tag_end; position++) {
+		if (isspace((unsigned char) *position) && strncmp(position + 1, attribute, attribute_size) == 0 &&
+			position[attribute_size + 1] == '=') {
+			position += attribute_size + 1;
+			quote = position[1];
+			if (quote != '"' && quote != '\'') {
+				return -EBADMSG;
+			}
+
+			position += 2;
+			value_end = strchr(position, quote);
+			if (value_end == NULL || value_end > tag_end || (size_t)(value_end - position) >= value_size) {
+				return -EBADMSG;
+			}
+
+			memcpy(value, position, (size_t)(value_end - position));
+			value[value_end - position] = '\0';
+
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file introspect-sd-bus.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for the introspection backed method signature cache
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _INTROSPECT_SDBUS_H_
+#define _INTROSPECT_SDBUS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <systemd/sd-bus.h>
+
+typedef struct bus_signature_cache_s bus_signature_cache_t;
+
+int bus_signature_cache_create(bus_signature_cache_t **cache);
+void bus_signature_cache_destroy(bus_signature_cache_t *cache);
+
+int bus_signature_cache_lookup(bus_signature_cache_t *cache, sd_bus *bus, uint64_t timeout_usec, const char *service,
+							   const char *object_path, const char *interface, const char *method, char *signature,
+							   size_t signature_size);
+void bus_signature_cache_invalidate(bus_signature_cache_t *cache, const char *service);
+void bus_signature_cache_clear(bus_signature_cache_t *cache);
+
+#endif //_INTROSPECT_SDBUS_H_
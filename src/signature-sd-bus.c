@@ -0,0 +1,313 @@
+/**
+ * @file signature-sd-bus.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements compiling of sd-bus signatures.
+ *        A signature is validated and turned into a flat array of ops once,
+ *        with the extent and the contents signature of every container
+ *        precomputed, so the encoder and decoder never have to walk the
+ *        signature string again. Compiled programs are memoized per signature.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <systemd/sd-bus-protocol.h>
+
+#include "hashmap.h"
+#include "signature-sd-bus.h"
+
+// at most 32 nested arrays and 32 nested structs
+#define BUS_SIGNATURE_DEPTH_MAX 64
+// signatures seen beyond this are compiled on every use instead of memoized
+#define BUS_SIGNATURE_CACHE_MAX 1024
+
+// contents of a container while compiling, before they are copied into the pool
+typedef struct bus_signature_span_s {
+	size_t offset;
+	size_t size;
+} bus_signature_span_t;
+
+static pthread_mutex_t bus_signature_lock = PTHREAD_MUTEX_INITIALIZER;
+static hashmap_t *bus_signature_programs = NULL;
+
+static int bus_signature_compile(const char *signature, bus_signature_program_t **program);
+static int bus_signature_compile_type(bus_signature_program_t *program, bus_signature_span_t *spans,
+									  const char *signature, size_t *offset, unsigned depth, bool in_array);
+static bool bus_signature_type_is_basic(char type);
+static void bus_signature_program_free(void *program);
+
+int bus_signature_program_get(const char *signature, const bus_signature_program_t **program)
+{
+	int error = 0;
+	size_t signature_size = 0;
+	bus_signature_program_t *compiled = NULL;
+	bus_signature_program_t *memoized = NULL;
+
+	if (signature == NULL || program == NULL) {
+		return -EINVAL;
+	}
+
+	signature_size = strlen(signature);
+
+	pthread_mutex_lock(&bus_signature_lock);
+	if (bus_signature_programs != NULL) {
+		memoized = hashmap_get(bus_signature_programs, signature, signature_size);
+	}
+	pthread_mutex_unlock(&bus_signature_lock);
+
+	if (memoized != NULL) {
+		*program = memoized;
+		return 0;
+	}
+
+	error = bus_signature_compile(signature, &compiled);
+	if (error < 0) {
+		return error;
+	}
+
+	pthread_mutex_lock(&bus_signature_lock);
+	if (bus_signature_programs == NULL) {
+		hashmap_create(&bus_signature_programs, bus_signature_program_free);
+	}
+
+	if (bus_signature_programs != NULL) {
+		// another thread may have compiled the same signature in the meantime
+		memoized = hashmap_get(bus_signature_programs, signature, signature_size);
+		if (memoized == NULL && hashmap_size(bus_signature_programs) < BUS_SIGNATURE_CACHE_MAX &&
+			hashmap_insert(bus_signature_programs, signature, signature_size, compiled) == 0) {
+			compiled->memoized = true;
+			memoized = compiled;
+		}
+	}
+	pthread_mutex_unlock(&bus_signature_lock);
+
+	if (memoized != NULL && memoized != compiled) {
+		bus_signature_program_free(compiled);
+		compiled = memoized;
+	}
+
+	*program = compiled;
+
+	return 0;
+}
+
+void bus_signature_program_put(const bus_signature_program_t *program)
+{
+	// memoized programs live until the cache is cleared
+	if (program != NULL && !program->memoized) {
+		bus_signature_program_free((void *) program);
+	}
+}
+
+void bus_signature_program_cache_clear(void)
+{
+	pthread_mutex_lock(&bus_signature_lock);
+	hashmap_destroy(bus_signature_programs);
+	bus_signature_programs = NULL;
+	pthread_mutex_unlock(&bus_signature_lock);
+}
+
+static int bus_signature_compile(const char *signature, bus_signature_program_t **program)
+{
+	int error = 0;
+	size_t signature_size = strlen(signature);
+	size_t offset = 0;
+	size_t contents_size = 0;
+	bus_signature_span_t *spans = NULL;
+	bus_signature_program_t *compiled = NULL;
+
+	if (signature_size > SD_BUS_MAXIMUM_SIGNATURE_LENGTH) {
+		return -EINVAL;
+	}
+
+	compiled = calloc(1, sizeof(bus_signature_program_t));
+	if (compiled == NULL) {
+		return -ENOMEM;
+	}
+
+	// every complete type takes at least one character of the signature
+	compiled->ops = calloc(signature_size ? signature_size : 1, sizeof(bus_signature_op_t));
+	spans = calloc(signature_size ? signature_size : 1, sizeof(bus_signature_span_t));
+	if (compiled->ops == NULL || spans == NULL) {
+		error = -ENOMEM;
+		goto error_out;
+	}
+
+	while (signature[offset] != '\0') {
+		error = bus_signature_compile_type(compiled, spans, signature, &offset, 0, false);
+		if (error < 0) {
+			goto error_out;
+		}
+	}
+
+	for (size_t i = 0; i < compiled->ops_count; i++) {
+		contents_size += spans[i].size + 1;
+	}
+
+	compiled->contents = calloc(contents_size ? contents_size : 1, sizeof(char));
+	if (compiled->contents == NULL) {
+		error = -ENOMEM;
+		goto error_out;
+	}
+
+	contents_size = 0;
+	for (size_t i = 0; i < compiled->ops_count; i++) {
+		if (spans[i].size == 0) {
+			continue;
+		}
+
+		memcpy(compiled->contents + contents_size, signature + spans[i].offset, spans[i].size);
+		compiled->ops[i].contents = compiled->contents + contents_size;
+		contents_size += spans[i].size + 1;
+	}
+
+	free(spans);
+	*program = compiled;
+
+	return 0;
+
+error_out:
+	free(spans);
+	bus_signature_program_free(compiled);
+
+	return error;
+}
+
+static int bus_signature_compile_type(bus_signature_program_t *program, bus_signature_span_t *spans,
+									  const char *signature, size_t *offset, unsigned depth, bool in_array)
+{
+	int error = 0;
+	size_t index = program->ops_count;
+	bus_signature_op_t *op = NULL;
+	char type = signature[*offset];
+
+	if (type == '\0' || depth > BUS_SIGNATURE_DEPTH_MAX) {
+		return -EINVAL;
+	}
+
+	op = &program->ops[index];
+	program->ops_count++;
+
+	if (bus_signature_type_is_basic(type) || type == SD_BUS_TYPE_VARIANT) {
+		op->type = type;
+		(*offset)++;
+	} else if (type == SD_BUS_TYPE_ARRAY) {
+		op->type = SD_BUS_TYPE_ARRAY;
+		(*offset)++;
+		spans[index].offset = *offset;
+
+		error = bus_signature_compile_type(program, spans, signature, offset, depth + 1, true);
+		if (error < 0) {
+			return error;
+		}
+
+		spans[index].size = *offset - spans[index].offset;
+	} else if (type == SD_BUS_TYPE_STRUCT_BEGIN) {
+		op->type = SD_BUS_TYPE_STRUCT;
+		(*offset)++;
+		spans[index].offset = *offset;
+
+		if (signature[*offset] == SD_BUS_TYPE_STRUCT_END) {
+			return -EINVAL;
+		}
+
+		while (signature[*offset] != SD_BUS_TYPE_STRUCT_END) {
+			if (signature[*offset] == '\0') {
+				return -EINVAL;
+			}
+
+			error = bus_signature_compile_type(program, spans, signature, offset, depth + 1, false);
+			if (error < 0) {
+				return error;
+			}
+		}
+
+		spans[index].size = *offset - spans[index].offset;
+		(*offset)++;
+	} else if (type == SD_BUS_TYPE_DICT_ENTRY_BEGIN && in_array) {
+		op->type = SD_BUS_TYPE_DICT_ENTRY;
+		(*offset)++;
+		spans[index].offset = *offset;
+
+		// a dict entry is exactly a basic key and a complete value
+		if (!bus_signature_type_is_basic(signature[*offset])) {
+			return -EINVAL;
+		}
+
+		for (int i = 0; i < 2; i++) {
+			error = bus_signature_compile_type(program, spans, signature, offset, depth + 1, false);
+			if (error < 0) {
+				return error;
+			}
+		}
+
+		if (signature[*offset] != SD_BUS_TYPE_DICT_ENTRY_END) {
+			return -EINVAL;
+		}
+
+		spans[index].size = *offset - spans[index].offset;
+		(*offset)++;
+	} else {
+		return -EINVAL;
+	}
+
+	op->end = program->ops_count;
+
+	return 0;
+}
+
+static bool bus_signature_type_is_basic(char type)
+{
+	switch (type) {
+		case SD_BUS_TYPE_BYTE:
+		case SD_BUS_TYPE_BOOLEAN:
+		case SD_BUS_TYPE_INT16:
+		case SD_BUS_TYPE_UINT16:
+		case SD_BUS_TYPE_INT32:
+		case SD_BUS_TYPE_UINT32:
+		case SD_BUS_TYPE_INT64:
+		case SD_BUS_TYPE_UINT64:
+		case SD_BUS_TYPE_DOUBLE:
+		case SD_BUS_TYPE_STRING:
+		case SD_BUS_TYPE_OBJECT_PATH:
+		case SD_BUS_TYPE_SIGNATURE:
+		case SD_BUS_TYPE_UNIX_FD:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void bus_signature_program_free(void *program)
+{
+	bus_signature_program_t *compiled = (bus_signature_program_t *) program;
+
+	if (compiled == NULL) {
+		return;
+	}
+
+	free(compiled->ops);
+	free(compiled->contents);
+	free(compiled);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file signature-sd-bus.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions for compiling sd-bus signatures
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _SIGNATURE_SDBUS_H_
+#define _SIGNATURE_SDBUS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// one complete type of a compiled signature
+typedef struct bus_signature_op_s {
+	// SD_BUS_TYPE_* of a basic type or a variant, SD_BUS_TYPE_ARRAY,
+	// SD_BUS_TYPE_STRUCT or SD_BUS_TYPE_DICT_ENTRY for containers
+	char type;
+	// index of the op following this complete type, the contents of a
+	// container are the ops between this one and end
+	size_t end;
+	// zero terminated signature of the container contents, NULL for basic types
+	const char *contents;
+} bus_signature_op_t;
+
+// signature compiled into a flat array of ops in pre-order
+typedef struct bus_signature_program_s {
+	bus_signature_op_t *ops;
+	size_t ops_count;
+	char *contents;
+	bool memoized;
+} bus_signature_program_t;
+
+int bus_signature_program_get(const char *signature, const bus_signature_program_t **program);
+void bus_signature_program_put(const bus_signature_program_t *program);
+void bus_signature_program_cache_clear(void);
+
+#endif //_SIGNATURE_SDBUS_H_
@@ -24,39 +24,124 @@
 /*=========================Includes===========================================*/
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 #include <errno.h>
 
-#include <sysrepo.h>
-#include <sysrepo/values.h>
-
 #include <systemd/sd-bus-protocol.h>
 #include <systemd/sd-bus.h>
 
+#include "signature-sd-bus.h"
 #include "transform-sd-bus.h"
 
 // bus argument iterator structure
 typedef struct bus_argument_iterator_s {
 	const char *arguments;
+	size_t arguments_size;
 	size_t arguments_offset;
 
-	char **argument_array;
-	size_t argument_array_size;
+	// tokens are unescaped one after another into a single buffer, every
+	// token consumes at least one character of its own or a separator, so
+	// the buffer never needs more than the argument string plus a terminator
+	char *tokens;
+	size_t tokens_offset;
 
-	size_t argument_array_element_size;
+	bus_bytes_format_t bytes_format;
 } bus_argument_iterator_t;
 
+#define BUS_STRING_CAPACITY_INITIAL 256
+
+// length tracking, geometrically growing output of the decoder
+typedef struct bus_string_s {
+	char *data;
+	size_t size;
+	size_t capacity;
+} bus_string_t;
+
+// state of a single decode, kept out of static storage so replies can be decoded concurrently
+typedef struct bus_decode_context_s {
+	sd_bus_message *message;
+	bus_decode_format_t format;
+	bus_bytes_format_t bytes_format;
+	bus_string_t output;
+} bus_decode_context_t;
+
+// streaming parser state of a JSON argument document
+typedef struct bus_json_parser_s {
+	const char *position;
+	// unescaped value of the last parsed JSON string
+	bus_string_t string;
+	bus_bytes_format_t bytes_format;
+} bus_json_parser_t;
+
+#define BUS_JSON_NUMBER_SIZE_MAX 64
+
+// a single value of any fixed width basic type
+typedef union bus_basic_value_u {
+	uint8_t byte;
+	int boolean;
+	int16_t int16;
+	uint16_t uint16;
+	int32_t int32;
+	uint32_t uint32;
+	int64_t int64;
+	uint64_t uint64;
+	double real;
+} bus_basic_value_t;
+
 int bus_message_encode(const char *signature, const char *arguments, sd_bus_message *m);
 int bus_message_decode(sd_bus_message *m, char **arguments);
-static int bus_message_encode_recursive(const char *signature, bus_argument_iterator_t *iterator, sd_bus_message *m);
+static int bus_message_encode_json_type(bus_json_parser_t *parser, const bus_signature_program_t *program,
+										size_t index, sd_bus_message *m);
+static int bus_message_append_basic_text(sd_bus_message *m, char type, const char *text);
+static int bus_basic_text_parse(char type, const char *text, void *value);
+static int bus_array_size_parse(const bus_argument_iterator_t *iterator, const char *text, size_t *size);
+static size_t bus_fixed_type_size(char type);
+static bool bus_fixed_array_is(const bus_signature_program_t *program, size_t index);
+static int bus_message_encode_fixed_array(bus_argument_iterator_t *iterator, char type, sd_bus_message *m);
+static int bus_message_encode_json_fixed_array(bus_json_parser_t *parser, char type, sd_bus_message *m);
+static int bus_message_decode_fixed_array(bus_decode_context_t *context, char type);
+static int bus_bytes_parse(const char *text, bus_bytes_format_t format, bus_string_t *bytes);
+static int bus_string_append_bytes(bus_string_t *string, const uint8_t *bytes, size_t size, bus_bytes_format_t format);
+static void bus_json_whitespace_skip(bus_json_parser_t *parser);
+static bool bus_json_consume(bus_json_parser_t *parser, char character);
+static int bus_json_expect(bus_json_parser_t *parser, char character);
+static int bus_json_string_parse(bus_json_parser_t *parser);
+static int bus_json_number_parse(bus_json_parser_t *parser, char *number, size_t number_size);
+static int bus_json_literal_parse(bus_json_parser_t *parser, const char *literal);
+static int bus_json_utf8_append(bus_string_t *string, uint32_t code_point);
+static int bus_message_encode_json(const bus_signature_program_t *program, const char *arguments,
+								   bus_bytes_format_t bytes_format, sd_bus_message *m);
+static int bus_message_encode_ops(const bus_signature_program_t *program, size_t begin, size_t end,
+								  bus_argument_iterator_t *iterator, sd_bus_message *m);
+static int bus_message_decode_ops(bus_decode_context_t *context, const bus_signature_program_t *program,
+								  size_t begin, size_t end);
+static int bus_message_decode_xml_ops(bus_decode_context_t *context, const bus_signature_program_t *program,
+									  size_t begin, size_t end);
 static int boolean_parse(const char *string_value, int *boolean_value);
-static int bracket_close_find(const char *bracket_open, size_t *bracket_close_offset);
-static int append_argument(bool is_argument_a_string, const char *argument_to_append, char **arguments_string);
+static int bus_string_append_basic(bus_string_t *string, char type, const void *value);
+static int bus_string_reserve(bus_string_t *string, size_t size);
+static int bus_string_append(bus_string_t *string, const char *data, size_t size);
+static int bus_string_insert(bus_string_t *string, size_t offset, const char *data, size_t size);
+static int bus_string_separate(bus_string_t *string);
+static int bus_string_append_xml_basic(bus_string_t *string, char type, const void *value);
+static int bus_string_append_xml_escaped(bus_string_t *string, const char *text);
+static const char *bus_xml_element_name(char type);
+static int bus_string_printf(bus_string_t *string, const char *format, ...) __attribute__((format(printf, 2, 3)));
 
 static int bus_argument_iterator_create(bus_argument_iterator_t **iterator, const char *argument);
 static int bus_argument_iterator_next(bus_argument_iterator_t *iterator, const char **argument);
 static void bus_argument_iterator_destroy(bus_argument_iterator_t *iterator);
 
 int bus_message_encode(const char *signature, const char *arguments, sd_bus_message *m)
+{
+	return bus_message_encode_format(signature, arguments, BUS_ENCODE_FORMAT_BUSCTL, BUS_BYTES_FORMAT_ARRAY, m);
+}
+
+int bus_message_encode_format(const char *signature, const char *arguments, bus_encode_format_t format,
+							  bus_bytes_format_t bytes_format, sd_bus_message *m)
 {
 	// TYPES STRING GRAMMAR
 	//            types ::= complete_type*
@@ -69,165 +154,77 @@ int bus_message_encode(const char *signature, const char *arguments, sd_bus_mess
 	//            dict_entry ::= "{" basic_type complete_type "}"
 
 	int error = 0;
+	const bus_signature_program_t *program = NULL;
 	bus_argument_iterator_t *argument_iterator = NULL;
 
+	error = bus_signature_program_get(signature, &program);
+	if (error < 0) {
+		goto out;
+	}
+
+	if (format == BUS_ENCODE_FORMAT_JSON) {
+		error = bus_message_encode_json(program, arguments, bytes_format, m);
+		goto out;
+	}
+
 	error = bus_argument_iterator_create(&argument_iterator, arguments);
 	if (error < 0) {
 		goto out;
 	}
+	argument_iterator->bytes_format = bytes_format;
 
-	error = bus_message_encode_recursive(signature, argument_iterator, m);
+	error = bus_message_encode_ops(program, 0, program->ops_count, argument_iterator, m);
 	if (error < 0) {
 		goto out;
 	}
 
 out:
 	bus_argument_iterator_destroy(argument_iterator);
+	bus_signature_program_put(program);
 	return (error < 0) ? error : 0;
 }
 
-static int bus_message_encode_recursive(const char *signature, bus_argument_iterator_t *iterator, sd_bus_message *m)
+static int bus_message_encode_ops(const bus_signature_program_t *program, size_t begin, size_t end,
+								  bus_argument_iterator_t *iterator, sd_bus_message *m)
 {
 	int error = 0;
+	const bus_signature_op_t *op = NULL;
 	char type = 0;
 	const char *argument_next = NULL;
-	int boolean_value = 0;
-	size_t bracket_close_offset = 0;
-	char contents_type[SD_BUS_MAXIMUM_SIGNATURE_LENGTH + 1] = {0};
+	bus_basic_value_t value = {0};
+	const bus_signature_program_t *variant_program = NULL;
 	size_t array_size = 0;
 
-	while ((type = *signature)) {
+	for (size_t i = begin; i < end; i = op->end) {
+		op = &program->ops[i];
+		type = op->type;
+
 		switch (type) {
 			case SD_BUS_TYPE_BOOLEAN:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = boolean_parse(argument_next, &boolean_value);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &boolean_value);
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_BYTE:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(uint8_t){(uint8_t) strtoul(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_INT16:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(int16_t){(int16_t) strtol(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_UINT16:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(uint16_t){(uint16_t) strtoul(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_INT32:
 			case SD_BUS_TYPE_UNIX_FD:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(int32_t){(int32_t) strtol(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_UINT32:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(uint32_t){(uint32_t) strtoul(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_INT64:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(int64_t){(int64_t) strtol(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
-				if (error < 0) {
-					goto out;
-				}
-
-				signature++;
-				break;
-
 			case SD_BUS_TYPE_UINT64:
+			case SD_BUS_TYPE_DOUBLE:
 				error = bus_argument_iterator_next(iterator, &argument_next);
 				if (error < 0) {
 					goto out;
 				}
 
-				error = sd_bus_message_append_basic(m, type, &(uint64_t){(uint64_t) strtoul(argument_next, (char **) NULL, 10)}); // TODO: add an error or range check here?
+				error = bus_basic_text_parse(type, argument_next, &value);
 				if (error < 0) {
 					goto out;
 				}
 
-				signature++;
-				break;
-
-			case SD_BUS_TYPE_DOUBLE:
-				error = bus_argument_iterator_next(iterator, &argument_next);
-				if (error < 0) {
-					goto out;
-				}
-
-				error = sd_bus_message_append_basic(m, type, &(double){strtod(argument_next, (char **) NULL)}); // TODO: add an error or range check here?
+				error = sd_bus_message_append_basic(m, type, &value);
 				if (error < 0) {
 					goto out;
 				}
 
-				signature++;
 				break;
 
 			case SD_BUS_TYPE_STRING:
@@ -243,7 +240,6 @@ static int bus_message_encode_recursive(const char *signature, bus_argument_iter
 					goto out;
 				}
 
-				signature++;
 				break;
 
 			case SD_BUS_TYPE_VARIANT:
@@ -252,38 +248,39 @@ static int bus_message_encode_recursive(const char *signature, bus_argument_iter
 					goto out;
 				}
 
-				error = sd_bus_message_open_container(m, type, argument_next);
+				// the contents of a variant are only known at run time
+				error = bus_signature_program_get(argument_next, &variant_program);
 				if (error < 0) {
 					goto out;
 				}
 
-				error = bus_message_encode_recursive(argument_next, iterator, m);
+				error = sd_bus_message_open_container(m, type, argument_next);
 				if (error < 0) {
 					goto out;
 				}
 
-				error = sd_bus_message_close_container(m);
+				error = bus_message_encode_ops(variant_program, 0, variant_program->ops_count, iterator, m);
 				if (error < 0) {
 					goto out;
 				}
 
-				signature++;
-				break;
-
-			case SD_BUS_TYPE_STRUCT_BEGIN:
-			case SD_BUS_TYPE_DICT_ENTRY_BEGIN:
-				error = bracket_close_find(signature, &bracket_close_offset);
+				error = sd_bus_message_close_container(m);
 				if (error < 0) {
 					goto out;
 				}
-				memcpy(contents_type, signature + 1, bracket_close_offset - 1);
 
-				error = sd_bus_message_open_container(m, (type == SD_BUS_TYPE_STRUCT_BEGIN) ? SD_BUS_TYPE_STRUCT : SD_BUS_TYPE_DICT_ENTRY, contents_type);
+				bus_signature_program_put(variant_program);
+				variant_program = NULL;
+				break;
+
+			case SD_BUS_TYPE_STRUCT:
+			case SD_BUS_TYPE_DICT_ENTRY:
+				error = sd_bus_message_open_container(m, type, op->contents);
 				if (error < 0) {
 					goto out;
 				}
 
-				error = bus_message_encode_recursive(contents_type, iterator, m);
+				error = bus_message_encode_ops(program, i + 1, op->end, iterator, m);
 				if (error < 0) {
 					goto out;
 				}
@@ -293,35 +290,36 @@ static int bus_message_encode_recursive(const char *signature, bus_argument_iter
 					goto out;
 				}
 
-				signature += bracket_close_offset + 1;
-
 				break;
 
 			case SD_BUS_TYPE_ARRAY:
+				// arrays of fixed width types are parsed into memory and appended at once
+				if (bus_fixed_array_is(program, i)) {
+					error = bus_message_encode_fixed_array(iterator, program->ops[i + 1].type, m);
+					if (error < 0) {
+						goto out;
+					}
+
+					break;
+				}
+
 				error = bus_argument_iterator_next(iterator, &argument_next);
 				if (error < 0) {
 					goto out;
 				}
 
-				if (*(signature + 1) == SD_BUS_TYPE_STRUCT_BEGIN || *(signature + 1) == SD_BUS_TYPE_DICT_ENTRY_BEGIN) {
-					error = bracket_close_find(signature + 1, &bracket_close_offset);
-					if (error < 0) {
-						goto out;
-					}
-					memcpy(contents_type, signature + 1, bracket_close_offset + 1);
-				} else {
-					memcpy(contents_type, signature + 1, 1);
+				error = sd_bus_message_open_container(m, type, op->contents);
+				if (error < 0) {
+					goto out;
 				}
 
-				error = sd_bus_message_open_container(m, type, contents_type);
+				error = bus_array_size_parse(iterator, argument_next, &array_size);
 				if (error < 0) {
 					goto out;
 				}
 
-				array_size = strtoul(argument_next, (char **) NULL, 10); // TODO: check return value of strtol
-
-				for (size_t i = 0; i < array_size; i++) {
-					error = bus_message_encode_recursive(contents_type, iterator, m);
+				for (size_t j = 0; j < array_size; j++) {
+					error = bus_message_encode_ops(program, i + 1, op->end, iterator, m);
 					if (error < 0) {
 						goto out;
 					}
@@ -332,12 +330,6 @@ static int bus_message_encode_recursive(const char *signature, bus_argument_iter
 					goto out;
 				}
 
-				if (*(signature + 1) == SD_BUS_TYPE_STRUCT_BEGIN || *(signature + 1) == SD_BUS_TYPE_DICT_ENTRY_BEGIN) {
-					signature += bracket_close_offset + 2;
-				} else {
-					signature += 2;
-				}
-
 				break;
 
 			default:
@@ -347,6 +339,7 @@ static int bus_message_encode_recursive(const char *signature, bus_argument_iter
 	}
 
 out:
+	bus_signature_program_put(variant_program);
 
 	return (error < 0) ? error : 0;
 }
@@ -362,11 +355,20 @@ static int bus_argument_iterator_create(bus_argument_iterator_t **iterator, cons
 	}
 
 	*iterator = calloc(1, sizeof(bus_argument_iterator_t));
+	if (*iterator == NULL) {
+		return -ENOMEM;
+	}
+
 	(*iterator)->arguments = arguments;
+	(*iterator)->arguments_size = strlen(arguments);
 	(*iterator)->arguments_offset = 0;
-	(*iterator)->argument_array = NULL;
-	(*iterator)->argument_array_size = 0;
-	(*iterator)->argument_array_element_size = 0;
+	(*iterator)->tokens = malloc((*iterator)->arguments_size + 1);
+	(*iterator)->tokens_offset = 0;
+	if ((*iterator)->tokens == NULL) {
+		free(*iterator);
+		*iterator = NULL;
+		return -ENOMEM;
+	}
 
 	return 0;
 }
@@ -374,6 +376,11 @@ static int bus_argument_iterator_create(bus_argument_iterator_t **iterator, cons
 static int bus_argument_iterator_next(bus_argument_iterator_t *iterator, const char **argument)
 {
 	bool argument_is_quoted = false;
+	const char *position = NULL;
+	const char *arguments_end = NULL;
+	char *token = NULL;
+	char *token_end = NULL;
+	size_t run_size = 0;
 
 	if (iterator == NULL) {
 		return -1;
@@ -383,36 +390,53 @@ static int bus_argument_iterator_next(bus_argument_iterator_t *iterator, const c
 		return -1;
 	}
 
-	if (*iterator->arguments == '\0') {
+	if (iterator->arguments_offset >= iterator->arguments_size) {
 		return -1;
 	}
 
-	iterator->argument_array = realloc(iterator->argument_array, sizeof(char *) * (iterator->argument_array_size + 1));
-	iterator->argument_array[iterator->argument_array_size] = NULL;
-	iterator->argument_array_element_size = 0;
-	while (iterator->arguments_offset < strlen(iterator->arguments)) {
-		if (iterator->arguments[iterator->arguments_offset] == '\\') {
-			iterator->argument_array[iterator->argument_array_size] = realloc(iterator->argument_array[iterator->argument_array_size], sizeof(char) * (iterator->argument_array_element_size + 1));
-			iterator->argument_array[iterator->argument_array_size][iterator->argument_array_element_size++] = iterator->arguments[iterator->arguments_offset + 1];
-			iterator->arguments_offset += 2;
-		} else if (argument_is_quoted == false && iterator->arguments[iterator->arguments_offset] == '"') {
-			argument_is_quoted = true;
-			iterator->arguments_offset += 1;
-		} else if (argument_is_quoted == true && iterator->arguments[iterator->arguments_offset] == '"') {
-			iterator->arguments_offset += 2;
+	position = iterator->arguments + iterator->arguments_offset;
+	arguments_end = iterator->arguments + iterator->arguments_size;
+	token = iterator->tokens + iterator->tokens_offset;
+	token_end = token;
+
+	while (position < arguments_end) {
+		// copy everything up to the next character that needs handling in one go
+		run_size = strcspn(position, argument_is_quoted ? "\\\"" : "\\\" ");
+		memcpy(token_end, position, run_size);
+		token_end += run_size;
+		position += run_size;
+
+		if (position == arguments_end) {
 			break;
-		} else if (argument_is_quoted == false && iterator->arguments[iterator->arguments_offset] == ' ') {
-			iterator->arguments_offset += 1;
+		}
+
+		if (*position == '\\') {
+			if (position + 1 == arguments_end) {
+				return -1;
+			}
+			*token_end++ = position[1];
+			position += 2;
+		} else if (*position == '"' && argument_is_quoted == false) {
+			argument_is_quoted = true;
+			position++;
+		} else if (*position == '"') {
+			// skip the closing quote and the separator after it
+			position++;
+			if (position < arguments_end && *position == ' ') {
+				position++;
+			}
 			break;
 		} else {
-			iterator->argument_array[iterator->argument_array_size] = realloc(iterator->argument_array[iterator->argument_array_size], sizeof(char) * (iterator->argument_array_element_size + 1));
-			iterator->argument_array[iterator->argument_array_size][iterator->argument_array_element_size++] = iterator->arguments[iterator->arguments_offset];
-			iterator->arguments_offset += 1;
+			position++;
+			break;
 		}
 	}
-	iterator->argument_array[iterator->argument_array_size] = realloc(iterator->argument_array[iterator->argument_array_size], sizeof(char) * (iterator->argument_array_element_size + 1));
-	iterator->argument_array[iterator->argument_array_size][iterator->argument_array_element_size++] = '\0';
-	*argument = iterator->argument_array[iterator->argument_array_size++];
+
+	*token_end++ = '\0';
+
+	iterator->arguments_offset = (size_t)(position - iterator->arguments);
+	iterator->tokens_offset = (size_t)(token_end - iterator->tokens);
+	*argument = token;
 
 	return 0;
 }
@@ -423,11 +447,7 @@ static void bus_argument_iterator_destroy(bus_argument_iterator_t *iterator)
 		return;
 	}
 
-	for (size_t i = 0; i < iterator->argument_array_size; i++) {
-		free(iterator->argument_array[i]);
-	}
-	free(iterator->argument_array);
-
+	free(iterator->tokens);
 	free(iterator);
 }
 
@@ -466,442 +486,1623 @@ static int boolean_parse(const char *string_value, int *boolean_value)
 	return -1;
 }
 
-static int bracket_close_find(const char *bracket_open, size_t *bracket_close_offset)
+int bus_message_decode(sd_bus_message *m, char **arguments)
 {
-	const char *bracket_close = NULL;
-	size_t bracket_counter = 0;
+	return bus_message_decode_format(m, BUS_DECODE_FORMAT_BUSCTL, BUS_BYTES_FORMAT_ARRAY, arguments);
+}
 
-	if (bracket_open && bracket_open[0] == '\0' && bracket_open[0] != SD_BUS_TYPE_STRUCT_BEGIN && bracket_open[0] != SD_BUS_TYPE_DICT_ENTRY_BEGIN) {
-		return -1;
-	}
+int bus_message_decode_format(sd_bus_message *m, bus_decode_format_t format, bus_bytes_format_t bytes_format, char **arguments)
+{
+	// the message is decoded from its beginning, driven by the signature of the whole message
+	return bus_message_decode_type_format(m, sd_bus_message_get_signature(m, true), format, bytes_format, arguments);
+}
 
-	bracket_close = bracket_open + 1;
-	bracket_counter = 1;
+int bus_message_decode_type_format(sd_bus_message *m, const char *signature, bus_decode_format_t format,
+								   bus_bytes_format_t bytes_format, char **arguments)
+{
+	int error = 0;
+	const bus_signature_program_t *program = NULL;
+	bus_decode_context_t context = {.message = m, .format = format, .bytes_format = bytes_format};
+
+	// keep appending to what the caller already has
+	if (*arguments != NULL) {
+		context.output.data = *arguments;
+		context.output.size = strlen(*arguments);
+		context.output.capacity = context.output.size + 1;
+		*arguments = NULL;
+	}
 
-	for (; bracket_close; bracket_close++) {
-		if (*bracket_close == SD_BUS_TYPE_STRUCT_BEGIN || *bracket_close == SD_BUS_TYPE_DICT_ENTRY_BEGIN) {
-			++bracket_counter;
-			continue;
-		}
+	error = bus_signature_program_get(signature, &program);
+	if (error < 0)
+		goto out;
 
-		if (*bracket_close == SD_BUS_TYPE_STRUCT_END || *bracket_close == SD_BUS_TYPE_DICT_ENTRY_END) {
-			if (--bracket_counter) {
-				continue;
-			} else {
-				break;
-			}
-		}
+	if (format == BUS_DECODE_FORMAT_XML) {
+		error = bus_message_decode_xml_ops(&context, program, 0, program->ops_count);
+	} else {
+		error = bus_message_decode_ops(&context, program, 0, program->ops_count);
 	}
+	if (error < 0)
+		goto out;
 
-	if (bracket_counter) {
-		return -1;
+	// a message without arguments decodes to no string at all
+	if (context.output.size > 0) {
+		*arguments = context.output.data;
+		context.output.data = NULL;
 	}
 
-	*bracket_close_offset = (size_t)(bracket_close - bracket_open);
-	if (*bracket_close_offset > SD_BUS_MAXIMUM_SIGNATURE_LENGTH) {
-		return -1;
-	}
+out:
+	free(context.output.data);
+	bus_signature_program_put(program);
 
-	return 0;
+	return (error < 0) ? error : 0;
 }
 
-int bus_message_decode(sd_bus_message *m, char **arguments)
+static int bus_message_decode_ops(bus_decode_context_t *context, const bus_signature_program_t *program,
+								  size_t begin, size_t end)
 {
 	int error = 0;
+	sd_bus_message *m = context->message;
+	bus_string_t *output = &context->output;
+	const bus_signature_op_t *op = NULL;
 	char type = 0;
 	const char *contents = NULL;
-	int buffer_size = 0;
-	char *string_representation_of_argument = NULL;
-	uint8_t argument_byte = 0;
-	int argument_boolean = 0;
-	int16_t argument_int16 = 0;
-	uint16_t argument_uint16 = 0;
-	int32_t argument_int32 = 0;
-	uint32_t argument_uint32 = 0;
-	int64_t argument_int64 = 0;
-	uint64_t argument_uint64 = 0;
-	double argument_double = 0;
-	const char *argument_string = NULL;
-	int argument_fd = 0;
-	char *arguments_tmp = NULL;
-	int count = 0;
-	static bool is_array_loop = false;
-	bool temp;
-
-	while (sd_bus_message_peek_type(m, &type, &contents) > 0) {
+	const bus_signature_program_t *variant_program = NULL;
+	size_t count_offset = 0;
+	size_t count = 0;
+	char count_string[24] = {0};
+	int count_size = 0;
+	union {
+		uint8_t byte;
+		int boolean;
+		int16_t int16;
+		uint16_t uint16;
+		int32_t int32;
+		uint32_t uint32;
+		int64_t int64;
+		uint64_t uint64;
+		double real;
+		const char *string;
+		int fd;
+	} argument;
+
+	for (size_t i = begin; i < end; i = op->end) {
+		op = &program->ops[i];
+		type = op->type;
+
 		switch (type) {
 			case SD_BUS_TYPE_BYTE:
-				error = sd_bus_message_read_basic(m, type, &argument_byte);
+			case SD_BUS_TYPE_BOOLEAN:
+			case SD_BUS_TYPE_INT16:
+			case SD_BUS_TYPE_UINT16:
+			case SD_BUS_TYPE_INT32:
+			case SD_BUS_TYPE_UINT32:
+			case SD_BUS_TYPE_INT64:
+			case SD_BUS_TYPE_UINT64:
+			case SD_BUS_TYPE_DOUBLE:
+			case SD_BUS_TYPE_UNIX_FD:
+			case SD_BUS_TYPE_STRING:
+			case SD_BUS_TYPE_OBJECT_PATH:
+			case SD_BUS_TYPE_SIGNATURE:
+				error = sd_bus_message_read_basic(m, type, &argument);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%u", argument_byte);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%u", argument_byte);
+				error = bus_string_separate(output);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = bus_string_append_basic(output, type, &argument);
 				if (error < 0)
-					goto error_out;
-
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+					goto out;
 
 				break;
 
-			case SD_BUS_TYPE_BOOLEAN:
-				error = sd_bus_message_read_basic(m, type, &argument_boolean);
+			case SD_BUS_TYPE_VARIANT:
+				error = sd_bus_message_peek_type(m, NULL, &contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%d", argument_boolean);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%d", argument_boolean);
+				// the contents of a variant are only known at run time
+				error = bus_signature_program_get(contents, &variant_program);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_enter_container(m, type, contents);
 				if (error < 0)
-					goto error_out;
-
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+					goto out;
 
-				break;
+				error = bus_string_separate(output);
+				if (error < 0)
+					goto out;
 
-			case SD_BUS_TYPE_INT16:
-				error = sd_bus_message_read_basic(m, type, &argument_int16);
+				error = bus_string_append(output, contents, strlen(contents));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%d", argument_int16);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%d", argument_int16);
+				error = bus_message_decode_ops(context, variant_program, 0, variant_program->ops_count);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+				bus_signature_program_put(variant_program);
+				variant_program = NULL;
 
 				break;
 
-			case SD_BUS_TYPE_UINT16:
-				error = sd_bus_message_read_basic(m, type, &argument_uint16);
-				if (error < 0)
-					goto error_out;
+			case SD_BUS_TYPE_ARRAY:
+				// arrays of fixed width types are read in a single copy
+				if (bus_fixed_array_is(program, i)) {
+					error = bus_message_decode_fixed_array(context, program->ops[i + 1].type);
+					if (error < 0)
+						goto out;
 
-				buffer_size = snprintf(NULL, 0, "%u", argument_uint16);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%u", argument_uint16);
-				if (error < 0)
-					goto error_out;
+					break;
+				}
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_enter_container(m, type, op->contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+				error = bus_string_separate(output);
+				if (error < 0)
+					goto out;
 
-				break;
+				// the element count precedes the elements, but is only known once they are decoded
+				count_offset = output->size;
+				count = 0;
+				while (sd_bus_message_at_end(m, false) == 0) {
+					error = bus_message_decode_ops(context, program, i + 1, op->end);
+					if (error < 0)
+						goto out;
 
-			case SD_BUS_TYPE_INT32:
-				error = sd_bus_message_read_basic(m, type, &argument_int32);
-				if (error < 0)
-					goto error_out;
+					count++;
+				}
 
-				buffer_size = snprintf(NULL, 0, "%d", argument_int32);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%d", argument_int32);
+				// elements decoded at the very start of the output have no separator of their own
+				count_size = snprintf(count_string, sizeof(count_string), (count > 0 && count_offset == 0) ? "%zu " : "%zu", count);
+				error = bus_string_insert(output, count_offset, count_string, (size_t) count_size);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
-
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+					goto out;
 
 				break;
 
-			case SD_BUS_TYPE_UINT32:
-				error = sd_bus_message_read_basic(m, type, &argument_uint32);
+			case SD_BUS_TYPE_DICT_ENTRY:
+			case SD_BUS_TYPE_STRUCT:
+				error = sd_bus_message_enter_container(m, type, op->contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%u", argument_uint32);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%u", argument_uint32);
+				error = bus_message_decode_ops(context, program, i + 1, op->end);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
-
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+					goto out;
 
 				break;
 
-			case SD_BUS_TYPE_INT64:
-				error = sd_bus_message_read_basic(m, type, &argument_int64);
-				if (error < 0)
-					goto error_out;
-
-				buffer_size = snprintf(NULL, 0, "%ld", argument_int64);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%ld", argument_int64);
-				if (error < 0)
-					goto error_out;
+			default:
+				error = -EINVAL;
+				goto out;
+		}
+	}
 
-				error = append_argument(false, string_representation_of_argument, arguments);
-				if (error < 0)
-					goto error_out;
+out:
+	bus_signature_program_put(variant_program);
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+	return (error < 0) ? error : 0;
+}
 
-				break;
+static int bus_message_decode_xml_ops(bus_decode_context_t *context, const bus_signature_program_t *program,
+									  size_t begin, size_t end)
+{
+	int error = 0;
+	sd_bus_message *m = context->message;
+	bus_string_t *output = &context->output;
+	const bus_signature_op_t *op = NULL;
+	char type = 0;
+	const char *contents = NULL;
+	const bus_signature_program_t *variant_program = NULL;
+	union {
+		uint8_t byte;
+		int boolean;
+		int16_t int16;
+		uint16_t uint16;
+		int32_t int32;
+		uint32_t uint32;
+		int64_t int64;
+		uint64_t uint64;
+		double real;
+		const char *string;
+		int fd;
+	} argument;
+
+	for (size_t i = begin; i < end; i = op->end) {
+		op = &program->ops[i];
+		type = op->type;
 
-			case SD_BUS_TYPE_UINT64:
-				error = sd_bus_message_read_basic(m, type, &argument_uint64);
+		switch (type) {
+			case SD_BUS_TYPE_VARIANT:
+				error = sd_bus_message_peek_type(m, NULL, &contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%lu", argument_uint64);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%lu", argument_uint64);
+				error = bus_signature_program_get(contents, &variant_program);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_enter_container(m, type, contents);
 				if (error < 0)
-					goto error_out;
-
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+					goto out;
 
-				break;
+				error = bus_string_printf(output, "<variant signature=\"%s\">", contents);
+				if (error < 0)
+					goto out;
 
-			case SD_BUS_TYPE_DOUBLE:
-				error = sd_bus_message_read_basic(m, type, &argument_double);
+				error = bus_message_decode_xml_ops(context, variant_program, 0, variant_program->ops_count);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%g", argument_double);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%g", argument_double);
+				error = bus_string_append(output, "</variant>", strlen("</variant>"));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+				bus_signature_program_put(variant_program);
+				variant_program = NULL;
 
 				break;
 
-			case SD_BUS_TYPE_STRING:
-			case SD_BUS_TYPE_OBJECT_PATH:
-			case SD_BUS_TYPE_SIGNATURE:
-				error = sd_bus_message_read_basic(m, type, &argument_string);
-				if (error < 0)
-					goto error_out;
-
-				error = append_argument(true, argument_string, arguments);
-				if (error < 0)
-					goto error_out;
+			case SD_BUS_TYPE_ARRAY:
+				if (bus_fixed_array_is(program, i)) {
+					error = bus_message_decode_fixed_array(context, program->ops[i + 1].type);
+					if (error < 0)
+						goto out;
 
-				break;
+					break;
+				}
 
-			case SD_BUS_TYPE_UNIX_FD:
-				error = sd_bus_message_read_basic(m, type, &argument_fd);
+				error = sd_bus_message_enter_container(m, type, op->contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%d", argument_fd);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%d", argument_fd);
+				error = bus_string_printf(output, "<array signature=\"%s\">", op->contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
+
+				while (sd_bus_message_at_end(m, false) == 0) {
+					error = bus_message_decode_xml_ops(context, program, i + 1, op->end);
+					if (error < 0)
+						goto out;
+				}
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = bus_string_append(output, "</array>", strlen("</array>"));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+				error = sd_bus_message_exit_container(m);
+				if (error < 0)
+					goto out;
 
 				break;
 
-			case SD_BUS_TYPE_VARIANT:
-				error = sd_bus_message_enter_container(m, type, contents);
+			case SD_BUS_TYPE_STRUCT:
+				error = sd_bus_message_enter_container(m, type, op->contents);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, contents, arguments);
+				error = bus_string_append(output, "<struct>", strlen("<struct>"));
 				if (error < 0)
-					goto error_out;
-
-				free(arguments_tmp);
-				arguments_tmp = NULL;
+					goto out;
 
-				temp = is_array_loop;
-				is_array_loop = false;
-				error = bus_message_decode(m, &arguments_tmp);
+				error = bus_message_decode_xml_ops(context, program, i + 1, op->end);
 				if (error < 0)
-					goto error_out;
-				is_array_loop = temp;
+					goto out;
 
-				error = append_argument(false, arguments_tmp, arguments);
+				error = bus_string_append(output, "</struct>", strlen("</struct>"));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
 				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
 				break;
 
-			case SD_BUS_TYPE_ARRAY:
-				count = 0;
+			case SD_BUS_TYPE_DICT_ENTRY:
+				error = sd_bus_message_enter_container(m, type, op->contents);
+				if (error < 0)
+					goto out;
 
-				error = sd_bus_message_enter_container(m, type, contents);
+				// the key of a dict entry is always a single basic type
+				error = bus_string_append(output, "<dict-entry><key>", strlen("<dict-entry><key>"));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(arguments_tmp);
-				arguments_tmp = NULL;
-				while (sd_bus_message_at_end(m, false) == 0) {
-					is_array_loop = true;
-					error = bus_message_decode(m, &arguments_tmp);
-					if (error < 0)
-						goto error_out;
+				error = bus_message_decode_xml_ops(context, program, i + 1, i + 2);
+				if (error < 0)
+					goto out;
 
-					count++;
-				}
+				error = bus_string_append(output, "</key><value>", strlen("</key><value>"));
+				if (error < 0)
+					goto out;
 
-				is_array_loop = false;
+				error = bus_message_decode_xml_ops(context, program, i + 2, op->end);
+				if (error < 0)
+					goto out;
 
-				buffer_size = snprintf(NULL, 0, "%d", count);
-				string_representation_of_argument = calloc(1, (size_t) buffer_size + 1);
-				error = snprintf(string_representation_of_argument, (size_t) buffer_size + 1, "%d", count);
+				error = bus_string_append(output, "</value></dict-entry>", strlen("</value></dict-entry>"));
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				error = append_argument(false, string_representation_of_argument, arguments);
+				error = sd_bus_message_exit_container(m);
 				if (error < 0)
-					goto error_out;
+					goto out;
 
-				free(string_representation_of_argument);
-				string_representation_of_argument = NULL;
+				break;
 
-				if (count > 0) {
-					error = append_argument(false, arguments_tmp, arguments);
-					if (error < 0)
-						goto error_out;
+			default:
+				if (bus_xml_element_name(type) == NULL) {
+					error = -EINVAL;
+					goto out;
 				}
 
-				error = sd_bus_message_exit_container(m);
+				error = sd_bus_message_read_basic(m, type, &argument);
 				if (error < 0)
-					goto error_out;
+					goto out;
+
+				error = bus_string_append_xml_basic(output, type, &argument);
+				if (error < 0)
+					goto out;
 
 				break;
+		}
+	}
 
-			case SD_BUS_TYPE_DICT_ENTRY:
-			case SD_BUS_TYPE_STRUCT:
-				error = sd_bus_message_enter_container(m, type, contents);
-				if (error < 0)
-					goto error_out;
+out:
+	bus_signature_program_put(variant_program);
 
-				free(arguments_tmp);
-				arguments_tmp = NULL;
+	return (error < 0) ? error : 0;
+}
 
-				while (sd_bus_message_at_end(m, false) == 0) {
-					temp = is_array_loop;
-					is_array_loop = false;
-					error = bus_message_decode(m, &arguments_tmp);
-					if (error < 0)
-						goto error_out;
-					is_array_loop = temp;
-				}
+static int bus_string_append_basic(bus_string_t *string, char type, const void *value)
+{
+	int error = 0;
 
-				error = append_argument(false, arguments_tmp, arguments);
-				if (error < 0)
-					goto error_out;
+	switch (type) {
+		case SD_BUS_TYPE_BYTE:
+			error = bus_string_printf(string, "%u", *(const uint8_t *) value);
+			break;
+		case SD_BUS_TYPE_BOOLEAN:
+		case SD_BUS_TYPE_UNIX_FD:
+			error = bus_string_printf(string, "%d", *(const int *) value);
+			break;
+		case SD_BUS_TYPE_INT16:
+			error = bus_string_printf(string, "%" PRId16, *(const int16_t *) value);
+			break;
+		case SD_BUS_TYPE_UINT16:
+			error = bus_string_printf(string, "%" PRIu16, *(const uint16_t *) value);
+			break;
+		case SD_BUS_TYPE_INT32:
+			error = bus_string_printf(string, "%" PRId32, *(const int32_t *) value);
+			break;
+		case SD_BUS_TYPE_UINT32:
+			error = bus_string_printf(string, "%" PRIu32, *(const uint32_t *) value);
+			break;
+		case SD_BUS_TYPE_INT64:
+			error = bus_string_printf(string, "%" PRId64, *(const int64_t *) value);
+			break;
+		case SD_BUS_TYPE_UINT64:
+			error = bus_string_printf(string, "%" PRIu64, *(const uint64_t *) value);
+			break;
+		case SD_BUS_TYPE_DOUBLE:
+			error = bus_string_printf(string, "%g", *(const double *) value);
+			break;
+		case SD_BUS_TYPE_STRING:
+		case SD_BUS_TYPE_OBJECT_PATH:
+		case SD_BUS_TYPE_SIGNATURE:
+			error = bus_string_printf(string, "\"%s\"", *(const char *const *) value);
+			break;
+		default:
+			error = -EINVAL;
+			break;
+	}
 
-				error = sd_bus_message_exit_container(m);
-				if (error < 0)
-					goto error_out;
+	return error;
+}
 
-				break;
+static int bus_string_reserve(bus_string_t *string, size_t size)
+{
+	size_t capacity = string->capacity ? string->capacity : BUS_STRING_CAPACITY_INITIAL;
+	char *data = NULL;
 
-			default:
-				error = -EINVAL;
-				goto error_out;
+	// room for size more characters and the terminating zero
+	if (string->size + size < string->capacity) {
+		return 0;
+	}
+
+	while (capacity <= string->size + size) {
+		capacity *= 2;
+	}
+
+	data = realloc(string->data, capacity);
+	if (data == NULL) {
+		return -ENOMEM;
+	}
+
+	if (string->data == NULL) {
+		data[0] = '\0';
+	}
+
+	string->data = data;
+	string->capacity = capacity;
+
+	return 0;
+}
+
+static int bus_string_append(bus_string_t *string, const char *data, size_t size)
+{
+	int error = 0;
+
+	error = bus_string_reserve(string, size);
+	if (error < 0) {
+		return error;
+	}
+
+	memcpy(string->data + string->size, data, size);
+	string->size += size;
+	string->data[string->size] = '\0';
+
+	return 0;
+}
+
+static int bus_string_insert(bus_string_t *string, size_t offset, const char *data, size_t size)
+{
+	int error = 0;
+
+	error = bus_string_reserve(string, size);
+	if (error < 0) {
+		return error;
+	}
+
+	memmove(string->data + offset + size, string->data + offset, string->size - offset + 1);
+	memcpy(string->data + offset, data, size);
+	string->size += size;
+
+	return 0;
+}
+
+static int bus_string_separate(bus_string_t *string)
+{
+	return (string->size > 0) ? bus_string_append(string, " ", 1) : 0;
+}
+
+static int bus_string_printf(bus_string_t *string, const char *format, ...)
+{
+	int error = 0;
+	va_list arguments;
+	int size = 0;
+
+	// format straight into the spare capacity, and only grow and retry if it did not fit
+	for (int attempt = 0; attempt < 2; attempt++) {
+		va_start(arguments, format);
+		size = vsnprintf(string->data ? string->data + string->size : NULL,
+						 string->data ? string->capacity - string->size : 0, format, arguments);
+		va_end(arguments);
+		if (size < 0) {
+			return -EINVAL;
 		}
 
-		if (is_array_loop) {
-			break;
+		if (string->data != NULL && (size_t) size < string->capacity - string->size) {
+			string->size += (size_t) size;
+			return 0;
+		}
+
+		error = bus_string_reserve(string, (size_t) size);
+		if (error < 0) {
+			return error;
 		}
 	}
 
-	goto out;
+	return -ENOBUFS;
+}
 
-error_out:
-	free(*arguments);
+static int bus_string_append_xml_basic(bus_string_t *string, char type, const void *value)
+{
+	int error = 0;
+	const char *name = bus_xml_element_name(type);
 
-out:
-	free(string_representation_of_argument);
-	string_representation_of_argument = NULL;
-	free(arguments_tmp);
-	arguments_tmp = NULL;
+	error = bus_string_printf(string, "<%s>", name);
+	if (error < 0) {
+		return error;
+	}
 
-	return (error < 0) ? error : 0;
+	switch (type) {
+		case SD_BUS_TYPE_BOOLEAN:
+			error = bus_string_printf(string, "%s", *(const int *) value ? "true" : "false");
+			break;
+		case SD_BUS_TYPE_DOUBLE:
+			// enough digits for the value to survive a round trip
+			error = bus_string_printf(string, "%.17g", *(const double *) value);
+			break;
+		case SD_BUS_TYPE_STRING:
+		case SD_BUS_TYPE_OBJECT_PATH:
+		case SD_BUS_TYPE_SIGNATURE:
+			error = bus_string_append_xml_escaped(string, *(const char *const *) value);
+			break;
+		default:
+			error = bus_string_append_basic(string, type, value);
+			break;
+	}
+	if (error < 0) {
+		return error;
+	}
+
+	return bus_string_printf(string, "</%s>", name);
 }
 
-static int append_argument(bool is_argument_a_string, const char *argument_to_append, char **arguments_string)
+static int bus_string_append_xml_escaped(bus_string_t *string, const char *text)
 {
-	if (argument_to_append == NULL) {
-		return -1;
+	// markup characters, quotes in case the text ends up in an attribute, and the C0 controls
+	static const char special[] = "&<>\"'"
+								  "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+								  "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f";
+	int error = 0;
+	size_t run_size = 0;
+	const char *entity = NULL;
+
+	while (*text != '\0') {
+		run_size = strcspn(text, special);
+		error = bus_string_append(string, text, run_size);
+		if (error < 0) {
+			return error;
+		}
+		text += run_size;
+
+		switch (*text) {
+			case '\0':
+				return 0;
+			case '&':
+				entity = "&amp;";
+				break;
+			case '<':
+				entity = "&lt;";
+				break;
+			case '>':
+				entity = "&gt;";
+				break;
+			case '"':
+				entity = "&quot;";
+				break;
+			case '\'':
+				entity = "&apos;";
+				break;
+			// the only controls XML 1.0 allows, as references so line ends are not normalized
+			case '\t':
+				entity = "&#9;";
+				break;
+			case '\n':
+				entity = "&#10;";
+				break;
+			case '\r':
+				entity = "&#13;";
+				break;
+			default:
+				// not even a character reference can carry the other controls
+				return -EILSEQ;
+		}
+
+		error = bus_string_append(string, entity, strlen(entity));
+		if (error < 0) {
+			return error;
+		}
+		text++;
 	}
 
-	if (arguments_string == NULL) {
-		return -1;
+	return 0;
+}
+
+static const char *bus_xml_element_name(char type)
+{
+	switch (type) {
+		case SD_BUS_TYPE_BYTE:
+			return "byte";
+		case SD_BUS_TYPE_BOOLEAN:
+			return "boolean";
+		case SD_BUS_TYPE_INT16:
+			return "int16";
+		case SD_BUS_TYPE_UINT16:
+			return "uint16";
+		case SD_BUS_TYPE_INT32:
+			return "int32";
+		case SD_BUS_TYPE_UINT32:
+			return "uint32";
+		case SD_BUS_TYPE_INT64:
+			return "int64";
+		case SD_BUS_TYPE_UINT64:
+			return "uint64";
+		case SD_BUS_TYPE_DOUBLE:
+			return "double";
+		case SD_BUS_TYPE_STRING:
+			return "string";
+		case SD_BUS_TYPE_OBJECT_PATH:
+			return "object-path";
+		case SD_BUS_TYPE_SIGNATURE:
+			return "signature";
+		case SD_BUS_TYPE_UNIX_FD:
+			return "unix-fd";
+		default:
+			return NULL;
+	}
+}
+
+static int bus_message_encode_json(const bus_signature_program_t *program, const char *arguments,
+								   bus_bytes_format_t bytes_format, sd_bus_message *m)
+{
+	int error = 0;
+	bus_json_parser_t parser = {.position = arguments, .bytes_format = bytes_format};
+
+	if (arguments == NULL) {
+		return -EINVAL;
 	}
 
-	if (*arguments_string == NULL) {
-		if (is_argument_a_string) {
-			*arguments_string = calloc(1, strlen("\"") + strlen(argument_to_append) + strlen("\"") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), "\"", strlen("\"") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), argument_to_append, strlen(argument_to_append) + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), "\"", strlen("\"") + 1);
-		} else {
-			*arguments_string = calloc(1, strlen(argument_to_append) + 1);
-			memcpy(*arguments_string, argument_to_append, strlen(argument_to_append) + 1);
+	// the arguments are a JSON array with one value per complete type of the signature
+	error = bus_json_expect(&parser, '[');
+	if (error < 0) {
+		goto out;
+	}
+
+	for (size_t i = 0; i < program->ops_count; i = program->ops[i].end) {
+		if (i > 0) {
+			error = bus_json_expect(&parser, ',');
+			if (error < 0) {
+				goto out;
+			}
 		}
-	} else {
-		if (is_argument_a_string) {
-			*arguments_string = realloc(*arguments_string, strlen(*arguments_string) + strlen(" ") + strlen("\"") + strlen(argument_to_append) + strlen("\"") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), " ", strlen(" ") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), "\"", strlen("\"") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), argument_to_append, strlen(argument_to_append) + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), "\"", strlen("\"") + 1);
-		} else {
-			*arguments_string = realloc(*arguments_string, strlen(*arguments_string) + strlen(" ") + strlen(argument_to_append) + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), " ", strlen(" ") + 1);
-			memcpy(*arguments_string + strlen(*arguments_string), argument_to_append, strlen(argument_to_append) + 1);
+
+		error = bus_message_encode_json_type(&parser, program, i, m);
+		if (error < 0) {
+			goto out;
 		}
 	}
 
-	return 0;
+	error = bus_json_expect(&parser, ']');
+	if (error < 0) {
+		goto out;
+	}
+
+	bus_json_whitespace_skip(&parser);
+	if (*parser.position != '\0') {
+		error = -EINVAL;
+	}
+
+out:
+	free(parser.string.data);
+
+	return error;
+}
+
+static int bus_message_encode_json_type(bus_json_parser_t *parser, const bus_signature_program_t *program,
+										size_t index, sd_bus_message *m)
+{
+	int error = 0;
+	const bus_signature_op_t *op = &program->ops[index];
+	const bus_signature_program_t *variant_program = NULL;
+	char number[BUS_JSON_NUMBER_SIZE_MAX] = {0};
+	bool first = true;
+
+	switch (op->type) {
+		case SD_BUS_TYPE_STRING:
+		case SD_BUS_TYPE_OBJECT_PATH:
+		case SD_BUS_TYPE_SIGNATURE:
+			error = bus_json_string_parse(parser);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = sd_bus_message_append_basic(m, op->type, parser->string.data);
+			break;
+
+		case SD_BUS_TYPE_BOOLEAN:
+			bus_json_whitespace_skip(parser);
+			if (bus_json_literal_parse(parser, "true") == 0) {
+				error = sd_bus_message_append_basic(m, op->type, &(int){1});
+			} else if (bus_json_literal_parse(parser, "false") == 0) {
+				error = sd_bus_message_append_basic(m, op->type, &(int){0});
+			} else {
+				error = -EINVAL;
+			}
+			break;
+
+		case SD_BUS_TYPE_VARIANT:
+			// {"type": "<signature>", "data": <value>}, the same shape busctl --json uses
+			error = bus_json_expect(parser, '{');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_string_parse(parser);
+			if (error < 0 || strcmp(parser->string.data, "type") != 0) {
+				error = -EINVAL;
+				goto out;
+			}
+
+			error = bus_json_expect(parser, ':');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_string_parse(parser);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_signature_program_get(parser->string.data, &variant_program);
+			if (error < 0) {
+				goto out;
+			}
+
+			// a variant holds exactly one complete type
+			if (variant_program->ops_count == 0 || variant_program->ops[0].end != variant_program->ops_count) {
+				error = -EINVAL;
+				goto out;
+			}
+
+			error = sd_bus_message_open_container(m, SD_BUS_TYPE_VARIANT, parser->string.data);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_expect(parser, ',');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_string_parse(parser);
+			if (error < 0 || strcmp(parser->string.data, "data") != 0) {
+				error = -EINVAL;
+				goto out;
+			}
+
+			error = bus_json_expect(parser, ':');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_message_encode_json_type(parser, variant_program, 0, m);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_expect(parser, '}');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = sd_bus_message_close_container(m);
+			break;
+
+		case SD_BUS_TYPE_STRUCT:
+			// a JSON array with one value per member
+			error = bus_json_expect(parser, '[');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = sd_bus_message_open_container(m, op->type, op->contents);
+			if (error < 0) {
+				goto out;
+			}
+
+			for (size_t i = index + 1; i < op->end; i = program->ops[i].end) {
+				if (!first) {
+					error = bus_json_expect(parser, ',');
+					if (error < 0) {
+						goto out;
+					}
+				}
+				first = false;
+
+				error = bus_message_encode_json_type(parser, program, i, m);
+				if (error < 0) {
+					goto out;
+				}
+			}
+
+			error = bus_json_expect(parser, ']');
+			if (error < 0) {
+				goto out;
+			}
+
+			error = sd_bus_message_close_container(m);
+			break;
+
+		case SD_BUS_TYPE_ARRAY:
+			// arrays of fixed width types are parsed into memory and appended at once
+			if (bus_fixed_array_is(program, index)) {
+				error = bus_message_encode_json_fixed_array(parser, program->ops[index + 1].type, m);
+				break;
+			}
+
+			error = sd_bus_message_open_container(m, op->type, op->contents);
+			if (error < 0) {
+				goto out;
+			}
+
+			if (program->ops[index + 1].type == SD_BUS_TYPE_DICT_ENTRY) {
+				// a dictionary is a JSON object, keys of other than string types hold their text form
+				error = bus_json_expect(parser, '{');
+				if (error < 0) {
+					goto out;
+				}
+
+				while (!bus_json_consume(parser, '}')) {
+					if (!first) {
+						error = bus_json_expect(parser, ',');
+						if (error < 0) {
+							goto out;
+						}
+					}
+					first = false;
+
+					error = sd_bus_message_open_container(m, SD_BUS_TYPE_DICT_ENTRY, program->ops[index + 1].contents);
+					if (error < 0) {
+						goto out;
+					}
+
+					error = bus_json_string_parse(parser);
+					if (error < 0) {
+						goto out;
+					}
+
+					error = bus_message_append_basic_text(m, program->ops[index + 2].type, parser->string.data);
+					if (error < 0) {
+						goto out;
+					}
+
+					error = bus_json_expect(parser, ':');
+					if (error < 0) {
+						goto out;
+					}
+
+					error = bus_message_encode_json_type(parser, program, index + 3, m);
+					if (error < 0) {
+						goto out;
+					}
+
+					error = sd_bus_message_close_container(m);
+					if (error < 0) {
+						goto out;
+					}
+				}
+			} else {
+				// elements are appended as they are parsed, no element count is needed up front
+				error = bus_json_expect(parser, '[');
+				if (error < 0) {
+					goto out;
+				}
+
+				while (!bus_json_consume(parser, ']')) {
+					if (!first) {
+						error = bus_json_expect(parser, ',');
+						if (error < 0) {
+							goto out;
+						}
+					}
+					first = false;
+
+					error = bus_message_encode_json_type(parser, program, index + 1, m);
+					if (error < 0) {
+						goto out;
+					}
+				}
+			}
+
+			error = sd_bus_message_close_container(m);
+			break;
+
+		default:
+			// the remaining basic types are JSON numbers
+			error = bus_json_number_parse(parser, number, sizeof(number));
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_message_append_basic_text(m, op->type, number);
+			break;
+	}
+
+out:
+	bus_signature_program_put(variant_program);
+
+	return (error < 0) ? error : 0;
+}
+
+static int bus_message_append_basic_text(sd_bus_message *m, char type, const char *text)
+{
+	int error = 0;
+	bus_basic_value_t value = {0};
+
+	switch (type) {
+		case SD_BUS_TYPE_STRING:
+		case SD_BUS_TYPE_OBJECT_PATH:
+		case SD_BUS_TYPE_SIGNATURE:
+			return sd_bus_message_append_basic(m, type, text);
+
+		default:
+			error = bus_basic_text_parse(type, text, &value);
+			if (error < 0) {
+				return error;
+			}
+			return sd_bus_message_append_basic(m, type, &value);
+	}
+}
+
+// converts the text of a basic value, the whole text has to be a value in range of the type
+static int bus_basic_text_parse(char type, const char *text, void *value)
+{
+	char *text_end = NULL;
+	long long signed_value = 0;
+	unsigned long long unsigned_value = 0;
+	double double_value = 0;
+	int boolean_value = 0;
+
+	errno = 0;
+	switch (type) {
+		case SD_BUS_TYPE_BOOLEAN:
+			if (boolean_parse(text, &boolean_value) < 0) {
+				return -EINVAL;
+			}
+			*(int *) value = boolean_value;
+			return 0;
+
+		case SD_BUS_TYPE_DOUBLE:
+			double_value = strtod(text, &text_end);
+			if (text_end == text || *text_end != '\0' || errno != 0) {
+				return -EINVAL;
+			}
+			*(double *) value = double_value;
+			return 0;
+
+		case SD_BUS_TYPE_BYTE:
+		case SD_BUS_TYPE_UINT16:
+		case SD_BUS_TYPE_UINT32:
+		case SD_BUS_TYPE_UINT64:
+			if (*text == '-') {
+				return -ERANGE;
+			}
+			unsigned_value = strtoull(text, &text_end, 10);
+			if (text_end == text || *text_end != '\0' || errno != 0) {
+				return -EINVAL;
+			}
+
+			switch (type) {
+				case SD_BUS_TYPE_BYTE:
+					if (unsigned_value > UINT8_MAX) {
+						return -ERANGE;
+					}
+					*(uint8_t *) value = (uint8_t) unsigned_value;
+					return 0;
+				case SD_BUS_TYPE_UINT16:
+					if (unsigned_value > UINT16_MAX) {
+						return -ERANGE;
+					}
+					*(uint16_t *) value = (uint16_t) unsigned_value;
+					return 0;
+				case SD_BUS_TYPE_UINT32:
+					if (unsigned_value > UINT32_MAX) {
+						return -ERANGE;
+					}
+					*(uint32_t *) value = (uint32_t) unsigned_value;
+					return 0;
+				default:
+					*(uint64_t *) value = (uint64_t) unsigned_value;
+					return 0;
+			}
+
+		case SD_BUS_TYPE_INT16:
+		case SD_BUS_TYPE_INT32:
+		case SD_BUS_TYPE_INT64:
+		case SD_BUS_TYPE_UNIX_FD:
+			signed_value = strtoll(text, &text_end, 10);
+			if (text_end == text || *text_end != '\0' || errno != 0) {
+				return -EINVAL;
+			}
+
+			switch (type) {
+				case SD_BUS_TYPE_INT16:
+					if (signed_value < INT16_MIN || signed_value > INT16_MAX) {
+						return -ERANGE;
+					}
+					*(int16_t *) value = (int16_t) signed_value;
+					return 0;
+				case SD_BUS_TYPE_INT64:
+					*(int64_t *) value = (int64_t) signed_value;
+					return 0;
+				default:
+					if (signed_value < INT32_MIN || signed_value > INT32_MAX) {
+						return -ERANGE;
+					}
+					*(int32_t *) value = (int32_t) signed_value;
+					return 0;
+			}
+
+		default:
+			return -EINVAL;
+	}
+}
+
+// converts the element count preceding the elements of an array in busctl format
+static int bus_array_size_parse(const bus_argument_iterator_t *iterator, const char *text, size_t *size)
+{
+	char *text_end = NULL;
+	unsigned long long value = 0;
+
+	if (*text == '-') {
+		return -ERANGE;
+	}
+
+	errno = 0;
+	value = strtoull(text, &text_end, 10);
+	if (text_end == text || *text_end != '\0' || errno != 0) {
+		return -EINVAL;
+	}
+
+	// every element takes at least one character, which also bounds the memory reserved for the elements
+	if (value > iterator->arguments_size - iterator->arguments_offset) {
+		return -EINVAL;
+	}
+
+	*size = (size_t) value;
+
+	return 0;
+}
+
+// size of a single element of the types sd-bus can read and append as a plain array, 0 for the others,
+// booleans are left out as sd-bus only appends them one by one
+static size_t bus_fixed_type_size(char type)
+{
+	switch (type) {
+		case SD_BUS_TYPE_BYTE:
+			return sizeof(uint8_t);
+		case SD_BUS_TYPE_INT16:
+		case SD_BUS_TYPE_UINT16:
+			return sizeof(uint16_t);
+		case SD_BUS_TYPE_INT32:
+		case SD_BUS_TYPE_UINT32:
+			return sizeof(uint32_t);
+		case SD_BUS_TYPE_INT64:
+		case SD_BUS_TYPE_UINT64:
+		case SD_BUS_TYPE_DOUBLE:
+			return sizeof(uint64_t);
+		default:
+			return 0;
+	}
+}
+
+// whether the op at index is an array whose elements are a single fixed width type
+static bool bus_fixed_array_is(const bus_signature_program_t *program, size_t index)
+{
+	const bus_signature_op_t *op = &program->ops[index];
+
+	return op->type == SD_BUS_TYPE_ARRAY && op->end == index + 2 && bus_fixed_type_size(program->ops[index + 1].type) > 0;
+}
+
+static int bus_message_encode_fixed_array(bus_argument_iterator_t *iterator, char type, sd_bus_message *m)
+{
+	int error = 0;
+	const char *argument_next = NULL;
+	size_t element_size = bus_fixed_type_size(type);
+	size_t array_size = 0;
+	bus_string_t elements = {0};
+
+	error = bus_argument_iterator_next(iterator, &argument_next);
+	if (error < 0) {
+		goto out;
+	}
+
+	if (type == SD_BUS_TYPE_BYTE && iterator->bytes_format != BUS_BYTES_FORMAT_ARRAY) {
+		// the whole array is a single token
+		error = bus_bytes_parse(argument_next, iterator->bytes_format, &elements);
+		if (error < 0) {
+			goto out;
+		}
+	} else {
+		error = bus_array_size_parse(iterator, argument_next, &array_size);
+		if (error < 0) {
+			goto out;
+		}
+
+		error = bus_string_reserve(&elements, array_size * element_size);
+		if (error < 0) {
+			goto out;
+		}
+
+		for (size_t i = 0; i < array_size; i++) {
+			error = bus_argument_iterator_next(iterator, &argument_next);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_basic_text_parse(type, argument_next, elements.data + elements.size);
+			if (error < 0) {
+				goto out;
+			}
+			elements.size += element_size;
+		}
+	}
+
+	error = sd_bus_message_append_array(m, type, elements.data, elements.size);
+
+out:
+	free(elements.data);
+
+	return (error < 0) ? error : 0;
+}
+
+static int bus_message_encode_json_fixed_array(bus_json_parser_t *parser, char type, sd_bus_message *m)
+{
+	int error = 0;
+	char number[BUS_JSON_NUMBER_SIZE_MAX] = {0};
+	size_t element_size = bus_fixed_type_size(type);
+	bus_string_t elements = {0};
+	bool first = true;
+
+	if (type == SD_BUS_TYPE_BYTE && parser->bytes_format != BUS_BYTES_FORMAT_ARRAY) {
+		// the whole array is a single JSON string
+		error = bus_json_string_parse(parser);
+		if (error < 0) {
+			goto out;
+		}
+
+		error = bus_bytes_parse(parser->string.data, parser->bytes_format, &elements);
+		if (error < 0) {
+			goto out;
+		}
+	} else {
+		error = bus_json_expect(parser, '[');
+		if (error < 0) {
+			goto out;
+		}
+
+		while (!bus_json_consume(parser, ']')) {
+			if (!first) {
+				error = bus_json_expect(parser, ',');
+				if (error < 0) {
+					goto out;
+				}
+			}
+			first = false;
+
+			error = bus_string_reserve(&elements, element_size);
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_json_number_parse(parser, number, sizeof(number));
+			if (error < 0) {
+				goto out;
+			}
+
+			error = bus_basic_text_parse(type, number, elements.data + elements.size);
+			if (error < 0) {
+				goto out;
+			}
+			elements.size += element_size;
+		}
+	}
+
+	error = sd_bus_message_append_array(m, type, elements.data, elements.size);
+
+out:
+	free(elements.data);
+
+	return (error < 0) ? error : 0;
+}
+
+static int bus_message_decode_fixed_array(bus_decode_context_t *context, char type)
+{
+	int error = 0;
+	bus_string_t *output = &context->output;
+	const char *elements = NULL;
+	const void *array = NULL;
+	size_t array_size = 0;
+	size_t element_size = bus_fixed_type_size(type);
+	bool bytes = (type == SD_BUS_TYPE_BYTE && context->bytes_format != BUS_BYTES_FORMAT_ARRAY);
+
+	// enters and leaves the array on its own, the elements point into the message
+	error = sd_bus_message_read_array(context->message, type, &array, &array_size);
+	if (error < 0) {
+		return error;
+	}
+	elements = array;
+
+	if (context->format == BUS_DECODE_FORMAT_XML) {
+		if (bytes) {
+			error = bus_string_printf(output, "<array signature=\"%c\" encoding=\"%s\">", type,
+									  (context->bytes_format == BUS_BYTES_FORMAT_BASE64) ? "base64" : "hex");
+			if (error < 0) {
+				return error;
+			}
+
+			error = bus_string_append_bytes(output, array, array_size, context->bytes_format);
+			if (error < 0) {
+				return error;
+			}
+		} else {
+			error = bus_string_printf(output, "<array signature=\"%c\">", type);
+			if (error < 0) {
+				return error;
+			}
+
+			for (size_t offset = 0; offset < array_size; offset += element_size) {
+				error = bus_string_append_xml_basic(output, type, elements + offset);
+				if (error < 0) {
+					return error;
+				}
+			}
+		}
+
+		return bus_string_append(output, "</array>", strlen("</array>"));
+	}
+
+	error = bus_string_separate(output);
+	if (error < 0) {
+		return error;
+	}
+
+	if (bytes) {
+		// a single quoted token, the same way strings are decoded
+		error = bus_string_append(output, "\"", 1);
+		if (error < 0) {
+			return error;
+		}
+
+		error = bus_string_append_bytes(output, array, array_size, context->bytes_format);
+		if (error < 0) {
+			return error;
+		}
+
+		return bus_string_append(output, "\"", 1);
+	}
+
+	error = bus_string_printf(output, "%zu", array_size / element_size);
+	if (error < 0) {
+		return error;
+	}
+
+	for (size_t offset = 0; offset < array_size; offset += element_size) {
+		error = bus_string_append(output, " ", 1);
+		if (error < 0) {
+			return error;
+		}
+
+		error = bus_string_append_basic(output, type, elements + offset);
+		if (error < 0) {
+			return error;
+		}
+	}
+
+	return 0;
+}
+
+static int bus_bytes_parse(const char *text, bus_bytes_format_t format, bus_string_t *bytes)
+{
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t text_size = strlen(text);
+	const char *digit = NULL;
+	uint32_t group = 0;
+	size_t group_size = 0;
+	size_t padding = 0;
+	int error = 0;
+
+	if (format == BUS_BYTES_FORMAT_HEX) {
+		if (text_size % 2 != 0) {
+			return -EINVAL;
+		}
+
+		error = bus_string_reserve(bytes, text_size / 2);
+		if (error < 0) {
+			return error;
+		}
+
+		for (size_t i = 0; i < text_size; i++) {
+			digit = strchr("0123456789abcdef", (text[i] >= 'A' && text[i] <= 'F') ? text[i] - 'A' + 'a' : text[i]);
+			if (digit == NULL || *digit == '\0') {
+				return -EINVAL;
+			}
+
+			group = (group << 4) | (uint32_t) (digit - "0123456789abcdef");
+			if (i % 2 == 1) {
+				bytes->data[bytes->size++] = (char) group;
+				group = 0;
+			}
+		}
+
+		return 0;
+	}
+
+	// padding is optional, but nothing may follow it
+	if (text_size % 4 == 1) {
+		return -EINVAL;
+	}
+
+	error = bus_string_reserve(bytes, text_size / 4 * 3 + 2);
+	if (error < 0) {
+		return error;
+	}
+
+	for (size_t i = 0; i < text_size; i++) {
+		if (text[i] == '=') {
+			padding++;
+			continue;
+		}
+
+		digit = strchr(base64, text[i]);
+		if (digit == NULL || padding > 0) {
+			return -EINVAL;
+		}
+
+		group = (group << 6) | (uint32_t) (digit - base64);
+		if (++group_size == 4) {
+			bytes->data[bytes->size++] = (char) (group >> 16);
+			bytes->data[bytes->size++] = (char) (group >> 8);
+			bytes->data[bytes->size++] = (char) group;
+			group = 0;
+			group_size = 0;
+		}
+	}
+
+	// a trailing group of two or three digits holds one or two bytes
+	if (group_size == 1 || padding > 2 || (padding > 0 && (group_size + padding) != 4)) {
+		return -EINVAL;
+	}
+	if (group_size == 2) {
+		bytes->data[bytes->size++] = (char) (group >> 4);
+	} else if (group_size == 3) {
+		bytes->data[bytes->size++] = (char) (group >> 10);
+		bytes->data[bytes->size++] = (char) (group >> 2);
+	}
+
+	return 0;
+}
+
+static int bus_string_append_bytes(bus_string_t *string, const uint8_t *bytes, size_t size, bus_bytes_format_t format)
+{
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	static const char hex[] = "0123456789abcdef";
+	char *position = NULL;
+	uint32_t group = 0;
+	size_t i = 0;
+	int error = 0;
+
+	error = bus_string_reserve(string, (format == BUS_BYTES_FORMAT_HEX) ? size * 2 : (size + 2) / 3 * 4);
+	if (error < 0) {
+		return error;
+	}
+	position = string->data + string->size;
+
+	if (format == BUS_BYTES_FORMAT_HEX) {
+		for (i = 0; i < size; i++) {
+			*position++ = hex[bytes[i] >> 4];
+			*position++ = hex[bytes[i] & 0x0f];
+		}
+	} else {
+		for (i = 0; i + 2 < size; i += 3) {
+			group = ((uint32_t) bytes[i] << 16) | ((uint32_t) bytes[i + 1] << 8) | bytes[i + 2];
+			*position++ = base64[(group >> 18) & 0x3f];
+			*position++ = base64[(group >> 12) & 0x3f];
+			*position++ = base64[(group >> 6) & 0x3f];
+			*position++ = base64[group & 0x3f];
+		}
+
+		if (i < size) {
+			group = ((uint32_t) bytes[i] << 16) | ((i + 1 < size) ? (uint32_t) bytes[i + 1] << 8 : 0);
+			*position++ = base64[(group >> 18) & 0x3f];
+			*position++ = base64[(group >> 12) & 0x3f];
+			*position++ = (i + 1 < size) ? base64[(group >> 6) & 0x3f] : '=';
+			*position++ = '=';
+		}
+	}
+
+	*position = '\0';
+	string->size = (size_t) (position - string->data);
+
+	return 0;
+}
+
+static void bus_json_whitespace_skip(bus_json_parser_t *parser)
+{
+	while (*parser->position == ' ' || *parser->position == '\t' || *parser->position == '\n' || *parser->position == '\r') {
+		parser->position++;
+	}
+}
+
+static bool bus_json_consume(bus_json_parser_t *parser, char character)
+{
+	bus_json_whitespace_skip(parser);
+	if (*parser->position != character) {
+		return false;
+	}
+
+	parser->position++;
+
+	return true;
+}
+
+static int bus_json_expect(bus_json_parser_t *parser, char character)
+{
+	return bus_json_consume(parser, character) ? 0 : -EINVAL;
+}
+
+static int bus_json_string_parse(bus_json_parser_t *parser)
+{
+	int error = 0;
+	size_t run_size = 0;
+	uint32_t code_point = 0;
+	uint32_t code_point_low = 0;
+	char *hex_end = NULL;
+	char hex[5] = {0};
+
+	error = bus_json_expect(parser, '"');
+	if (error < 0) {
+		return error;
+	}
+
+	parser->string.size = 0;
+	error = bus_string_reserve(&parser->string, 0);
+	if (error < 0) {
+		return error;
+	}
+	parser->string.data[0] = '\0';
+
+	while (true) {
+		// copy everything up to the next quote or escape in one go
+		run_size = strcspn(parser->position, "\"\\");
+		error = bus_string_append(&parser->string, parser->position, run_size);
+		if (error < 0) {
+			return error;
+		}
+		parser->position += run_size;
+
+		if (*parser->position == '"') {
+			parser->position++;
+			return 0;
+		}
+
+		if (*parser->position == '\0') {
+			return -EINVAL;
+		}
+
+		parser->position++;
+		switch (*parser->position++) {
+			case '"':
+				error = bus_string_append(&parser->string, "\"", 1);
+				break;
+			case '\\':
+				error = bus_string_append(&parser->string, "\\", 1);
+				break;
+			case '/':
+				error = bus_string_append(&parser->string, "/", 1);
+				break;
+			case 'b':
+				error = bus_string_append(&parser->string, "\b", 1);
+				break;
+			case 'f':
+				error = bus_string_append(&parser->string, "\f", 1);
+				break;
+			case 'n':
+				error = bus_string_append(&parser->string, "\n", 1);
+				break;
+			case 'r':
+				error = bus_string_append(&parser->string, "\r", 1);
+				break;
+			case 't':
+				error = bus_string_append(&parser->string, "\t", 1);
+				break;
+			case 'u':
+				if (strnlen(parser->position, 4) < 4) {
+					return -EINVAL;
+				}
+				memcpy(hex, parser->position, 4);
+				code_point = (uint32_t) strtoul(hex, &hex_end, 16);
+				if (hex_end != hex + 4) {
+					return -EINVAL;
+				}
+				parser->position += 4;
+
+				// characters outside the basic plane come as a surrogate pair
+				if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+					if (parser->position[0] != '\\' || parser->position[1] != 'u' || strnlen(parser->position + 2, 4) < 4) {
+						return -EINVAL;
+					}
+					memcpy(hex, parser->position + 2, 4);
+					code_point_low = (uint32_t) strtoul(hex, &hex_end, 16);
+					if (hex_end != hex + 4 || code_point_low < 0xDC00 || code_point_low > 0xDFFF) {
+						return -EINVAL;
+					}
+					parser->position += 6;
+					code_point = 0x10000 + ((code_point - 0xD800) << 10) + (code_point_low - 0xDC00);
+				}
+
+				// sd-bus strings cannot hold a zero character
+				if (code_point == 0) {
+					return -EINVAL;
+				}
+
+				error = bus_json_utf8_append(&parser->string, code_point);
+				break;
+			default:
+				return -EINVAL;
+		}
+		if (error < 0) {
+			return error;
+		}
+	}
+}
+
+static int bus_json_number_parse(bus_json_parser_t *parser, char *number, size_t number_size)
+{
+	size_t size = 0;
+
+	bus_json_whitespace_skip(parser);
+
+	size = strspn(parser->position, "+-0123456789.eE");
+	if (size == 0 || size >= number_size) {
+		return -EINVAL;
+	}
+
+	memcpy(number, parser->position, size);
+	number[size] = '\0';
+	parser->position += size;
+
+	return 0;
+}
+
+static int bus_json_literal_parse(bus_json_parser_t *parser, const char *literal)
+{
+	size_t literal_size = strlen(literal);
+
+	if (strncmp(parser->position, literal, literal_size) != 0) {
+		return -EINVAL;
+	}
+
+	parser->position += literal_size;
+
+	return 0;
+}
+
+static int bus_json_utf8_append(bus_string_t *string, uint32_t code_point)
+{
+	char utf8[4] = {0};
+	size_t utf8_size = 0;
+
+	if (code_point < 0x80) {
+		utf8[utf8_size++] = (char) code_point;
+	} else if (code_point < 0x800) {
+		utf8[utf8_size++] = (char) (0xC0 | (code_point >> 6));
+		utf8[utf8_size++] = (char) (0x80 | (code_point & 0x3F));
+	} else if (code_point < 0x10000) {
+		utf8[utf8_size++] = (char) (0xE0 | (code_point >> 12));
+		utf8[utf8_size++] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+		utf8[utf8_size++] = (char) (0x80 | (code_point & 0x3F));
+	} else {
+		utf8[utf8_size++] = (char) (0xF0 | (code_point >> 18));
+		utf8[utf8_size++] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+		utf8[utf8_size++] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+		utf8[utf8_size++] = (char) (0x80 | (code_point & 0x3F));
+	}
+
+	return bus_string_append(string, utf8, utf8_size);
 }
@@ -32,8 +32,40 @@
 int append_complete_types_to_message(sd_bus_message *m, const char *signature, char **arguments);
 int parse_message_to_string(sd_bus_message *m, char **ret, bool called_from_container);
 
+// text representation a reply is decoded into
+typedef enum bus_decode_format_e {
+	// positional arguments as accepted by busctl
+	BUS_DECODE_FORMAT_BUSCTL = 0,
+	// XML elements named after the sd-bus types, nested like the containers
+	BUS_DECODE_FORMAT_XML,
+} bus_decode_format_t;
+
+// text representation the arguments of a call are encoded from
+typedef enum bus_encode_format_e {
+	// positional arguments as accepted by busctl
+	BUS_ENCODE_FORMAT_BUSCTL = 0,
+	// a JSON array with one value per complete type of the signature
+	BUS_ENCODE_FORMAT_JSON,
+} bus_encode_format_t;
+
+// text representation of byte arrays in the arguments and in a decoded reply
+typedef enum bus_bytes_format_e {
+	// an element count followed by one number per byte, like any other array
+	BUS_BYTES_FORMAT_ARRAY = 0,
+	// a single base64 string
+	BUS_BYTES_FORMAT_BASE64,
+	// a single string of two hexadecimal digits per byte
+	BUS_BYTES_FORMAT_HEX,
+} bus_bytes_format_t;
+
 int bus_message_encode(const char *signature, const char *arguments, sd_bus_message *m);
+int bus_message_encode_format(const char *signature, const char *arguments, bus_encode_format_t format,
+							  bus_bytes_format_t bytes_format, sd_bus_message *m);
 int bus_message_decode(sd_bus_message *m, char **arguments);
+int bus_message_decode_format(sd_bus_message *m, bus_decode_format_t format, bus_bytes_format_t bytes_format, char **arguments);
+// decodes the complete types of signature at the current read position of the message
+int bus_message_decode_type_format(sd_bus_message *m, const char *signature, bus_decode_format_t format,
+								   bus_bytes_format_t bytes_format, char **arguments);
 
 #define FREE_SAFE(x) \
 	do {             \
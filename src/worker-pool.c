@@ -0,0 +1,212 @@
+/**
+ * @file worker-pool.c
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Implements a fixed size pool of worker threads.
+ *        A batch of jobs is handed to the pool at once and queued behind the
+ *        batches of other callers, idle workers claim the next job of the
+ *        oldest batch with jobs left, and the caller is blocked until every
+ *        job of its own batch has finished. Every worker
+ *        keeps its own state, created on the worker thread, so jobs can use
+ *        resources that must not be shared between threads.
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "worker-pool.h"
+
+// a batch lives on the stack of the caller of worker_pool_run()
+typedef struct worker_pool_batch_s {
+	struct worker_pool_batch_s *next;
+	worker_pool_job_cb job;
+	void *userdata;
+	size_t jobs_count;
+	size_t jobs_next;
+	size_t jobs_done;
+} worker_pool_batch_t;
+
+struct worker_pool_s {
+	pthread_t *workers;
+	size_t workers_count;
+	worker_pool_state_create_cb state_create;
+	worker_pool_state_destroy_cb state_destroy;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	bool stopping;
+
+	// batches with jobs not yet claimed, oldest first
+	worker_pool_batch_t *head;
+	worker_pool_batch_t *tail;
+};
+
+static void *worker_pool_worker(void *arg);
+
+int worker_pool_create(worker_pool_t **pool, size_t workers_count,
+					   worker_pool_state_create_cb state_create, worker_pool_state_destroy_cb state_destroy)
+{
+	int error = 0;
+
+	if (pool == NULL || workers_count == 0) {
+		return -EINVAL;
+	}
+
+	*pool = calloc(1, sizeof(worker_pool_t));
+	if (*pool == NULL) {
+		return -ENOMEM;
+	}
+
+	(*pool)->workers = calloc(workers_count, sizeof(pthread_t));
+	if ((*pool)->workers == NULL) {
+		free(*pool);
+		*pool = NULL;
+		return -ENOMEM;
+	}
+
+	(*pool)->state_create = state_create;
+	(*pool)->state_destroy = state_destroy;
+	pthread_mutex_init(&(*pool)->lock, NULL);
+	pthread_cond_init(&(*pool)->work, NULL);
+	pthread_cond_init(&(*pool)->done, NULL);
+
+	for (size_t i = 0; i < workers_count; i++) {
+		error = pthread_create(&(*pool)->workers[i], NULL, worker_pool_worker, *pool);
+		if (error != 0) {
+			worker_pool_destroy(*pool);
+			*pool = NULL;
+			return -error;
+		}
+		(*pool)->workers_count++;
+	}
+
+	return 0;
+}
+
+void worker_pool_destroy(worker_pool_t *pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->workers_count; i++) {
+		pthread_join(pool->workers[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+}
+
+size_t worker_pool_size(worker_pool_t *pool)
+{
+	return (pool == NULL) ? 0 : pool->workers_count;
+}
+
+int worker_pool_run(worker_pool_t *pool, size_t jobs_count, worker_pool_job_cb job, void *userdata)
+{
+	worker_pool_batch_t batch = {0};
+
+	if (pool == NULL || job == NULL) {
+		return -EINVAL;
+	}
+
+	if (jobs_count == 0) {
+		return 0;
+	}
+
+	batch.job = job;
+	batch.userdata = userdata;
+	batch.jobs_count = jobs_count;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->tail != NULL) {
+		pool->tail->next = &batch;
+	} else {
+		pool->head = &batch;
+	}
+	pool->tail = &batch;
+	pthread_cond_broadcast(&pool->work);
+
+	// the batch leaves the queue once its last job is claimed, so only its own jobs are waited for
+	while (batch.jobs_done < batch.jobs_count) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+static void *worker_pool_worker(void *arg)
+{
+	worker_pool_t *pool = (worker_pool_t *) arg;
+	void *state = NULL;
+	worker_pool_batch_t *batch = NULL;
+	size_t index = 0;
+
+	if (pool->state_create != NULL) {
+		state = pool->state_create();
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->stopping && pool->head == NULL) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+		}
+
+		if (pool->stopping) {
+			break;
+		}
+
+		batch = pool->head;
+		index = batch->jobs_next++;
+		if (batch->jobs_next == batch->jobs_count) {
+			pool->head = batch->next;
+			if (pool->head == NULL) {
+				pool->tail = NULL;
+			}
+		}
+		pthread_mutex_unlock(&pool->lock);
+
+		batch->job(index, state, batch->userdata);
+
+		pthread_mutex_lock(&pool->lock);
+		if (++batch->jobs_done == batch->jobs_count) {
+			pthread_cond_broadcast(&pool->done);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if (pool->state_destroy != NULL) {
+		pool->state_destroy(state);
+	}
+
+	return NULL;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file worker-pool.h
+ * @authors Borna Blazevic <borna.blazevic@sartura.hr> Luka Paulic <luka.paulic@sartura.hr>
+ *
+ * @brief Lists the functions of a fixed size pool of worker threads
+ *
+ * @copyright
+ * Copyright (C) 2020 Deutsche Telekom AG.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *	http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*=========================Includes===========================================*/
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+#include <stddef.h>
+
+typedef struct worker_pool_s worker_pool_t;
+
+// called on every worker thread when it starts, the result is passed to every job the worker runs
+typedef void *(*worker_pool_state_create_cb)(void);
+// called on every worker thread when the pool is destroyed
+typedef void (*worker_pool_state_destroy_cb)(void *state);
+// runs a single job of a batch
+typedef void (*worker_pool_job_cb)(size_t job, void *state, void *userdata);
+
+int worker_pool_create(worker_pool_t **pool, size_t workers_count,
+					   worker_pool_state_create_cb state_create, worker_pool_state_destroy_cb state_destroy);
+void worker_pool_destroy(worker_pool_t *pool);
+
+size_t worker_pool_size(worker_pool_t *pool);
+int worker_pool_run(worker_pool_t *pool, size_t jobs_count, worker_pool_job_cb job, void *userdata);
+
+#endif //_WORKER_POOL_H_
@@ -29,11 +29,15 @@ import (
 	"bytes"
 	"errors"
 	"fmt"
+	"io"
 	"io/ioutil"
 	"log"
 	"os"
 	"reflect"
+	"sort"
 	"strconv"
+	"strings"
+	"sync"
 	"time"
 	"encoding/xml"
 	"os/exec"
@@ -65,15 +69,96 @@ type test struct {
 	Replace        [][]interface{}
 	Setup          []test
 	Teardown       []test
+	Sleep          int64
+	Concurrent     int
 	Graph          bool
 }
 
-type Result struct {
-	XMLName		xml.Name 		`xml:"sd-bus-result"`
-    XMLNS    	string   		`xml:"xmlns,attr"`
-    Method    	string   		`xml:"sd-bus-method"`
-    Response    string   		`xml:"sd-bus-response"`
-    Signature   string   		`xml:"sd-bus-signature"`
+// xmlTokens flattens an XML document into comparable tokens, elements by their
+// resolved namespace and name, ignoring whitespace between elements, so any
+// number of results and nested data can be compared with the reply
+func xmlTokens(data string) ([]string, error) {
+	var tokens []string
+
+	decoder := xml.NewDecoder(strings.NewReader(data))
+	for {
+		token, err := decoder.Token()
+		if err == io.EOF {
+			return tokens, nil
+		}
+		if err != nil {
+			return nil, err
+		}
+
+		switch t := token.(type) {
+		case xml.StartElement:
+			var attrs []string
+			for _, attr := range t.Attr {
+				if attr.Name.Space == "xmlns" || attr.Name.Local == "xmlns" {
+					continue
+				}
+				attrs = append(attrs, attr.Name.Space+":"+attr.Name.Local+"="+attr.Value)
+			}
+			sort.Strings(attrs)
+			tokens = append(tokens, "<"+t.Name.Space+":"+t.Name.Local+" "+strings.Join(attrs, " ")+">")
+		case xml.EndElement:
+			tokens = append(tokens, "</"+t.Name.Space+":"+t.Name.Local+">")
+		case xml.CharData:
+			text := strings.TrimSpace(string(t))
+			if text != "" {
+				tokens = append(tokens, text)
+			}
+		}
+	}
+}
+
+// xmlUnqualified drops the namespace of an element token
+func xmlUnqualified(token string) string {
+	if !strings.HasPrefix(token, "<") {
+		return token
+	}
+	prefix := "<"
+	if strings.HasPrefix(token, "</") {
+		prefix = "</"
+	}
+	name := strings.TrimPrefix(token, prefix)
+	separator := strings.LastIndex(strings.SplitN(name, " ", 2)[0], ":")
+	if separator < 0 {
+		return token
+	}
+
+	return prefix + ":" + name[separator+1:]
+}
+
+// xmlMatch compares the reply with the expected response, an expected text of
+// "*" stands for any text, e.g. a value that differs between runs, and an
+// expected element without a namespace matches the element in any namespace
+func xmlMatch(expected string, reply string) bool {
+	expectedTokens, err := xmlTokens(expected)
+	if err != nil {
+		fmt.Printf("ERROR: invalid XMLResponse: %s\n", err)
+		return false
+	}
+	replyTokens, err := xmlTokens(reply)
+	if err != nil || len(expectedTokens) != len(replyTokens) {
+		return false
+	}
+
+	for i := range expectedTokens {
+		if expectedTokens[i] == replyTokens[i] {
+			continue
+		}
+		if strings.HasPrefix(expectedTokens[i], "<:") || strings.HasPrefix(expectedTokens[i], "</:") {
+			if expectedTokens[i] == xmlUnqualified(replyTokens[i]) {
+				continue
+			}
+		}
+		if expectedTokens[i] != "*" || strings.HasPrefix(replyTokens[i], "<") {
+			return false
+		}
+	}
+
+	return true
 }
 
 func fillList(replace *[][]interface{}) (*[][]interface{}, error) {
@@ -178,85 +263,137 @@ func parseConfig(configFile string) {
 		Timeout:         5 * time.Second,
 	}
 
-	s, err := netconf.DialSSH(Config.Login.Address, auth)
+	dial := func() (*netconf.Session, error) {
+		return netconf.DialSSH(Config.Login.Address, auth)
+	}
+
+	s, err := dial()
 	if err != nil {
 		log.Fatal(err)
 	}
 	defer s.Close()
 
 	for i := range Config.Test {
-		cfg := Config.Test[i]
+		runTest(s, dial, Config.Test[i], strconv.Itoa(i+1))
+	}
+}
+
+// runTest sends the requests of a test, its setup steps before and its
+// teardown steps after it, and checks every reply against its XMLResponse
+func runTest(s *netconf.Session, dial func() (*netconf.Session, error), cfg test, name string) {
+	for step := range cfg.Setup {
+		runTest(s, dial, cfg.Setup[step], fmt.Sprintf("%s setup %d", name, step+1))
+	}
 
-		var buffer bytes.Buffer
-		var buffers []bytes.Buffer
+	var buffer bytes.Buffer
+	var buffers []bytes.Buffer
 
-		if cfg.XMLRequestHead != "" {
-			buffer.Write([]byte(cfg.XMLRequestHead))
-		}
+	if cfg.XMLRequestHead != "" {
+		buffer.Write([]byte(cfg.XMLRequestHead))
+	}
 
-		list, err := transform(cfg.Replace)
-		if err != nil {
-			fmt.Println(err)
-		}
+	list, err := transform(cfg.Replace)
+	if err != nil {
+		fmt.Println(err)
+	}
 
-		list_entries := 0
-		if nil == list {
-			if cfg.XMLRequestBody != "" {
-				buffer.Write([]byte(cfg.XMLRequestBody))
-			}
-		} else {
-			for el := range *list {
-				list_entries = list_entries + 1
-				xml := fmt.Sprintf(cfg.XMLRequestBody, (*list)[el]...)
-				if "" == cfg.XMLRequestHead && "" == cfg.XMLRequestTail {
-					var item bytes.Buffer
-					item.Write([]byte(xml))
-					buffers = append(buffers, item)
-				} else {
-					buffer.Write([]byte(xml))
-				}
+	list_entries := 0
+	if nil == list {
+		if cfg.XMLRequestBody != "" {
+			buffer.Write([]byte(cfg.XMLRequestBody))
+		}
+	} else {
+		for el := range *list {
+			list_entries = list_entries + 1
+			xml := fmt.Sprintf(cfg.XMLRequestBody, (*list)[el]...)
+			if "" == cfg.XMLRequestHead && "" == cfg.XMLRequestTail {
+				var item bytes.Buffer
+				item.Write([]byte(xml))
+				buffers = append(buffers, item)
+			} else {
+				buffer.Write([]byte(xml))
 			}
 		}
+	}
 
-		if cfg.XMLRequestTail != "" {
-			buffer.Write([]byte(cfg.XMLRequestTail))
-		}
+	if cfg.XMLRequestTail != "" {
+		buffer.Write([]byte(cfg.XMLRequestTail))
+	}
+
+	if nil == buffers {
+		buffers = append(buffers, buffer)
+	}
 
-		if nil == buffers {
-			buffers = append(buffers, buffer)
+	// e.g. for a cached reply to expire
+	time.Sleep(time.Duration(cfg.Sleep) * time.Millisecond)
+
+	start := time.Now()
+	fmt.Printf("NETCONF requests %d\n", len(buffers))
+	fmt.Printf("NETCONF list entries %d\n", list_entries)
+	fmt.Printf("%s\n", cfg.Message)
+	for item := range buffers {
+		if cfg.Concurrent > 1 {
+			runConcurrent(dial, cfg, buffers[item].String(), name)
+			continue
 		}
+		reply, err := s.Exec(netconf.RawMethod(buffers[item].String()))
+		checkReply(cfg, buffers[item].String(), reply, err, name)
+	}
+	finish := time.Now()
+	fmt.Printf("time elapsed %f\n", finish.Sub(start).Seconds())
+	fmt.Printf("speed is %f entries/sec\n\n", (float64(list_entries) / finish.Sub(start).Seconds()))
+	fmt.Printf("\n")
 
-		start := time.Now()
-		fmt.Printf("NETCONF requests %d\n", len(buffers))
-		fmt.Printf("NETCONF list entries %d\n", list_entries)
-		fmt.Printf("%s\n", Config.Test[i].Message)
-		for item := range buffers {
-			reply, err := s.Exec(netconf.RawMethod(buffers[item].String()))
-			if err != nil {
-				fmt.Println(buffers[item].String())
-				fmt.Printf("ERROR: %s\n", err)
-				fmt.Printf("Fail for test %d\n", i)
-			}
-			if reply == nil {
-				fmt.Printf("ERROR no reply from server\n")
-			} else if cfg.XMLResponse != "" && reply.Data != cfg.XMLResponse {
-				result := Result{}
-				xml.Unmarshal([]byte(cfg.XMLResponse), &result)
-				o, _ := xml.Marshal(result);
-				if string(reply.Data) == string(o) {
-					fmt.Printf("Sucess for test %d\n", i+1)
-				} else {
-					fmt.Printf("Fail for test %d\n", i+1)
-				} 
+	for step := range cfg.Teardown {
+		runTest(s, dial, cfg.Teardown[step], fmt.Sprintf("%s teardown %d", name, step+1))
+	}
+}
 
-			} else {
-				fmt.Printf("Sucess for test %d\n", i+1)
-			}
+// runConcurrent sends the same request from several sessions at once, e.g. for
+// identical calls to share a single sd-bus call, and checks every reply
+func runConcurrent(dial func() (*netconf.Session, error), cfg test, request string, name string) {
+	sessions := make([]*netconf.Session, cfg.Concurrent)
+	for i := range sessions {
+		session, err := dial()
+		if err != nil {
+			fmt.Printf("ERROR: %s\n", err)
+			fmt.Printf("Fail for test %s\n", name)
+			return
 		}
-		finish := time.Now()
-		fmt.Printf("time elapsed %f\n", finish.Sub(start).Seconds())
-		fmt.Printf("speed is %f entries/sec\n\n", (float64(list_entries) / finish.Sub(start).Seconds()))
-		fmt.Printf("\n")
+		defer session.Close()
+		sessions[i] = session
+	}
+
+	replies := make([]*netconf.RPCReply, len(sessions))
+	errs := make([]error, len(sessions))
+	var wait sync.WaitGroup
+	for i := range sessions {
+		wait.Add(1)
+		go func(i int) {
+			defer wait.Done()
+			replies[i], errs[i] = sessions[i].Exec(netconf.RawMethod(request))
+		}(i)
+	}
+	wait.Wait()
+
+	for i := range sessions {
+		checkReply(cfg, request, replies[i], errs[i], fmt.Sprintf("%s session %d", name, i+1))
+	}
+}
+
+func checkReply(cfg test, request string, reply *netconf.RPCReply, err error, name string) {
+	if err != nil {
+		fmt.Println(request)
+		fmt.Printf("ERROR: %s\n", err)
+		fmt.Printf("Fail for test %s\n", name)
+	}
+	if reply == nil {
+		fmt.Printf("ERROR no reply from server\n")
+	} else if cfg.XMLResponse != "" && !xmlMatch(cfg.XMLResponse, reply.Data) {
+		fmt.Println(reply.Data)
+		fmt.Printf("Fail for test %s\n", name)
+	} else {
+		fmt.Printf("Sucess for test %s\n", name)
 	}
 }
 
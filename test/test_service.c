@@ -23,8 +23,16 @@
 
 /*=========================Includes===========================================*/
 #include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <systemd/sd-bus.h>
+#include <systemd/sd-id128.h>
 
 #include <transform-sd-bus.h>
 
@@ -64,6 +72,29 @@
 //For the input '"str_arg" "str_arg" 2 "str_arg" au 1 14460 "str_arg" s "str_arg" 2 "str_arg" 3 "str_arg" y 1 "str_arg" u 2 "str_arg" x 3 "str_arg" 0'
 #define TEST_9_EXPECTED_RESULT "\"str_arg\" \"str_arg\" 2 \"str_arg\" au 1 14460 \"str_arg\" s \"str_arg\" 2 \"str_arg\" 3 \"str_arg\" y 1 \"str_arg\" u 2 \"str_arg\" x 3 \"str_arg\" 0"
 
+//Echo replies with the string it was called with, Control with a string XML cannot carry
+#define ECHO_SIGNATURE "s"
+#define CONTROL_RESULT "bell\a"
+
+//Slow replies like Echo and Fail fails, both only after SLOW_USEC so that identical calls overlap
+#define SLOW_USEC 500000
+#define FAIL_ERROR "net.sysrepo.SDBUSTest.Error.Failed"
+#define FAIL_MESSAGE "failed on purpose"
+
+//Count replies with the number of Slow and Fail calls received since it was last called
+static uint32_t slow_calls = 0;
+
+//Properties read and written by the sd-bus-properties tests
+typedef struct test_properties_s {
+    char *version;
+    uint32_t level;
+} test_properties_t;
+
+static test_properties_t test_properties = {.version = "1.0", .level = 1};
+
+//The object is served peer-to-peer on this socket as well, for the sd-bus-address tests
+#define PEER_SOCKET_PATH "/tmp/sdbus-test.sock"
+
 //Function declarations
 static int method_test1(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_test2(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
@@ -74,7 +105,15 @@ static int method_test6(sd_bus_message *m, void *userdata, sd_bus_error *ret_err
 static int method_test7(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_test8(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int method_test9(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_echo(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_control(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_slow(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_fail(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
+static int method_count(sd_bus_message *m, void *userdata, sd_bus_error *ret_error);
 static int execute_test(const char *test_print_format, sd_bus_message *m, const char *result);
+static int peer_listen(pthread_t *thread);
+static void *peer_accept(void *userdata);
+static void *peer_serve(void *userdata);
 
 /* The vtable of our little object, implements the net.poettering.Calculator interface */
 static const sd_bus_vtable test_vtable[] = {
@@ -88,11 +127,19 @@ static const sd_bus_vtable test_vtable[] = {
     SD_BUS_METHOD("Test7", TEST_7_SIGNATURE, "x", method_test7, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("Test8", TEST_8_SIGNATURE, "x", method_test8, SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_METHOD("Test9", TEST_9_SIGNATURE, "x", method_test9, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Echo", ECHO_SIGNATURE, "s", method_echo, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Control", "", "s", method_control, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Slow", ECHO_SIGNATURE, "s", method_slow, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Fail", ECHO_SIGNATURE, "s", method_fail, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("Count", "", "u", method_count, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_PROPERTY("Version", "s", NULL, offsetof(test_properties_t, version), SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_WRITABLE_PROPERTY("Level", "u", NULL, NULL, offsetof(test_properties_t, level), SD_BUS_VTABLE_UNPRIVILEGED),
     SD_BUS_VTABLE_END};
 
 int main(int argc, char *argv[]) {
     sd_bus_slot *slot = NULL;
     sd_bus *bus = NULL;
+    pthread_t peer_thread;
     int r;
 
     /* Connect to the user bus this time */
@@ -108,7 +155,7 @@ int main(int argc, char *argv[]) {
                                  "/net/sysrepo/SDBUSTest", /* object path */
                                  "net.sysrepo.SDBUSTest",  /* interface name */
                                  test_vtable,
-                                 NULL);
+                                 &test_properties);
     if (r < 0) {
         printf("Failed to issue method call: %s\n", strerror(-r));
         goto finish;
@@ -121,6 +168,12 @@ int main(int argc, char *argv[]) {
         goto finish;
     }
 
+    r = peer_listen(&peer_thread);
+    if (r < 0) {
+        printf("Failed to listen on %s: %s\n", PEER_SOCKET_PATH, strerror(-r));
+        goto finish;
+    }
+
     for (;;) {
         /* Process requests */
         r = sd_bus_process(bus, NULL);
@@ -182,6 +235,148 @@ static int method_test9(sd_bus_message *m, void *userdata, sd_bus_error *ret_err
     return execute_test(TEST_9_SIGNATURE, m, TEST_9_EXPECTED_RESULT);
 }
 
+static int method_echo(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    const char *text = NULL;
+    int r;
+
+    r = sd_bus_message_read(m, ECHO_SIGNATURE, &text);
+    if (r < 0) {
+        return r;
+    }
+
+    return sd_bus_reply_method_return(m, "s", text);
+}
+
+static int method_control(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    return sd_bus_reply_method_return(m, "s", CONTROL_RESULT);
+}
+
+static int method_slow(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    slow_calls++;
+    usleep(SLOW_USEC);
+
+    return method_echo(m, userdata, ret_error);
+}
+
+static int method_fail(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    slow_calls++;
+    usleep(SLOW_USEC);
+
+    return sd_bus_reply_method_errorf(m, FAIL_ERROR, FAIL_MESSAGE);
+}
+
+static int method_count(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+    uint32_t count = slow_calls;
+
+    slow_calls = 0;
+
+    return sd_bus_reply_method_return(m, "u", count);
+}
+
+static int peer_listen(pthread_t *thread) {
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    int fd;
+    int r;
+
+    strncpy(address.sun_path, PEER_SOCKET_PATH, sizeof(address.sun_path) - 1);
+    unlink(PEER_SOCKET_PATH);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        r = -errno;
+        close(fd);
+        return r;
+    }
+
+    r = pthread_create(thread, NULL, peer_accept, (void *) (intptr_t) fd);
+    if (r != 0) {
+        close(fd);
+        return -r;
+    }
+
+    return 0;
+}
+
+static void *peer_accept(void *userdata) {
+    int listen_fd = (int) (intptr_t) userdata;
+    pthread_t thread;
+    int fd;
+
+    for (;;) {
+        fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            printf("Failed to accept a peer: %s\n", strerror(errno));
+            break;
+        }
+
+        /* Every peer gets a connection and a thread of its own */
+        if (pthread_create(&thread, NULL, peer_serve, (void *) (intptr_t) fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    close(listen_fd);
+
+    return NULL;
+}
+
+static void *peer_serve(void *userdata) {
+    int fd = (int) (intptr_t) userdata;
+    sd_bus *bus = NULL;
+    sd_id128_t id;
+    int r;
+
+    r = sd_bus_new(&bus);
+    if (r < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    /* The peer is the server end, clients of any user may connect */
+    r = sd_bus_set_fd(bus, fd, fd);
+    if (r >= 0)
+        r = sd_id128_randomize(&id);
+    if (r >= 0)
+        r = sd_bus_set_server(bus, 1, id);
+    if (r >= 0)
+        r = sd_bus_set_anonymous(bus, 1);
+    if (r >= 0)
+        r = sd_bus_add_object_vtable(bus, NULL, "/net/sysrepo/SDBUSTest", "net.sysrepo.SDBUSTest", test_vtable, &test_properties);
+    if (r >= 0)
+        r = sd_bus_start(bus);
+    if (r < 0) {
+        printf("Failed to serve a peer: %s\n", strerror(-r));
+        goto finish;
+    }
+
+    for (;;) {
+        r = sd_bus_process(bus, NULL);
+        if (r < 0)
+            break;
+        if (r > 0)
+            continue;
+
+        r = sd_bus_wait(bus, (uint64_t)-1);
+        if (r < 0)
+            break;
+    }
+
+finish:
+    /* The fd is closed along with the connection */
+    sd_bus_flush_close_unref(bus);
+
+    return NULL;
+}
+
 static int execute_test(const char *test_signature, sd_bus_message *m, const char *result) {
     int r;
 	char *message = NULL;